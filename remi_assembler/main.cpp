@@ -17,22 +17,27 @@
 #include <iostream>
 
 #include <remi_vm/vm.hpp>
+#include <remi_vm/isa.hpp>
 
 #include "./main.hpp"
 
 int main(int argc, char** argv) {
+    using vm::opcode;
+    using vm::reg;
+    using vm::isa::encode;
+
     u32 program[] = {
-        (u32) vm::instr(vm::opcode::nop),
-        (u32) vm::instr(vm::opcode::mov_lit_reg, vm::word(u16(2)), u8(vm::reg::r1)),
-        (u32) vm::instr(vm::opcode::mov_lit_reg, vm::word(u16(2)), u8(vm::reg::r2)),
-        (u32) vm::instr(vm::opcode::mov_lit_reg, vm::word(i16(-32734)), u8(vm::reg::r3)),
-        (u32) vm::instr(vm::opcode::add_reg_reg, u8(vm::reg::r1), u8(vm::reg::r2)),
-        (u32) vm::instr(vm::opcode::nop),
-        (u32) vm::instr(vm::opcode::mov_lit_reg, vm::word(u16(0x4141)), u8(vm::reg::r5)),
-        (u32) vm::instr(vm::opcode::mov_reg_mem, u8(vm::reg::r5), vm::word(u16(0x7f00))),
-        (u32) vm::instr(vm::opcode::mov_mem_reg, vm::word(u16(0x7f00)), u8(vm::reg::r6)),
+        (u32) encode<opcode::nop>(),
+        (u32) encode<opcode::mov_lit_reg>({2, reg::r1}),
+        (u32) encode<opcode::mov_lit_reg>({2, reg::r2}),
+        (u32) encode<opcode::mov_lit_reg>({u16(i16(-32734)), reg::r3}),
+        (u32) encode<opcode::add_reg_reg>({reg::r1, reg::r2}),
+        (u32) encode<opcode::nop>(),
+        (u32) encode<opcode::mov_lit_reg>({0x4141, reg::r5}),
+        (u32) encode<opcode::mov_reg_mem>({reg::r5, 0x7f00}),
+        (u32) encode<opcode::mov_mem_reg>({0x7f00, reg::r6}),
 
-        (u32) vm::instr(vm::opcode::hlt),
+        (u32) encode<opcode::hlt>(),
     };
 
     // write test rom file
@@ -48,7 +53,7 @@ int main(int argc, char** argv) {
     // For now though we can just hardcode it since this is just a test file.
     region regions[] = {
         // main
-        region {.id = 0, .offset = 24, .size = std::size(program) * sizeof(u32), .loadat = 0x7f00, .bank = 0, .reserved = 0},
+        region {.id = 0, .offset = 24, .size = std::size(program) * sizeof(u32), .loadat = 0x7f00, .bank = 0},
     };
 
     // Region count
@@ -61,7 +66,7 @@ int main(int argc, char** argv) {
         write(rom, u16(regions[i].size));
         write(rom, u16(regions[i].loadat));
         write(rom, u16(regions[i].bank));
-        write(rom, u16(regions[i].reserved));
+        write(rom, u16(regions[i].size >> 16));
     }
 
     // write bytes of all regions (but we just have main region for now so)
@@ -18,6 +18,9 @@
 #include <fstream>
 #include <type_traits>
 
+#include <remi_vm/vm.hpp>
+#include <remi_vm/isa.hpp>
+
 // typedef cstdint types so they're easier to type
 using u8 = uint8_t;
 using u16 = uint16_t;
@@ -39,18 +42,31 @@ struct region {
     // offset in ROM to region
     u32 offset;
     
-    // size of region in bytes
-    u16 size;
+    // size of region in bytes (the low 16 bits are written before loadat, the high 16 bits after bank)
+    u32 size;
     // where to load region in RAM (0 for random)
     u16 loadat;
-    // memory bank to load region in RAM to (65535 for random)
+    // memory bank to load region in RAM to (65535 for random, 65534 for a cartridge that isn't loaded into RAM)
     u16 bank;
-    // padding for now but may be used for something else
-    u16 reserved;
 };
 
 // helper to write binary data to ROM file (because the << operator writes in string format so we can't use that)
 template <typename T>
 void write(std::ofstream& rom, T* data) { rom.write((const char*) data, sizeof(T)); }
 template <typename T>
-void write(std::ofstream& rom, T data) { rom.write((const char*) &data, sizeof(T)); }
\ No newline at end of file
+void write(std::ofstream& rom, T data) { rom.write((const char*) &data, sizeof(T)); }
+
+// TRAP instructions for each host call (see vm::host_call), so programs can call the runtime routines by name.
+// Arguments go in r0, r1 and r2, and results come back in ac and r3.
+namespace intrinsics {
+    inline u32 trap(vm::host_call call) { return (u32) vm::isa::encode<vm::opcode::trap_lit>({u16(call)}); }
+
+    inline u32 memmove() { return trap(vm::host_call::memmove); }
+    inline u32 memset() { return trap(vm::host_call::memset); }
+    inline u32 mulu() { return trap(vm::host_call::mulu); }
+    inline u32 muls() { return trap(vm::host_call::muls); }
+    inline u32 divu() { return trap(vm::host_call::divu); }
+    inline u32 divs() { return trap(vm::host_call::divs); }
+    inline u32 strcmp() { return trap(vm::host_call::strcmp); }
+    inline u32 lz4_decompress() { return trap(vm::host_call::lz4_decompress); }
+}
@@ -0,0 +1,54 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "./audio_output.hpp"
+
+audio_output::audio_output(vm::spsc_ring<i16>& ring, int sample_rate): ring(ring) {
+    SDL_AudioSpec spec = {};
+    spec.format = SDL_AUDIO_S16;
+    spec.channels = 1;
+    spec.freq = sample_rate;
+
+    stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec, feed, this);
+    // Devices opened this way start paused
+    if (stream) {
+        SDL_ResumeAudioStreamDevice(stream);
+    }
+}
+
+audio_output::~audio_output() {
+    if (stream) {
+        SDL_DestroyAudioStream(stream);
+    }
+}
+
+// Called from the SDL audio thread
+void SDLCALL audio_output::feed(void* user, SDL_AudioStream* stream, int additional_amount, int total_amount) {
+    auto* self = static_cast<audio_output*>(user);
+
+    i16 buffer[512];
+    usize needed = usize(additional_amount) / sizeof(i16);
+    while (needed > 0) {
+        usize count = std::min(needed, std::size(buffer));
+        usize popped = self->ring.pop(buffer, count);
+        // Underrun, play silence instead of waiting
+        std::fill(buffer + popped, buffer + count, i16(0));
+
+        SDL_PutAudioStreamData(stream, buffer, int(count * sizeof(i16)));
+        needed -= count;
+    }
+}
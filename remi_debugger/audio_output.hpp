@@ -0,0 +1,37 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <SDL3/SDL.h>
+#include <remi_vm/ring_buffer.hpp>
+
+#include "./main.hpp"
+
+// Plays the console sound output through an SDL audio stream.
+//
+// SDL pulls samples from its own thread through a callback, which only pops from the lock-free ring buffer the
+// sound device fills. There is no lock anywhere on this path, so the UI or emulation stalling can only cause
+// silence, never block the audio thread.
+class audio_output {
+    SDL_AudioStream* stream = nullptr;
+    vm::spsc_ring<i16>& ring;
+
+    static void SDLCALL feed(void* user, SDL_AudioStream* stream, int additional_amount, int total_amount);
+public:
+    audio_output(vm::spsc_ring<i16>& ring, int sample_rate);
+    ~audio_output();
+    audio_output(const audio_output&) = delete;
+    audio_output& operator=(const audio_output&) = delete;
+};
@@ -14,46 +14,92 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <cassert>
-#include <span>
 
 #include <remi_vm/vm.hpp>
 
 #include "./main.hpp"
 #include "./debugger.hpp"
+#include "./profiler.hpp"
 
 // Constructs the debugger with a rom path.
-// Reads the rom from the file. Crashes if the file doesn't exist or is not a remi16 ROM file.
-//
-// (temporary)
-// Reads ROM region 0 (main) and sets it as the current running program. Crashes if region 0 doesn't exist,
-// or contains no code, or its code doesn't end with the "hlt" instruction.
-debugger::debugger(const char* rom_path): bus(cpu) {
-    rom = load_rom_from_file(rom_path);
-    cpu.reset();
-    
-    // Just set program to main region for now
-    const std::vector<u8>& main_region = rom.get_region(0);
-    program = std::span((u32*) main_region.data(), main_region.size() / sizeof(u32));
-    assert(!program.empty());
-    assert(program[program.size()-1] == (u32) vm::instr(vm::opcode::hlt));
+// Reads the rom from the file and loads it into the machine. Crashes if the file doesn't exist, is not a remi16
+// ROM file or has no main region.
+debugger::debugger(const char* rom_path): rom_watcher(rom_path) {
+    rom = vm::load_rom_from_file(rom_path);
+    assert(rom.regions.contains(0));
+    machine.load(rom);
 }
 
-vm::instr debugger::step() {
-    // Fetch instruction
-    u16 pc = cpu.reg(vm::reg::pc);
-    // `program` is an u32 array, but `pc` is supposed to be a byte index. Hence the need for division
-    vm::instr next_instr = vm::instr(program[pc / 4]);
-    if (next_instr.op != vm::opcode::hlt) {
-        // Execute
-        vm::execute(cpu, bus, next_instr);
-        // Program counter always increments by 4 after executing
-        cpu.set(vm::reg::pc, pc + 4);
+void debugger::check_rom_changes() {
+    if (!rom_watcher.changed()) {
+        return;
+    }
+
+    auto result = rom.reload();
+    // Probably caught halfway through being written, the next change will bring the rest
+    reload_failed = !result.ok;
+    if (!result.ok || (result.changed.empty() && !result.layout_changed)) {
+        return;
+    }
+
+    reloaded_regions = result.changed.size();
+    // The next reset loads the new ROM
+    rom_outdated = true;
+
+    // Replays only make sense for the program they were recorded with
+    stop_replay();
+
+    // Patched code runs from where the CPU is now, unless the layout changed under it
+    reload_needs_reset = result.layout_changed;
+    if (!reload_needs_reset) {
+        for (u32 id : result.changed) {
+            machine.load_region(rom.regions.at(id), rom.get_region(id));
+        }
     }
+}
 
-    return next_instr;
+vm::instr debugger::step() {
+    PROFILE_SCOPE(frame_phase::emulation);
+    return machine.step();
 }
 
-// Executes a sakuya16c assembly program. The execution will not stop until a HLT instruction is encountered.
+// Executes a sakuya16c assembly program. The execution will not stop until a HLT instruction is encountered,
+// or the replay being played back ends.
 void debugger::execute() {
-    while (step().op != vm::opcode::hlt) {}
+    PROFILE_SCOPE(frame_phase::emulation);
+    machine.execute();
+}
+
+void debugger::reset() {
+    if (rom_outdated) {
+        machine.load(rom);
+        rom_outdated = false;
+    } else {
+        machine.reset();
+    }
+    reload_needs_reset = false;
+}
+
+void debugger::start_recording(const char* path) {
+    stop_replay();
+    player.reset();
+    reset();
+    recorder = std::make_unique<vm::replay_recorder>(path);
+    machine.attach(recorder.get());
+}
+
+void debugger::start_replay(const char* path) {
+    stop_replay();
+    reset();
+    player = std::make_unique<vm::replay_player>(path);
+    machine.attach(player.get());
+}
+
+void debugger::stop_replay() {
+    machine.attach(nullptr);
+    if (recorder) {
+        recorder->finish(machine);
+        recorder.reset();
+    }
+    // The player is kept around so its result can still be displayed
 }
\ No newline at end of file
@@ -14,31 +14,63 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
-#include <span>
+#include <memory>
 
 #include <remi_vm/vm.hpp>
 #include <remi_vm/mapper.hpp>
+#include <remi_vm/machine.hpp>
+#include <remi_vm/replay.hpp>
+#include <remi_vm/rom_loader.hpp>
 
 #include "./main.hpp"
-#include "./rom_loader.hpp"
+#include "./file_watcher.hpp"
+#include "./memory_scanner.hpp"
 
 // sakuya16c assembly debugger
 class debugger {
-    vm::sakuya16c cpu;
-    vm::bus bus;
+    vm::machine machine;
     
-    loaded_rom rom;
-    // temporary
-    std::span<u32> program;
-    u16 program_addr = 0;
+    vm::loaded_rom rom;
+    file_watcher rom_watcher;
+
+    // Hot reload status, shown with the program
+    usize reloaded_regions = 0;
+    bool reload_failed = false;
+    bool reload_needs_reset = false;
+    // Set when the ROM changed since it was loaded into the machine, so resets must load it again
+    bool rom_outdated = false;
+
+    // At most one of these is active at a time
+    std::unique_ptr<vm::replay_recorder> recorder;
+    std::unique_ptr<vm::replay_player> player;
+
+    memory_scanner scanner;
 public:
     debugger(const char* rom_path);
 
-
     void execute();
     vm::instr step();
+    void reset();
+
+    // Reloads the ROM if its file changed, patching the regions that changed without resetting the machine when
+    // that's safe. Cheap enough to call every frame.
+    void check_rom_changes();
+
+    // Resets the machine and starts recording a replay into `path`.
+    void start_recording(const char* path);
+    // Resets the machine and plays back the replay in `path`.
+    void start_replay(const char* path);
+    // Stops recording or playing back.
+    void stop_replay();
+
+    vm::dev::framebuffer& get_framebuffer() { return machine.framebuffer; }
+    vm::spsc_ring<i16>& get_sound_output() { return machine.sound.output(); }
+    u64 get_instructions() const { return machine.instructions; }
 
     // ImGui methods
     void draw_imgui();
     void draw_current_program_imgui();
+    void draw_replay_imgui();
+    void draw_frame_time_imgui();
+    void draw_memory_scanner_imgui();
 };
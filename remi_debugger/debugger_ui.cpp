@@ -15,12 +15,15 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 #define IMGUI_DEFINE_MATH_OPERATORS
+#include <cstdlib>
 #include <imgui.h>
 #include <remi_vm/vm.hpp>
+#include <remi_vm/isa.hpp>
 #include <remi_vm/mapper.hpp>
 
 #include "./main.hpp"
 #include "./debugger.hpp"
+#include "./profiler.hpp"
 
 // How to format a register value
 enum class regview {
@@ -114,6 +117,9 @@ void cpu_imgui(const vm::sakuya16c &cpu) {
         reg_imgui(cpu, "r7", vm::reg::r7, cpu_ui.regviews[15]);
     ImGui::EndTable();
 
+    ImGui::Separator();
+    ImGui::Text("Interrupts raised: $%04x | pending: $%04x", cpu.status.raised, cpu.status.pending);
+
     ImGui::End();
 }
 
@@ -136,12 +142,30 @@ const char* reg_name(vm::reg reg);
 // Draws with ImGui the arguments of an instruction
 void draw_instr_arguments(vm::instr instr);
 
-// Draws dissassembly of the current running program
+// Reads an instruction from memory through a bank, without going through devices
+static vm::instr read_instr(const vm::dev::memory& memory, u16 bank, u16 addr) {
+    u8 bytes[sizeof(vm::instr)];
+    for (usize i = 0; i < sizeof(vm::instr); i++) {
+        bytes[i] = *memory.bank_read(bank, u16(addr + i), 1);
+    }
+    u32 raw;
+    memcpy(&raw, bytes, sizeof(raw));
+    return vm::instr(raw);
+}
+
+// Draws dissassembly of the main region, as it is in memory right now
 void debugger::draw_current_program_imgui() {
+    const auto& cpu = machine.cpu;
+    const auto& main_region = rom.regions.at(0);
+    u16 code_bank = main_region.bank == 0xffff ? 0 : main_region.bank;
+    usize code_size = std::min<usize>(main_region.size, 0x10000 - main_region.loadat);
+
     ImGui::Begin("Current Program");
     ImGui::Checkbox("Show Overload", &disasm_ui.show_overload);
     ImGui::SameLine();
-    ImGui::Text("| Size: $%zx | Instructions: %zu", program.size_bytes(), program.size());
+    ImGui::Text("| Addr: $%04x | Size: $%zx | Instructions: %zu", main_region.loadat, code_size, code_size / 4);
+    ImGui::SameLine();
+    ImGui::Text("| Cycles: %llu", (unsigned long long) machine.scheduler.cycles);
     ImGui::Separator();
 
     ImGuiTableFlags table_flags = ImGuiTableFlags_Borders 
@@ -149,7 +173,7 @@ void debugger::draw_current_program_imgui() {
         | ImGuiTableFlags_SizingFixedFit
         | ImGuiTableFlags_ScrollY;
 
-    auto current_running_instr = vm::instr(program[cpu.reg(vm::reg::pc) / 4]);
+    auto current_running_instr = machine.fetch();
     if (current_running_instr.op == vm::opcode::hlt) {
         ImGui::BeginDisabled();
     }
@@ -163,16 +187,22 @@ void debugger::draw_current_program_imgui() {
     }
 
     ImGui::SameLine();
-    if (ImGui::Button("Reset")) {
-        cpu.reset();
-        bus.reset();
+    if (ImGui::Button("Reset")) reset();
 
-        // TODO set to appropriate value
-        program_addr = 0; 
-        cpu.set(vm::reg::pc, 0);
+    if (reload_needs_reset) {
+        ImGui::TextColored(COLOR_REGISTER, "The ROM layout changed, the program may not run correctly until reset.");
+        ImGui::SameLine();
+        if (ImGui::Button("Reset now")) reset();
+    } else if (reload_failed) {
+        ImGui::TextColored(COLOR_GRAY, "The ROM file couldn't be read, waiting for the next change.");
+    } else if (reloaded_regions > 0) {
+        ImGui::TextColored(COLOR_GRAY, "ROM reloaded, %zu region(s) patched.", reloaded_regions);
     }
 
-    if (current_running_instr.op == vm::opcode::hlt) {
+    if (machine.faulted) {
+        ImGui::SameLine();
+        ImGui::Text("Unhandled fault");
+    } else if (current_running_instr.op == vm::opcode::hlt) {
         ImGui::SameLine();
         ImGui::Text("Program halted");
     }
@@ -186,13 +216,12 @@ void debugger::draw_current_program_imgui() {
 
     u16 pc = cpu.reg(vm::reg::pc);
     
-    usize addr_counter = program_addr;
-    for (usize program_idx = 0; program_idx < program.size(); program_idx++) {
-        auto next_instr = vm::instr(program[program_idx]);
-        ImGui::Text("$%04zx", addr_counter);
-        addr_counter += 4;
+    for (usize offset = 0; offset + sizeof(vm::instr) <= code_size; offset += sizeof(vm::instr)) {
+        u16 addr = u16(main_region.loadat + offset);
+        auto next_instr = read_instr(machine.bus.memory(), code_bank, addr);
+        ImGui::Text("$%04x", addr);
         ImGui::TableNextColumn();
-        if (program_idx == pc / 4) {
+        if (addr == pc) {
             // Set cell color to blue
             ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0, ImGui::ColorConvertFloat4ToU32(COLOR_HIGHLIGHT));
         }
@@ -215,7 +244,7 @@ static struct {
 
 void mapper_imgui(const std::unique_ptr<vm::mapper_device>& mapper, const vm::bus& bus) {
     auto [range_start, range_end] = mapper->range();
-    u32 num_sections = (range_end - range_start) / 0xFF;
+    u32 num_sections = std::max(1, (range_end - range_start) / 0xFF);
 
     if (memory_ui.current_section == 0) {
         ImGui::BeginDisabled();
@@ -270,7 +299,11 @@ void mapper_imgui(const std::unique_ptr<vm::mapper_device>& mapper, const vm::bu
         ImGui::TableNextColumn();
 
         u8 data_row[16] = {};
-        mapper->read_region(addr, std::min(u16(16), u16(range_end - addr)), data_row);
+        if (addr <= range_end) {
+            // Remapped devices expect addresses relative to the start of their range
+            u16 device_addr = mapper->remap_range() ? u16(addr - range_start) : addr;
+            mapper->read_region(device_addr, std::min(16, range_end - addr + 1), data_row);
+        }
         // Hex view
         for (u16 row = 0; row < 16; row++) {
             if (addr > range_end) break;
@@ -337,97 +370,235 @@ void mappers_imgui(const vm::sakuya16c& cpu, const vm::bus& bus) {
 
 // Renders all debugger ImGui
 void debugger::draw_imgui() {
-    cpu_imgui(cpu);
-    mappers_imgui(cpu, bus);
+    cpu_imgui(machine.cpu);
+    mappers_imgui(machine.cpu, machine.bus);
     draw_current_program_imgui();
+    draw_replay_imgui();
+    draw_frame_time_imgui();
+    draw_memory_scanner_imgui();
+}
+
+static struct {
+    char path[256] = "./test_rom.r16r";
+} replay_ui;
+
+// Draws replay recording and playback controls
+void debugger::draw_replay_imgui() {
+    ImGui::Begin("Replay");
+    ImGui::InputText("File", replay_ui.path, sizeof(replay_ui.path));
+
+    bool active = machine.attached_hook() != nullptr;
+    if (active) ImGui::BeginDisabled();
+    if (ImGui::Button("Record")) start_recording(replay_ui.path);
+    ImGui::SameLine();
+    if (ImGui::Button("Play")) start_replay(replay_ui.path);
+    if (active) ImGui::EndDisabled();
+
+    ImGui::SameLine();
+    if (!active) ImGui::BeginDisabled();
+    if (ImGui::Button("Stop")) stop_replay();
+    if (!active) ImGui::EndDisabled();
+
+    ImGui::Separator();
+    ImGui::Text("Instructions: %llu", (unsigned long long) machine.instructions);
+    if (recorder) {
+        ImGui::Text("Recording...");
+    } else if (player) {
+        switch (player->status) {
+        case vm::replay_status::playing: 
+            ImGui::Text("Playing back...");
+            break;
+        case vm::replay_status::finished:
+            ImGui::Text("Replay finished, every state hash matched");
+            break;
+        case vm::replay_status::mismatch:
+            ImGui::Text(
+                "State hash mismatch between instructions %llu and %llu", 
+                (unsigned long long) (player->failed_at.instruction - std::min(player->failed_at.instruction, player->hash_interval())), 
+                (unsigned long long) player->failed_at.instruction
+            );
+            ImGui::Text("Expected $%016llx", (unsigned long long) player->failed_at.hash);
+            ImGui::Text("Got      $%016llx", (unsigned long long) player->actual_hash);
+            break;
+        case vm::replay_status::invalid:
+            ImGui::Text("Not a valid replay file");
+            break;
+        }
+    }
+
+    ImGui::End();
 }
 
 // Opcode enum to string
 const char* opcode_name(vm::opcode opcode, bool overloaded_name) {
-    switch (opcode) {
-    case vm::opcode::nop: return "nop";
-    case vm::opcode::hlt: return "hlt";
-    case vm::opcode::mov_lit_reg: return overloaded_name ? "mov_lit_reg" : "mov";
-    case vm::opcode::mov_reg_reg: return overloaded_name ? "mov_reg_reg" : "mov";
-    case vm::opcode::mov_mem_reg: return overloaded_name ? "mov_mem_reg" : "mov";
-    case vm::opcode::mov_reg_mem: return overloaded_name ? "mov_reg_mem" : "mov";
-
-    case vm::opcode::add_reg_reg: return overloaded_name ? "add_reg_reg" : "add";
-    }
-    return "???";
+    if (!vm::isa::valid(opcode)) return "???";
+    const auto& info = vm::isa::info(opcode);
+    return overloaded_name ? info.name : info.mnemonic;
 }
 
 // Reg enum to string
 const char* reg_name(vm::reg reg) {
-    switch (reg) {
-    case vm::reg::r0: return "#r0";
-    case vm::reg::r1: return "#r1";
-    case vm::reg::r2: return "#r2";
-    case vm::reg::r3: return "#r3";
-    case vm::reg::r4: return "#r4";
-    case vm::reg::r5: return "#r5";
-    case vm::reg::r6: return "#r6";
-    case vm::reg::r7: return "#r7";
-
-    case vm::reg::pc: return "#pc";
-    case vm::reg::ac: return "#ac";
-    case vm::reg::sp: return "#sp";
-    case vm::reg::fp: return "#fp";
-    case vm::reg::im: return "#im";
-    case vm::reg::mb: return "#mb";
-    case vm::reg::ps: return "#ps";
-    case vm::reg::fl: return "#fl";
-    }
-    return "#??";
+    return vm::isa::reg_name(reg);
 }
 
 void draw_instr_arguments(vm::instr instr) {
-    auto draw_lit_reg = [](vm::instr instr) {
-        u16 lit = vm::word(instr.args[0], instr.args[1]).val;
-        vm::reg reg = static_cast<vm::reg>(instr.args[2]);
-
-        ImGui::TextColored(COLOR_LITERAL, "$%04x", lit);
-        ImGui::SameLine(0, 0);
-        ImGui::Text(", ");
-        ImGui::SameLine(0, 0);
-        ImGui::TextColored(COLOR_REGISTER, "%s", reg_name(reg));
-    };
-
-    auto draw_reg_lit = [](vm::instr instr) {
-        vm::reg reg = static_cast<vm::reg>(instr.args[0]);
-        u16 lit = vm::word(instr.args[1], instr.args[2]).val;
-
-        ImGui::TextColored(COLOR_REGISTER, "%s", reg_name(reg));
-        ImGui::SameLine(0, 0);
-        ImGui::Text(", ");
-        ImGui::SameLine(0, 0);
-        ImGui::TextColored(COLOR_LITERAL, "$%04x", lit);
-    };
-
-    auto draw_reg_reg = [](vm::instr instr) {
-        vm::reg reg1 = static_cast<vm::reg>(instr.args[0]);
-        vm::reg reg2 = static_cast<vm::reg>(instr.args[1]);
-
-        ImGui::TextColored(COLOR_REGISTER, "%s", reg_name(reg1));
-        ImGui::SameLine(0, 0);
-        ImGui::Text(", ");
-        ImGui::SameLine(0, 0);
-        ImGui::TextColored(COLOR_REGISTER, "%s", reg_name(reg2));
-    };
-
-    switch (instr.op) {
-    case vm::opcode::mov_mem_reg:
-    case vm::opcode::mov_lit_reg:
-        draw_lit_reg(instr);
-        break;
-    case vm::opcode::mov_reg_reg:
-    case vm::opcode::add_reg_reg:
-        draw_reg_reg(instr);
-        break;
-    case vm::opcode::mov_reg_mem:
-        draw_reg_lit(instr);
-        break;
-    default:
-        break;
+    auto disasm = vm::isa::disassemble(instr);
+
+    for (u8 i = 0; i < disasm.count; i++) {
+        const auto& operand = disasm.operands[i];
+        if (i > 0) {
+            ImGui::SameLine(0, 0);
+            ImGui::Text(", ");
+            ImGui::SameLine(0, 0);
+        }
+
+        switch (operand.kind) {
+        case vm::isa::operand_kind::reg:
+            ImGui::TextColored(COLOR_REGISTER, "%s", reg_name(vm::reg(operand.value)));
+            break;
+        case vm::isa::operand_kind::lit:
+            ImGui::TextColored(COLOR_LITERAL, "$%04x", operand.value);
+            break;
+        }
+    }
+}
+
+static struct {
+    char trace_path[256] = "./remi16_trace.json";
+    // Result of the last export, shown next to the button
+    const char* export_status = "";
+} frame_time_ui;
+
+// Draws rolling frame time graphs split by phase, guest speed and host CPU usage
+void debugger::draw_frame_time_imgui() {
+    ImGui::Begin("Frame Time");
+#if REMI16_PROFILE
+    const frame_profiler& prof = profiler();
+    usize count = prof.history_size();
+    float frame_ms = prof.average_frame_ms();
+
+    ImGui::Text("Frame: %.2f ms (%.0f fps)", frame_ms, frame_ms > 0 ? 1000.0f / frame_ms : 0.0f);
+    ImGui::Text("Guest: %.2f MIPS (%.2f MIPS while emulating)", prof.guest_mips(), prof.emulation_mips());
+    ImGui::Text("Host CPU: %.0f%%", prof.average_cpu_percent());
+    ImGui::Separator();
+
+    // Every graph shares the scale of the slowest frame, so phases can be compared at a glance
+    float scale_max = 1.0f;
+    for (usize i = 0; i < count; i++) {
+        scale_max = std::max(scale_max, prof.frame_history()[i]);
+    }
+    if (count > 0) {
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "frame %.2f ms", frame_ms);
+        ImGui::PlotLines(
+            "##frame", prof.frame_history(), int(count), int(prof.history_offset() % count), overlay, 0, scale_max,
+            ImVec2(-1, 50)
+        );
+        for (usize phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+            auto current = frame_phase(phase);
+            snprintf(overlay, sizeof(overlay), "%s %.2f ms", frame_phase_name(current), prof.average_ms(current));
+            ImGui::PushID(int(phase));
+            ImGui::PlotLines(
+                "##phase", prof.phase_history(current), int(count), int(prof.history_offset() % count), overlay, 0, 
+                scale_max, ImVec2(-1, 35)
+            );
+            ImGui::PopID();
+        }
     }
-}
\ No newline at end of file
+
+    ImGui::Separator();
+    ImGui::InputText("Trace file", frame_time_ui.trace_path, sizeof(frame_time_ui.trace_path));
+    if (ImGui::Button("Export Chrome trace")) {
+        frame_time_ui.export_status = prof.export_chrome_trace(frame_time_ui.trace_path) 
+            ? "Exported" 
+            : "Couldn't write the trace file";
+    }
+    ImGui::SameLine();
+    ImGui::TextColored(COLOR_GRAY, "%s", frame_time_ui.export_status);
+#else
+    ImGui::TextWrapped("Profiling is compiled out of release builds. Build with REMI16_PROFILE=1 to enable it.");
+#endif
+    ImGui::End();
+}
+
+static struct {
+    i32 width = 0;
+    i32 compare = 0;
+    char value[8] = "0";
+} scanner_ui;
+
+// Draws the memory scanner, which narrows down where a value lives over repeated scans
+void debugger::draw_memory_scanner_imgui() {
+    // Candidates listed, there's no point in showing thousands of them
+    constexpr usize LISTED = 256;
+
+    ImGui::Begin("Memory Scanner");
+    ImGui::RadioButton("8bit", &scanner_ui.width, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("16bit", &scanner_ui.width, 1);
+    ImGui::SameLine();
+    if (ImGui::Button("New Scan")) {
+        scanner.start(machine.bus, scanner_ui.width ? scan_width::word : scan_width::byte);
+    }
+
+    const char* compares[] = {"Equal to", "Changed", "Unchanged", "Increased", "Decreased"};
+    ImGui::PushItemWidth(100.0f);
+    ImGui::Combo("###Compare", &scanner_ui.compare, compares, int(std::size(compares)));
+    ImGui::PopItemWidth();
+    if (scanner_ui.compare == 0) {
+        ImGui::SameLine();
+        ImGui::PushItemWidth(60.0f);
+        ImGui::InputText("###Value", scanner_ui.value, sizeof(scanner_ui.value));
+        ImGui::PopItemWidth();
+    }
+    ImGui::SameLine();
+    if (!scanner.started()) ImGui::BeginDisabled();
+    if (ImGui::Button("Next Scan")) {
+        // $ for hex like everywhere else, decimal otherwise
+        const char* text = scanner_ui.value;
+        u16 value = text[0] == '$' ? u16(strtoul(text + 1, nullptr, 16)) : u16(strtoul(text, nullptr, 10));
+        scanner.narrow(machine.bus, scan_compare(scanner_ui.compare), value);
+    }
+    if (!scanner.started()) ImGui::EndDisabled();
+
+    ImGui::Separator();
+    if (!scanner.started()) {
+        ImGui::TextDisabled("Start a new scan");
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("%zu candidates", scanner.candidate_count());
+
+    ImGuiTableFlags table_flags = ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
+    if (scanner.candidate_count() > 0 && ImGui::BeginTable("Candidates", 4, table_flags)) {
+        ImGui::TableSetupColumn("Device");
+        ImGui::TableSetupColumn("Addr");
+        ImGui::TableSetupColumn("Value");
+        ImGui::TableSetupColumn("Previous");
+        ImGui::TableHeadersRow();
+
+        const char* format = scanner.width() == scan_width::word ? "$%04X" : "$%02X";
+        for (const auto& found : scanner.first_candidates(machine.bus, LISTED)) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", found.where->name);
+            ImGui::TableNextColumn();
+            if (found.where->bank >= 0) {
+                ImGui::Text("$%04X (bank %d)", found.addr, found.where->bank);
+            } else {
+                ImGui::Text("$%04X", found.addr);
+            }
+            ImGui::TableNextColumn();
+            // Values that changed since the last scan stand out
+            if (found.value != found.previous) ImGui::TextColored(COLOR_LITERAL, format, found.value);
+            else ImGui::Text(format, found.value);
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled(format, found.previous);
+        }
+        ImGui::EndTable();
+    }
+    if (scanner.candidate_count() > LISTED) {
+        ImGui::TextDisabled("Showing the first %zu", LISTED);
+    }
+    ImGui::End();
+}
@@ -0,0 +1,73 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "./file_watcher.hpp"
+
+file_watcher::file_watcher(const char* path): path(std::filesystem::absolute(path)) {
+#if defined(__linux__)
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0) {
+        // Writes end with IN_CLOSE_WRITE, replacements with IN_MOVED_TO or IN_CREATE
+        inotify_add_watch(fd, this->path.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    }
+#else
+    std::error_code error;
+    last_write = std::filesystem::last_write_time(this->path, error);
+#endif
+}
+
+file_watcher::~file_watcher() {
+#if defined(__linux__)
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+bool file_watcher::changed() {
+#if defined(__linux__)
+    if (fd < 0) {
+        return false;
+    }
+
+    // Drain every pending event, several of them usually come together
+    bool changed = false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* ptr = buffer; ptr < buffer + length; ) {
+            auto* event = (const inotify_event*) ptr;
+            if (event->len > 0 && path.filename() == event->name) {
+                changed = true;
+            }
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+    return changed;
+#else
+    std::error_code error;
+    auto write = std::filesystem::last_write_time(path, error);
+    if (error || write == last_write) {
+        return false;
+    }
+    last_write = write;
+    return true;
+#endif
+}
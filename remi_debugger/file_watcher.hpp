@@ -0,0 +1,41 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <filesystem>
+#include <string>
+
+#include "./main.hpp"
+
+// Watches a file for changes without blocking. Uses inotify on Linux, and compares modification times elsewhere.
+//
+// The directory is watched rather than the file itself, so files replaced by renaming a new one over them (which
+// is what most tools do when saving) keep being tracked.
+class file_watcher {
+    std::filesystem::path path;
+#if defined(__linux__)
+    int fd = -1;
+#else
+    std::filesystem::file_time_type last_write = {};
+#endif
+public:
+    file_watcher(const char* path);
+    file_watcher(const file_watcher&) = delete;
+    file_watcher& operator=(const file_watcher&) = delete;
+    ~file_watcher();
+
+    // Whether the file was written or replaced since the last call.
+    bool changed();
+};
@@ -14,6 +14,9 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <memory>
+
 #include <remi_vm/vm.hpp>
 #include <SDL3/SDL.h>
 #include <imgui.h>
@@ -21,9 +24,12 @@
 #include "../vendor/imgui/backends/imgui_impl_sdlrenderer3.h"
 
 #include "./debugger.hpp"
+#include "./video_output.hpp"
+#include "./audio_output.hpp"
+#include "./profiler.hpp"
 
 int main() {
-    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
     // Initialize window and renderer
     SDL_Window* window = SDL_CreateWindow("Remi16", 1280, 720, SDL_WINDOW_HIDDEN);
@@ -42,20 +48,29 @@ int main() {
 
     // Initialize VM with test rom
     auto console = debugger("./test_rom.remi16");
+    auto video = video_output(renderer);
+    // Must be closed before SDL shuts down
+    auto audio = std::make_unique<audio_output>(console.get_sound_output(), vm::dev::sound::SAMPLE_RATE);
 
     // Show window only after everything is loaded
     SDL_ShowWindow(window);
     bool running = true;
     while (running) {
+#if REMI16_PROFILE
+        profiler().begin_frame(console.get_instructions());
+#endif
         // ---------------------------------------- Process system events
-        SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            ImGui_ImplSDL3_ProcessEvent(&e);
-            switch (e.type) {
-            case SDL_EVENT_QUIT:
-            case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
-                running = false;
-                break;
+        {
+            PROFILE_SCOPE(frame_phase::events);
+            SDL_Event e;
+            while (SDL_PollEvent(&e)) {
+                ImGui_ImplSDL3_ProcessEvent(&e);
+                switch (e.type) {
+                case SDL_EVENT_QUIT:
+                case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+                    running = false;
+                    break;
+                }
             }
         }
         // Don't update if the window is minimized
@@ -63,33 +78,57 @@ int main() {
             SDL_Delay(10);
             continue;
         }
-        // Start the Dear ImGui frame
-        ImGui_ImplSDLRenderer3_NewFrame();
-        ImGui_ImplSDL3_NewFrame();
-        ImGui::NewFrame();
 
         // ---------------------------------------- Update
-        ImGui::DockSpaceOverViewport();
-        console.draw_imgui();
-        ImGui::ShowDemoWindow();
+        {
+            PROFILE_SCOPE(frame_phase::emulation);
+            console.check_rom_changes();
+        }
+        {
+            // Running the machine from the debugger controls is timed as emulation, not UI
+            PROFILE_SCOPE(frame_phase::ui);
+
+            // Start the Dear ImGui frame
+            ImGui_ImplSDLRenderer3_NewFrame();
+            ImGui_ImplSDL3_NewFrame();
+            ImGui::NewFrame();
+
+            ImGui::DockSpaceOverViewport();
+            console.draw_imgui();
+            ImGui::ShowDemoWindow();
+
+            // Console screen, scaled to fit the window
+            video.update(console.get_framebuffer());
+            ImGui::Begin("Screen");
+            {
+                using vm::dev::framebuffer;
+                ImVec2 avail = ImGui::GetContentRegionAvail();
+                float scale = std::max(1.0f, std::min(avail.x / framebuffer::WIDTH, avail.y / framebuffer::HEIGHT));
+                ImGui::Image((ImTextureID) (intptr_t) video.get_texture(), ImVec2(framebuffer::WIDTH * scale, framebuffer::HEIGHT * scale));
+            }
+            ImGui::End();
+        }
 
         // ---------------------------------------- Draw
-        // Clear to black
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-
-        // Render test rect
-        SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-        auto test_rect = SDL_FRect { 100.0, 100.0, 100.0, 100.0 };
-        SDL_RenderFillRect(renderer, &test_rect);
-
-        // Render ImGui
-        ImGui::Render();
-        ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
-        SDL_RenderPresent(renderer);
+        {
+            PROFILE_SCOPE(frame_phase::render);
+            // Clear to black
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+
+            // Render ImGui
+            ImGui::Render();
+            ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
+        }
+        {
+            // Includes waiting for vsync
+            PROFILE_SCOPE(frame_phase::present);
+            SDL_RenderPresent(renderer);
+        }
     }
 
     // Cleanup
+    audio.reset();
     ImGui_ImplSDLRenderer3_Shutdown();
     ImGui_ImplSDL3_Shutdown();
     ImGui::DestroyContext();
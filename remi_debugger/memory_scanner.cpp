@@ -0,0 +1,272 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "./memory_scanner.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Value of a byte or word at an offset. Words never start at the last byte of a region.
+template<scan_width W>
+static u16 value_at(const u8* data, usize offset) {
+    if constexpr (W == scan_width::byte) {
+        return data[offset];
+    } else {
+        return u16(data[offset] | data[offset + 1] << 8);
+    }
+}
+
+static u16 value_at(scan_width width, const u8* data, usize offset) {
+    return width == scan_width::byte ? value_at<scan_width::byte>(data, offset) : value_at<scan_width::word>(data, offset);
+}
+
+template<scan_compare C>
+static bool passes(u16 now, u16 before, u16 value) {
+    switch (C) {
+    case scan_compare::equal: return now == value;
+    case scan_compare::changed: return now != before;
+    case scan_compare::unchanged: return now == before;
+    case scan_compare::increased: return now > before;
+    case scan_compare::decreased: return now < before;
+    }
+    return false;
+}
+
+#if defined(__SSE2__)
+// Compares 16 bytes. Returns one bit per byte.
+template<scan_compare C>
+static u32 compare_lanes(__m128i now, __m128i before, u16 value, std::integral_constant<scan_width, scan_width::byte>) {
+    if constexpr (C == scan_compare::equal) {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(now, _mm_set1_epi8(char(value))));
+    }
+    u32 same = _mm_movemask_epi8(_mm_cmpeq_epi8(now, before));
+    if constexpr (C == scan_compare::changed) return ~same & 0xffff;
+    if constexpr (C == scan_compare::unchanged) return same;
+    // Unsigned bytes only have min and max, which are enough to tell which side is bigger
+    if constexpr (C == scan_compare::increased) return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(now, before), now)) & ~same;
+    if constexpr (C == scan_compare::decreased) return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(now, before), now)) & ~same;
+    return 0;
+}
+
+// Compares 8 words. Returns two bits per word.
+template<scan_compare C>
+static u32 compare_lanes(__m128i now, __m128i before, u16 value, std::integral_constant<scan_width, scan_width::word>) {
+    if constexpr (C == scan_compare::equal) {
+        return _mm_movemask_epi8(_mm_cmpeq_epi16(now, _mm_set1_epi16(i16(value))));
+    }
+    u32 same = _mm_movemask_epi8(_mm_cmpeq_epi16(now, before));
+    if constexpr (C == scan_compare::changed) return ~same & 0xffff;
+    if constexpr (C == scan_compare::unchanged) return same;
+    // Words only have signed comparisons, so both sides are biased to compare them unsigned
+    __m128i bias = _mm_set1_epi16(i16(0x8000));
+    now = _mm_xor_si128(now, bias);
+    before = _mm_xor_si128(before, bias);
+    if constexpr (C == scan_compare::increased) return _mm_movemask_epi8(_mm_cmpgt_epi16(now, before));
+    if constexpr (C == scan_compare::decreased) return _mm_movemask_epi8(_mm_cmpgt_epi16(before, now));
+    return 0;
+}
+
+// Compares the values at the 16 addresses from `offset`. Returns one bit per address.
+template<scan_width W, scan_compare C>
+static u32 compare_16(const u8* now, const u8* before, usize offset, u16 value) {
+    auto load = [](const u8* data) { return _mm_loadu_si128((const __m128i*) data); };
+    std::integral_constant<scan_width, W> width;
+    if constexpr (W == scan_width::byte) {
+        return compare_lanes<C>(load(now + offset), load(before + offset), value, width);
+    } else {
+        // Words at even offsets, then words at odd offsets, interleaved back
+        u32 even = compare_lanes<C>(load(now + offset), load(before + offset), value, width) & 0x5555;
+        u32 odd = compare_lanes<C>(load(now + offset + 1), load(before + offset + 1), value, width) & 0x5555;
+        return even | odd << 1;
+    }
+}
+#endif
+
+template<scan_width W, scan_compare C>
+static void narrow_region(memory_scanner::region& area, const u8* now, u16 value) {
+    const u8* before = area.previous.data();
+    // Bytes read to compare 16 addresses
+    constexpr usize reach = W == scan_width::byte ? 16 : 17;
+
+    for (usize index = 0; index < area.candidates.size(); index++) {
+        u64& bits = area.candidates[index];
+        if (bits == 0) {
+            continue;
+        }
+        usize base = index * 64;
+        u64 pass = 0;
+
+#if defined(__SSE2__)
+        if (base + 48 + reach <= area.size) {
+            for (usize group = 0; group < 4; group++) {
+                pass |= u64(compare_16<W, C>(now, before, base + group * 16, value)) << (group * 16);
+            }
+            bits &= pass;
+            continue;
+        }
+#endif
+        // The end of the region (or every address, without SSE2), only looking at candidates
+        for (u64 rest = bits; rest != 0; rest &= rest - 1) {
+            usize bit = std::countr_zero(rest);
+            if (passes<C>(value_at<W>(now, base + bit), value_at<W>(before, base + bit), value)) {
+                pass |= u64(1) << bit;
+            }
+        }
+        bits &= pass;
+    }
+}
+
+template<scan_width W>
+static void narrow_region(memory_scanner::region& area, const u8* now, scan_compare compare, u16 value) {
+    switch (compare) {
+    case scan_compare::equal: narrow_region<W, scan_compare::equal>(area, now, value); break;
+    case scan_compare::changed: narrow_region<W, scan_compare::changed>(area, now, value); break;
+    case scan_compare::unchanged: narrow_region<W, scan_compare::unchanged>(area, now, value); break;
+    case scan_compare::increased: narrow_region<W, scan_compare::increased>(area, now, value); break;
+    case scan_compare::decreased: narrow_region<W, scan_compare::decreased>(area, now, value); break;
+    }
+}
+
+std::vector<memory_scanner::source> memory_scanner::collect(const vm::bus& bus) {
+    std::vector<source> sources;
+    const vm::dev::memory& memory = bus.memory();
+    std::span<u8> host = memory.host_memory();
+
+    sources.push_back({memory.name(), 0x0000, -1, host.data(), 0x8000});
+    for (usize bank = 0; bank < vm::dev::memory::bank_count; bank++) {
+        sources.push_back({memory.name(), 0x8000, i32(bank), host.data() + (1 + bank) * 0x8000, 0x8000});
+    }
+
+    // Devices, in runs of contiguous memory they give direct access to
+    for (const auto& mapper : bus.get_mappers()) {
+        if (mapper.get() == &memory) {
+            continue;
+        }
+        auto [range_start, range_end] = mapper->range();
+        source run = {};
+        auto flush = [&]() {
+            if (run.data) {
+                sources.push_back(run);
+            }
+            run = {};
+        };
+
+        for (u32 addr = range_start; addr <= range_end;) {
+            u16 size = u16(std::min<u32>(0x100 - addr % 0x100, range_end + 1 - addr));
+            u16 device_addr = mapper->remap_range() ? u16(addr - range_start) : u16(addr);
+            const u8* data = mapper->direct_read(device_addr, size);
+            // Devices that forward to memory (like an empty cartridge slot) are already covered
+            if (data >= host.data() && data < host.data() + host.size()) {
+                data = nullptr;
+            }
+
+            if (!data) {
+                flush();
+            } else if (run.data && run.data + run.size == data) {
+                run.size += size;
+            } else {
+                flush();
+                run = {mapper->name(), u16(addr), -1, data, size};
+            }
+            addr += size;
+        }
+        flush();
+    }
+    return sources;
+}
+
+const memory_scanner::source* memory_scanner::find(const std::vector<source>& sources, const region& area) {
+    for (const source& candidate : sources) {
+        if (strcmp(candidate.name, area.name) == 0 && candidate.addr == area.addr && candidate.bank == area.bank 
+            && candidate.size == area.size) {
+            return &candidate;
+        }
+    }
+    return nullptr;
+}
+
+void memory_scanner::start(const vm::bus& bus, scan_width width) {
+    regions.clear();
+    current_width = width;
+    count = 0;
+
+    for (const source& from : collect(bus)) {
+        region area = {from.name, from.addr, from.bank, from.size};
+        area.candidates.assign((from.size + 63) / 64, ~u64(0));
+        area.previous.assign(from.data, from.data + from.size);
+
+        // Nothing past the end, and no word starting at the last byte
+        usize valid = width == scan_width::byte ? from.size : from.size - 1;
+        for (usize offset = valid; offset < area.candidates.size() * 64; offset++) {
+            area.candidates[offset / 64] &= ~(u64(1) << (offset % 64));
+        }
+        count += valid;
+        regions.push_back(std::move(area));
+    }
+}
+
+void memory_scanner::narrow(const vm::bus& bus, scan_compare compare, u16 value) {
+    std::vector<source> sources = collect(bus);
+    count = 0;
+
+    for (region& area : regions) {
+        const source* now = find(sources, area);
+        if (!now) {
+            std::fill(area.candidates.begin(), area.candidates.end(), 0);
+            continue;
+        }
+
+        if (current_width == scan_width::byte) {
+            narrow_region<scan_width::byte>(area, now->data, compare, value);
+        } else {
+            narrow_region<scan_width::word>(area, now->data, compare, value);
+        }
+        memcpy(area.previous.data(), now->data, area.size);
+
+        for (u64 bits : area.candidates) {
+            count += std::popcount(bits);
+        }
+    }
+}
+
+std::vector<memory_scanner::candidate> memory_scanner::first_candidates(const vm::bus& bus, usize limit) const {
+    std::vector<candidate> found;
+    std::vector<source> sources = collect(bus);
+
+    for (const region& area : regions) {
+        const source* now = find(sources, area);
+        if (!now) {
+            continue;
+        }
+        for (usize index = 0; index < area.candidates.size(); index++) {
+            for (u64 bits = area.candidates[index]; bits != 0; bits &= bits - 1) {
+                if (found.size() == limit) {
+                    return found;
+                }
+                usize offset = index * 64 + std::countr_zero(bits);
+                found.push_back({
+                    &area, u16(area.addr + offset), 
+                    value_at(current_width, now->data, offset), value_at(current_width, area.previous.data(), offset),
+                });
+            }
+        }
+    }
+    return found;
+}
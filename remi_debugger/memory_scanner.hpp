@@ -0,0 +1,96 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <vector>
+
+#include <remi_vm/vm.hpp>
+#include <remi_vm/mapper.hpp>
+
+#include "./main.hpp"
+
+// Size of the values a memory scan looks for. Words are little endian and can start at any address.
+enum class scan_width: u8 {
+    byte, word,
+};
+
+// How a scan narrows the candidates down
+enum class scan_compare: u8 {
+    // Equal to a given value
+    equal,
+    // Compared to the value in the previous scan (unsigned)
+    changed, unchanged, increased, decreased,
+};
+
+// Value search over every memory bank and every device with direct memory, to find where a program keeps its
+// state by narrowing the candidates down over repeated scans.
+//
+// Candidates are a bit per address, and every scan compares 16 addresses at a time against the previous scan (with
+// SSE2 where available), skipping 64 addresses at a time where no candidate is left. Scanning all of memory takes a
+// few microseconds.
+class memory_scanner {
+public:
+    // Contiguous memory that is scanned: the low half of memory, the high half of a bank, or part of a device
+    struct region {
+        const char* name;
+        // Address of the first byte, and memory bank of high halves (-1 for anything else)
+        u16 addr;
+        i32 bank;
+        usize size;
+        // One bit per address that is still a candidate
+        std::vector<u64> candidates;
+        // Contents as of the previous scan
+        std::vector<u8> previous;
+    };
+
+    // A candidate, as returned by first_candidates()
+    struct candidate {
+        const region* where;
+        u16 addr;
+        u16 value;
+        u16 previous;
+    };
+
+    // Starts a new search: every address of every region is a candidate.
+    void start(const vm::bus& bus, scan_width width);
+    // Keeps the candidates that pass the comparison, against `value` for scan_compare::equal and against the
+    // previous scan otherwise. Regions that went away since the previous scan (like a device window that moved)
+    // lose every candidate.
+    void narrow(const vm::bus& bus, scan_compare compare, u16 value);
+
+    bool started() const { return !regions.empty(); }
+    scan_width width() const { return current_width; }
+    usize candidate_count() const { return count; }
+    // Returns the first `limit` candidates, in region order, with their value as the bus is now.
+    std::vector<candidate> first_candidates(const vm::bus& bus, usize limit) const;
+
+private:
+    struct source {
+        const char* name;
+        u16 addr;
+        i32 bank;
+        const u8* data;
+        usize size;
+    };
+
+    std::vector<region> regions;
+    scan_width current_width = scan_width::byte;
+    usize count = 0;
+
+    // Finds the scanned memory as the bus is now
+    static std::vector<source> collect(const vm::bus& bus);
+    // Returns the source a region was made from, or nullptr if it went away
+    static const source* find(const std::vector<source>& sources, const region& area);
+};
@@ -0,0 +1,164 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <cassert>
+#include <cstdio>
+
+#include "./profiler.hpp"
+
+const char* frame_phase_name(frame_phase phase) {
+    switch (phase) {
+    case frame_phase::events: return "events";
+    case frame_phase::emulation: return "emulation";
+    case frame_phase::ui: return "ui";
+    case frame_phase::render: return "render";
+    case frame_phase::present: return "present";
+    }
+    return "unknown";
+}
+
+frame_profiler& profiler() {
+    static frame_profiler instance;
+    return instance;
+}
+
+frame_profiler::frame_profiler() {
+    events = std::unique_ptr<trace_event[]>(new trace_event[MAX_EVENTS]);
+}
+
+u64 frame_profiler::now_ns() const {
+    return u64(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - origin).count());
+}
+
+void frame_profiler::record(const char* name, u64 start_ns, u64 end_ns) {
+    events[events_written % MAX_EVENTS] = {name, start_ns, end_ns - start_ns};
+    events_written++;
+}
+
+void frame_profiler::begin(frame_phase phase) {
+    // Scopes nested too deep are still counted, so every end() has its begin(), but aren't timed
+    if (depth < MAX_DEPTH) {
+        stack[depth] = {phase, now_ns(), 0};
+    }
+    depth++;
+}
+
+void frame_profiler::end() {
+    assert(depth > 0 && "profiler scope ended without being started");
+    depth--;
+    if (depth >= MAX_DEPTH) {
+        return;
+    }
+
+    const open_scope& scope = stack[depth];
+    u64 end_ns = now_ns();
+    u64 duration = end_ns - scope.start_ns;
+    frame_phase_ns[usize(scope.phase)] += duration - scope.nested_ns;
+    if (depth > 0) {
+        stack[depth - 1].nested_ns += duration;
+    }
+    record(frame_phase_name(scope.phase), scope.start_ns, end_ns);
+}
+
+void frame_profiler::begin_frame(u64 guest_instructions) {
+    u64 now = now_ns();
+    std::clock_t cpu_now = std::clock();
+
+    if (frame_open) {
+        float total_ms = float(now - frame_start_ns) / 1e6f;
+        float cpu_ms = float(cpu_now - frame_start_cpu) * 1000.0f / CLOCKS_PER_SEC;
+        for (usize phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+            phase_ms[phase][head] = float(frame_phase_ns[phase]) / 1e6f;
+        }
+        frame_ms[head] = total_ms;
+        cpu_percent[head] = total_ms > 0 ? cpu_ms / total_ms * 100.0f : 0;
+        // The count starts over when the machine is reset
+        instructions[head] = guest_instructions >= last_instructions 
+            ? guest_instructions - last_instructions 
+            : guest_instructions;
+        head = (head + 1) % HISTORY;
+        frames++;
+        record("frame", frame_start_ns, now);
+    }
+
+    frame_open = true;
+    frame_start_ns = now;
+    frame_start_cpu = cpu_now;
+    for (u64& ns : frame_phase_ns) {
+        ns = 0;
+    }
+    last_instructions = guest_instructions;
+}
+
+// Average of the frames in the history
+static float average(const float* values, usize count) {
+    float sum = 0;
+    for (usize i = 0; i < count; i++) {
+        sum += values[i];
+    }
+    return count > 0 ? sum / count : 0;
+}
+
+float frame_profiler::average_ms(frame_phase phase) const {
+    return average(phase_ms[usize(phase)], history_size());
+}
+
+float frame_profiler::average_frame_ms() const {
+    return average(frame_ms, history_size());
+}
+
+float frame_profiler::average_cpu_percent() const {
+    return average(cpu_percent, history_size());
+}
+
+double frame_profiler::guest_mips() const {
+    u64 total = 0;
+    for (usize i = 0; i < history_size(); i++) {
+        total += instructions[i];
+    }
+    double us = double(average_frame_ms()) * history_size() * 1000.0;
+    return us > 0 ? total / us : 0;
+}
+
+double frame_profiler::emulation_mips() const {
+    u64 total = 0;
+    for (usize i = 0; i < history_size(); i++) {
+        total += instructions[i];
+    }
+    double us = double(average_ms(frame_phase::emulation)) * history_size() * 1000.0;
+    return us > 0 ? total / us : 0;
+}
+
+bool frame_profiler::export_chrome_trace(const char* path) const {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        return false;
+    }
+
+    // Complete ("X") events with microsecond timestamps, oldest first
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    u64 first = events_written > MAX_EVENTS ? events_written - MAX_EVENTS : 0;
+    for (u64 i = first; i < events_written; i++) {
+        const trace_event& event = events[i % MAX_EVENTS];
+        fprintf(
+            out, "%s{\"name\":\"%s\",\"cat\":\"remi16\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}\n",
+            i == first ? "" : ",", event.name, event.start_ns / 1000.0, event.duration_ns / 1000.0
+        );
+    }
+    fprintf(out, "]}\n");
+
+    bool ok = !ferror(out);
+    return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,141 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <chrono>
+#include <ctime>
+#include <memory>
+
+#include "./main.hpp"
+
+// Profiling is compiled in for debug builds only. Define REMI16_PROFILE=1 to profile a release build.
+#ifndef REMI16_PROFILE
+#define REMI16_PROFILE REMI16_DEBUG
+#endif
+
+// Parts of a debugger frame that are timed separately
+enum class frame_phase: u8 {
+    events, emulation, ui, render, present,
+};
+constexpr usize FRAME_PHASE_COUNT = 5;
+
+const char* frame_phase_name(frame_phase phase);
+
+// Host instrumentation of the debugger main loop.
+//
+// Code is timed with PROFILE_SCOPE(). Every frame adds up the time spent in each phase, not counting scopes nested
+// inside it, so a phase that runs inside another one (emulation started from a UI button) isn't counted twice.
+// The last frames are kept for the frame time panel, and the last scopes for exporting a Chrome trace.
+class frame_profiler {
+public:
+    // Frames kept for the graphs
+    static constexpr usize HISTORY = 240;
+    // Scopes kept for trace export
+    static constexpr usize MAX_EVENTS = 16384;
+    static constexpr usize MAX_DEPTH = 16;
+private:
+    using clock = std::chrono::steady_clock;
+    clock::time_point origin = clock::now();
+
+    struct open_scope {
+        frame_phase phase;
+        u64 start_ns;
+        // Time spent in nested scopes, which doesn't count towards this one's phase
+        u64 nested_ns;
+    };
+    open_scope stack[MAX_DEPTH] = {};
+    usize depth = 0;
+
+    struct trace_event {
+        // Phase name, or "frame"
+        const char* name;
+        u64 start_ns;
+        u64 duration_ns;
+    };
+    // Ring of the last MAX_EVENTS completed scopes, `events_written` counts every scope ever completed
+    std::unique_ptr<trace_event[]> events;
+    u64 events_written = 0;
+
+    // Frame being measured
+    bool frame_open = false;
+    u64 frame_start_ns = 0;
+    std::clock_t frame_start_cpu = 0;
+    u64 frame_phase_ns[FRAME_PHASE_COUNT] = {};
+    u64 last_instructions = 0;
+
+    // Rolling history, in milliseconds. `head` is the oldest frame and the next one to be overwritten.
+    float phase_ms[FRAME_PHASE_COUNT][HISTORY] = {};
+    float frame_ms[HISTORY] = {};
+    // Host CPU time over wall time, in percent (over 100 when several threads are busy)
+    float cpu_percent[HISTORY] = {};
+    u64 instructions[HISTORY] = {};
+    usize head = 0;
+    usize frames = 0;
+
+    u64 now_ns() const;
+    void record(const char* name, u64 start_ns, u64 end_ns);
+public:
+    frame_profiler();
+
+    // Opens and closes a scope of a phase. Use PROFILE_SCOPE() instead.
+    void begin(frame_phase phase);
+    void end();
+
+    // Closes the frame being measured, if any, and starts the next one. `guest_instructions` is the instruction
+    // count of the machine, so the instructions run by every frame can be told apart.
+    void begin_frame(u64 guest_instructions);
+
+    // History, oldest frame first when plotted from `history_offset()`
+    const float* phase_history(frame_phase phase) const { return phase_ms[usize(phase)]; }
+    const float* frame_history() const { return frame_ms; }
+    const float* cpu_history() const { return cpu_percent; }
+    usize history_offset() const { return head; }
+    // Number of frames in the history (up to HISTORY)
+    usize history_size() const { return frames < HISTORY ? frames : HISTORY; }
+
+    // Averages over the history
+    float average_ms(frame_phase phase) const;
+    float average_frame_ms() const;
+    float average_cpu_percent() const;
+    // Guest instructions per wall clock microsecond, and per microsecond spent emulating
+    double guest_mips() const;
+    double emulation_mips() const;
+
+    // Writes the last scopes as Chrome trace event JSON (chrome://tracing, Perfetto). Returns false if the file
+    // couldn't be written.
+    bool export_chrome_trace(const char* path) const;
+};
+
+// The profiler of the debugger main loop
+frame_profiler& profiler();
+
+// Times a phase until the end of the enclosing scope.
+class profile_scope {
+public:
+    explicit profile_scope(frame_phase phase) { profiler().begin(phase); }
+    ~profile_scope() { profiler().end(); }
+    profile_scope(const profile_scope&) = delete;
+    profile_scope& operator=(const profile_scope&) = delete;
+};
+
+#define REMI16_CONCAT_IMPL(a, b) a##b
+#define REMI16_CONCAT(a, b) REMI16_CONCAT_IMPL(a, b)
+
+// Times a phase until the end of the enclosing scope. Compiled out unless REMI16_PROFILE is set.
+#if REMI16_PROFILE
+#define PROFILE_SCOPE(phase) profile_scope REMI16_CONCAT(profile_scope_, __LINE__)(phase)
+#else
+#define PROFILE_SCOPE(phase) do {} while (0)
+#endif
@@ -0,0 +1,61 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "./video_output.hpp"
+
+using vm::dev::framebuffer;
+
+video_output::video_output(SDL_Renderer* renderer) {
+    texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, 
+        framebuffer::WIDTH, framebuffer::HEIGHT
+    );
+    // Keep pixels crisp when scaled up
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+}
+
+void video_output::update(framebuffer& framebuffer) {
+    if (!framebuffer.any_dirty()) {
+        return;
+    }
+
+    auto [min_x, max_x] = framebuffer.dirty_columns();
+    usize width = max_x - min_x + 1;
+
+    // Upload each run of consecutive dirty rows as one locked rectangle
+    usize y = 0;
+    while (y < framebuffer::HEIGHT) {
+        if (!framebuffer.row_dirty(y)) {
+            y++;
+            continue;
+        }
+        usize first = y;
+        while (y < framebuffer::HEIGHT && framebuffer.row_dirty(y)) y++;
+
+        SDL_Rect rect = {int(min_x), int(first), int(width), int(y - first)};
+        void* pixels = nullptr;
+        int pitch = 0;
+        if (!SDL_LockTexture(texture, &rect, &pixels, &pitch)) {
+            continue;
+        }
+        for (usize row = first; row < y; row++) {
+            u32* dst = (u32*) ((u8*) pixels + (row - first) * pitch);
+            framebuffer.convert_row(min_x, row, width, dst);
+        }
+        SDL_UnlockTexture(texture);
+    }
+
+    framebuffer.clear_dirty();
+}
@@ -0,0 +1,38 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <SDL3/SDL.h>
+#include <remi_vm/video.hpp>
+
+#include "./main.hpp"
+
+// Presents the console framebuffer through an SDL streaming texture.
+//
+// Only the rows and columns written since the previous frame are converted and uploaded, so a guest that
+// touches a few pixels per frame costs next to nothing.
+// The texture belongs to the renderer, and is destroyed along with it.
+class video_output {
+    SDL_Texture* texture = nullptr;
+public:
+    video_output(SDL_Renderer* renderer);
+    video_output(const video_output&) = delete;
+    video_output& operator=(const video_output&) = delete;
+
+    // Uploads the dirty regions of the framebuffer and clears its dirty state.
+    void update(vm::dev::framebuffer& framebuffer);
+
+    SDL_Texture* get_texture() const { return texture; }
+};
@@ -0,0 +1,312 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <remi_vm/vm.hpp>
+#include <remi_vm/machine.hpp>
+#include <remi_vm/rom_loader.hpp>
+#include <remi_vm/state_hash.hpp>
+
+#include "./main.hpp"
+
+// In-process coverage-guided remi16 ROM fuzzer
+//
+// Usage: remi_fuzz <rom.remi16> <corpus dir> [runs] [instruction budget]
+//
+// Mutates the inputs a ROM consumes and keeps the ones that reach new edges in the interpreter's coverage bitmap.
+// Inputs that fault without a handler installed (bus faults and invalid opcodes) or run past the instruction
+// budget are saved to the corpus directory as crash-* files. Existing files in the directory are loaded as
+// the initial corpus.
+//
+// An input is a byte string decoded as:
+//     15 x u16     initial value of every register except pc (missing bytes are 0)
+//     records until the end of the input, each starting with a tag byte:
+//       even tag   memory patch: u16 address, u8 length, then `length` bytes written into bank (tag / 2) % 4
+//       odd tag    device input: u16 delay in instructions since the previous input, u16 address, u8 value
+//
+// A single machine runs every input. Resetting it only restores the memory pages the previous input wrote to,
+// so most of the time goes into running the ROM itself.
+
+constexpr usize REGISTER_BYTES = 15 * sizeof(u16);
+constexpr usize MAX_INPUT_SIZE = 4096;
+
+// splitmix64, more than random enough for mutations
+struct rng {
+    u64 state;
+
+    u64 next() {
+        u64 z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+    // Random number in [0, bound)
+    usize below(usize bound) { return bound ? next() % bound : 0; }
+};
+
+struct device_input {
+    u64 at;
+    u16 addr;
+    u8 val;
+};
+
+// Runs an input on a machine: feeds device inputs at the right instruction counts and stops the machine once
+// it reaches the instruction budget.
+class input_runner final: public vm::machine_hook {
+    std::vector<device_input> inputs;
+    usize next_input = 0;
+    u64 budget;
+public:
+    bool timed_out = false;
+
+    input_runner(u64 budget): budget(budget) {}
+
+    // Resets the machine and applies the registers and memory patches of an input.
+    void load(vm::machine& machine, std::span<const u8> data) {
+        machine.reset();
+        inputs.clear();
+        next_input = 0;
+        timed_out = false;
+
+        usize cursor = 0;
+        auto byte = [&]() -> u8 { return cursor < data.size() ? data[cursor++] : 0; };
+        auto word = [&]() -> u16 { u8 lo = byte(); return u16(lo | (byte() << 8)); };
+
+        for (u8 i = 1; i < 16; i++) {
+            machine.cpu.set(vm::reg(i), word());
+        }
+
+        u64 at = 0;
+        while (cursor < data.size()) {
+            u8 tag = byte();
+            if (tag % 2 == 0) {
+                u16 addr = word();
+                u16 length = byte();
+                // Patches can't cross into the other half of memory, so they're cut short there
+                length = std::min<usize>({length, data.size() - cursor, usize(0x8000 - addr % 0x8000)});
+                if (u8* dst = machine.bus.memory().bank_write((tag / 2) % 4, addr, length)) {
+                    memcpy(dst, data.data() + cursor, length);
+                }
+                cursor += length;
+            } else {
+                at += word();
+                u16 addr = word();
+                inputs.push_back({at, addr, byte()});
+            }
+        }
+    }
+
+    u64 on_instruction(vm::machine& machine) override {
+        while (next_input < inputs.size() && inputs[next_input].at <= machine.instructions) {
+            machine.input(inputs[next_input].addr, inputs[next_input].val);
+            next_input++;
+        }
+        if (machine.instructions >= budget) {
+            timed_out = true;
+            machine.stop_requested = true;
+            return UINT64_MAX;
+        }
+        return next_input < inputs.size() ? std::min(inputs[next_input].at, budget) : budget;
+    }
+};
+
+// Hit counts are bucketed the same way as AFL, so loops only count as new coverage when their iteration count
+// changes order of magnitude.
+u8 bucket(u8 hits) {
+    if (hits <= 3) return hits;
+    if (hits <= 7) return 1 << 3;
+    if (hits <= 15) return 1 << 4;
+    if (hits <= 31) return 1 << 5;
+    if (hits <= 127) return 1 << 6;
+    return 1 << 7;
+}
+
+// Merges the coverage of a run into the bits seen so far, clearing the bitmap for the next run. Returns whether
+// it reached anything new.
+bool merge_coverage(u8* coverage, u8* seen) {
+    bool found = false;
+    // Most of the bitmap is empty, so it's skipped 16 counters at a time and only the touched parts are cleared
+    for (usize i = 0; i < vm::COVERAGE_SIZE; i += 16) {
+#if defined(__SSE2__)
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (coverage + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_setzero_si128())) == 0xffff) continue;
+#else
+        u64 chunk[2];
+        memcpy(chunk, coverage + i, sizeof(chunk));
+        if (!(chunk[0] | chunk[1])) continue;
+#endif
+
+        for (usize j = i; j < i + 16; j++) {
+            u8 bits = bucket(coverage[j]);
+            if (bits & ~seen[j]) {
+                seen[j] |= bits;
+                found = true;
+            }
+        }
+        memset(coverage + i, 0, 16);
+    }
+    return found;
+}
+
+void mutate(std::vector<u8>& input, const std::vector<std::vector<u8>>& corpus, rng& random) {
+    static constexpr u8 interesting[] = {0x00, 0x01, 0x7f, 0x80, 0xff};
+
+    usize count = 1 + random.below(4);
+    for (usize i = 0; i < count; i++) {
+        if (input.empty()) {
+            input.push_back(u8(random.next()));
+        }
+        usize at = random.below(input.size());
+
+        switch (random.below(7)) {
+        case 0: 
+            input[at] ^= u8(1 << random.below(8)); 
+            break;
+        case 1: 
+            input[at] = u8(random.next()); 
+            break;
+        case 2: 
+            input[at] = interesting[random.below(std::size(interesting))]; 
+            break;
+        case 3: 
+            input[at] += u8(random.below(33)) - 16; 
+            break;
+        case 4: {
+            // Insert random bytes, which is how new records show up
+            usize length = 1 + random.below(8);
+            if (input.size() + length > MAX_INPUT_SIZE) break;
+            for (usize j = 0; j < length; j++) {
+                input.insert(input.begin() + at, u8(random.next()));
+            }
+            break;
+        }
+        case 5: {
+            usize length = std::min(input.size() - at, 1 + random.below(8));
+            input.erase(input.begin() + at, input.begin() + at + length);
+            break;
+        }
+        case 6: {
+            // Splice in a piece of another input
+            const auto& other = corpus[random.below(corpus.size())];
+            if (other.empty()) break;
+            usize from = random.below(other.size());
+            usize length = std::min({other.size() - from, 1 + random.below(32), MAX_INPUT_SIZE - input.size()});
+            input.insert(input.begin() + at, other.begin() + from, other.begin() + from + length);
+            break;
+        }
+        }
+    }
+}
+
+void save(const std::filesystem::path& path, std::span<const u8> data) {
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write((const char*) data.data(), data.size());
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "Usage: %s <rom.remi16> <corpus dir> [runs] [instruction budget]\n", argv[0]);
+        return 1;
+    }
+    std::filesystem::path corpus_dir = argv[2];
+    u64 runs = argc > 3 ? strtoull(argv[3], nullptr, 0) : UINT64_MAX;
+    u64 budget = argc > 4 ? strtoull(argv[4], nullptr, 0) : 100'000;
+
+    auto rom = vm::load_rom_from_file(argv[1]);
+    vm::machine machine;
+    machine.load(rom);
+
+    auto coverage = std::make_unique<u8[]>(vm::COVERAGE_SIZE);
+    auto seen = std::make_unique<u8[]>(vm::COVERAGE_SIZE);
+    machine.attach_coverage(coverage.get());
+    input_runner runner(budget);
+
+    // Runs an input and returns whether it found new coverage. Crashes are saved, once per kind and address.
+    std::unordered_set<u64> known_crashes;
+    auto run = [&](std::span<const u8> data) {
+        runner.load(machine, data);
+        machine.attach(&runner);
+        machine.execute();
+        machine.attach(nullptr);
+
+        if (machine.faulted || runner.timed_out) {
+            u16 faults = machine.cpu.status.raised & vm::FAULT_INTERRUPTS;
+            u16 pc = machine.cpu.reg(vm::reg::pc);
+            if (known_crashes.insert(u64(faults) << 16 | pc).second) {
+                char name[64];
+                snprintf(name, sizeof(name), "crash-%s-%04x-%016" PRIx64, 
+                    runner.timed_out ? "timeout" : faults & 1 ? "bus" : "opcode", pc, 
+                    vm::hash_bytes(data.data(), data.size()));
+                save(corpus_dir / name, data);
+                printf("Crash: %s\n", name);
+            }
+        }
+        return merge_coverage(coverage.get(), seen.get());
+    };
+
+    std::filesystem::create_directories(corpus_dir);
+    std::vector<std::vector<u8>> corpus;
+    for (const auto& entry: std::filesystem::directory_iterator(corpus_dir)) {
+        if (!entry.is_regular_file() || entry.path().filename().string().starts_with("crash-")) continue;
+        std::ifstream file(entry.path(), std::ios::in | std::ios::binary);
+        corpus.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if (corpus.empty()) {
+        corpus.emplace_back(REGISTER_BYTES, 0);
+    }
+    for (const auto& input: corpus) {
+        run(input);
+    }
+
+    rng random = {u64(std::chrono::steady_clock::now().time_since_epoch().count())};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<u8> input;
+    for (u64 i = 1; i <= runs; i++) {
+        input = corpus[random.below(corpus.size())];
+        mutate(input, corpus, random);
+
+        if (run(input)) {
+            char name[32];
+            snprintf(name, sizeof(name), "%016" PRIx64, vm::hash_bytes(input.data(), input.size()));
+            save(corpus_dir / name, input);
+            corpus.push_back(input);
+        }
+
+        if (i % 100'000 == 0 || i == runs) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("%" PRIu64 " runs, %.0f runs/s, corpus %zu, crashes %zu\n", 
+                i, i / seconds, corpus.size(), known_crashes.size());
+        }
+    }
+
+    return 0;
+}
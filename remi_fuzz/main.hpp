@@ -14,28 +14,19 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
-#include <remi_vm/vm.hpp>
+#include <cstdint>
+#include <type_traits>
 
-#include <vector>
-#include <unordered_map>
-#include <fstream>
+// typedef cstdint types so they're easier to type
+using u8 = uint8_t;
+using u16 = uint16_t;
+using u32 = uint32_t;
+using u64 = uint64_t;
 
-#include "./main.hpp"
+using i8 = int8_t;
+using i16 = int16_t;
+using i32 = int32_t;
+using i64 = int64_t;
 
-struct rom_region {
-    u32 rom_offset;
-    u32 size;
-    u16 loadat;
-    u16 bank;
-};
-
-struct loaded_rom {
-    std::ifstream file;
-    std::unordered_map<u32, rom_region> regions;
-    std::unordered_map<u32, std::vector<u8>> loaded_region_data;
-
-    // Crashes if region doesn't exist.
-    const std::vector<u8>& get_region(u32 region_id);
-};
-
-loaded_rom load_rom_from_file(const char* filename);
\ No newline at end of file
+using usize = size_t;
+using isize = std::make_signed_t<usize>;
\ No newline at end of file
@@ -0,0 +1,235 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <span>
+#include <string>
+
+#include <remi_vm/vm.hpp>
+#include <remi_vm/isa.hpp>
+#include <remi_vm/aot.hpp>
+#include <remi_vm/machine.hpp>
+#include <remi_vm/rom_loader.hpp>
+#include <remi_vm/state_hash.hpp>
+
+#include "./main.hpp"
+
+// remi16 ahead-of-time recompiler
+//
+// Usage: remi_recompiler <rom.remi16> <output.cpp>
+//
+// Translates the main region of a ROM into C++, to be built into a shared object that remi_run can load
+// instead of interpreting the program:
+//
+//     c++ -std=c++20 -O2 -shared -fPIC -I<remi16 source dir> output.cpp -o output.so
+//
+// Every instruction becomes a case of a switch on the program counter that falls through into the next one, so
+// straight-line code runs without any dispatch and jumps re-enter the switch. Instructions the recompiler
+// doesn't know how to translate call vm::execute() instead.
+//
+// Stores that may change code (into the compiled code itself or into a device, which could start a DMA) yield
+// right after, so the machine notices and falls back to the interpreter for the code that changed.
+
+// Assembly text of an instruction, for comments in the generated code
+std::string disassemble(vm::instr instr) {
+    auto disasm = vm::isa::disassemble(instr);
+    if (!disasm.info) return "???";
+
+    std::string text = disasm.info->mnemonic;
+    for (u8 i = 0; i < disasm.count; i++) {
+        const auto& operand = disasm.operands[i];
+        text += i == 0 ? " " : ", ";
+        if (operand.kind == vm::isa::operand_kind::reg) {
+            text += vm::isa::reg_name(vm::reg(operand.value));
+        } else {
+            char lit[8];
+            snprintf(lit, sizeof(lit), "$%04x", operand.value);
+            text += lit;
+        }
+    }
+    return text;
+}
+
+// C++ expression naming a register
+std::string reg_expr(vm::reg reg) {
+    return "vm::reg(" + std::to_string(u8(reg)) + ")";
+}
+
+// Where the compiled code lives in the address space
+struct code_placement {
+    const vm::bus& bus;
+    u16 addr;
+    u32 size;
+
+    // Whether a 16bit store to `target` may change any code
+    bool store_may_change_code(u16 target) const {
+        bool hits_code = u32(target) + 2 > addr && target < addr + size;
+        return hits_code || !bus.plain_memory(target) || !bus.plain_memory(u16(target + 1));
+    }
+    // Whether writing the bank register changes which code runs
+    bool banked() const { return addr + size > 0x8000; }
+};
+
+// Writes the body of a single instruction. `next` is the value of the program counter after it.
+//
+// Returns false if the body never falls through into the next instruction.
+bool emit_instruction(FILE* out, const code_placement& code, vm::instr instr, u16 next) {
+    using vm::opcode;
+    namespace isa = vm::isa;
+
+    // Invalid instructions are left to the interpreter, which knows how to fault
+    if (!isa::valid(instr)) {
+        fprintf(out, "            return vm::control_flow::ok;\n");
+        return false;
+    }
+
+    fprintf(out, "            if (ctx.must_yield()) return vm::control_flow::ok;\n");
+    if (instr.op == opcode::hlt) {
+        fprintf(out, "            return vm::control_flow::halt;\n");
+        return false;
+    }
+    fprintf(out, "            cpu.set(vm::reg::pc, 0x%04x);\n", next);
+
+    // Set if the instruction may have jumped, so the switch must be re-entered
+    bool jumps = false;
+    // Set if the machine must check the code before running any more of it
+    bool yields = false;
+    // Set if the interpreter's handler runs it
+    bool fallback = false;
+    switch (instr.op) {
+    case opcode::nop:
+        break;
+    case opcode::mov_lit_reg: {
+        auto ops = isa::operands_for<opcode::mov_lit_reg>::decode(instr);
+        fprintf(out, "            cpu.set(%s, 0x%04x);\n", reg_expr(ops.reg).c_str(), ops.lit);
+        jumps = ops.reg == vm::reg::pc;
+        yields = ops.reg == vm::reg::mb && code.banked();
+        break;
+    }
+    case opcode::mov_reg_reg: {
+        auto ops = isa::operands_for<opcode::mov_reg_reg>::decode(instr);
+        fprintf(out, "            cpu.set(%s, cpu.reg(%s));\n", reg_expr(ops.dst).c_str(), reg_expr(ops.src).c_str());
+        jumps = ops.dst == vm::reg::pc;
+        yields = ops.dst == vm::reg::mb && code.banked();
+        break;
+    }
+    case opcode::mov_reg_mem: {
+        auto ops = isa::operands_for<opcode::mov_reg_mem>::decode(instr);
+        fprintf(out, "            bus.write16(0x%04x, cpu.reg(%s));\n", ops.lit, reg_expr(ops.reg).c_str());
+        yields = code.store_may_change_code(ops.lit);
+        break;
+    }
+    case opcode::mov_mem_reg: {
+        auto ops = isa::operands_for<opcode::mov_mem_reg>::decode(instr);
+        fprintf(out, "            cpu.set(%s, bus.read16(0x%04x));\n", reg_expr(ops.reg).c_str(), ops.lit);
+        jumps = ops.reg == vm::reg::pc;
+        yields = ops.reg == vm::reg::mb && code.banked();
+        break;
+    }
+    case opcode::add_reg_reg: {
+        auto ops = isa::operands_for<opcode::add_reg_reg>::decode(instr);
+        fprintf(out, "            cpu.set(vm::reg::ac, cpu.reg(%s) + cpu.reg(%s));\n", 
+            reg_expr(ops.src).c_str(), reg_expr(ops.dst).c_str());
+        break;
+    }
+    default:
+        // Fall back to the interpreter's handler
+        fprintf(out, "            vm::execute(cpu, bus, vm::instr(0x%08" PRIx32 "u));\n", (u32) instr);
+        jumps = true;
+        yields = true;
+        fallback = true;
+        break;
+    }
+
+    fprintf(out, "            ctx.retire(%u);\n", isa::cycles(instr.op));
+    if (fallback) {
+        fprintf(out, "            ctx.retire_stall();\n");
+    }
+    if (yields) {
+        fprintf(out, "            return vm::control_flow::ok;\n");
+        return false;
+    }
+    if (jumps) {
+        fprintf(out, "            if (cpu.reg(vm::reg::pc) != 0x%04x) continue;\n", next);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <rom.remi16> <output.cpp>\n", argv[0]);
+        return 1;
+    }
+
+    // The ROM is loaded into a machine exactly like remi_run loads it, so the compiled code matches what ends up
+    // in memory. Only the main region is compiled.
+    auto rom = vm::load_rom_from_file(argv[1]);
+    if (!rom.regions.contains(0)) {
+        fprintf(stderr, "The ROM has no main region\n");
+        return 1;
+    }
+    vm::machine machine;
+    machine.load(rom);
+
+    const vm::rom_region& main_region = rom.regions.at(0);
+    const std::vector<u8>& main_data = rom.get_region(0);
+    code_placement code = {machine.bus, main_region.loadat, 0};
+    code.size = u32(std::min<usize>(main_data.size(), 0x10000 - main_region.loadat));
+    auto program = std::span((const u32*) main_data.data(), code.size / sizeof(u32));
+
+    FILE* out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "Can't open %s\n", argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by remi_recompiler from %s. Do not edit.\n", argv[1]);
+    fprintf(out, "#include <remi_vm/aot.hpp>\n\n");
+    fprintf(out, "static vm::control_flow run(vm::aot_context& ctx) {\n");
+    fprintf(out, "    auto& cpu = ctx.cpu;\n");
+    fprintf(out, "    auto& bus = ctx.bus;\n");
+    fprintf(out, "    for (;;) {\n");
+    fprintf(out, "        switch (cpu.reg(vm::reg::pc)) {\n");
+
+    for (usize i = 0; i < program.size(); i++) {
+        auto instr = vm::instr(program[i]);
+        u16 pc = u16(code.addr + i * 4);
+        fprintf(out, "        case 0x%04x: // %s\n", pc, disassemble(instr).c_str());
+        if (emit_instruction(out, code, instr, u16(pc + 4))) {
+            fprintf(out, "            [[fallthrough]];\n");
+        }
+    }
+
+    // Running off the end of the program (or jumping into the middle of an instruction) is the interpreter's job
+    fprintf(out, "        default:\n");
+    fprintf(out, "            return vm::control_flow::ok;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "extern \"C\" const vm::aot_module %s = {\n", vm::AOT_MODULE_SYMBOL);
+    fprintf(out, "    %u,\n", vm::AOT_ABI_VERSION);
+    fprintf(out, "    0x%04x,\n", code.addr);
+    fprintf(out, "    %u,\n", main_region.bank == 0xffff ? 0 : main_region.bank);
+    fprintf(out, "    %u,\n", code.size);
+    fprintf(out, "    0x%016" PRIx64 "ull,\n", vm::hash_bytes(main_data.data(), code.size));
+    fprintf(out, "    run,\n");
+    fprintf(out, "};\n");
+
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,254 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <dlfcn.h>
+
+#include <remi_vm/vm.hpp>
+#include <remi_vm/isa.hpp>
+#include <remi_vm/aot.hpp>
+#include <remi_vm/machine.hpp>
+#include <remi_vm/static_bus.hpp>
+#include <remi_vm/debug_server.hpp>
+#include <remi_vm/introspection.hpp>
+#include <remi_vm/rom_loader.hpp>
+#include <remi_vm/state_hash.hpp>
+
+#include "./main.hpp"
+
+// Headless remi16 runner
+//
+// Usage: remi_run <rom.remi16> [compiled.so] [--debug <port or socket path>] [--wait] [--cores <n>] [--parallel]
+//                 [--introspect <name>] [--bench <instructions>]
+//
+// Runs a ROM until the boot core halts, then prints the final machine state. If a shared object built from remi_recompiler's
+// output is given, the program runs natively, falling back to the interpreter for anything the module can't
+// handle (or for the whole program, if the module was built from another ROM).
+//
+// --debug starts a debug server (see remi_vm/debug_server.hpp) on a loopback TCP port, or on a Unix domain socket
+// if the argument isn't a number. --wait doesn't start running until a debugger connects.
+//
+// --cores gives the machine up to vm::MAX_CORES cores, interleaved deterministically on one thread, or each on
+// its own thread with --parallel.
+//
+// --introspect exposes the machine to other processes through a shared memory segment at /dev/shm/<name> (see
+// remi_vm/introspection.hpp), which is removed when the runner exits normally.
+//
+// --bench runs the boot core on the bare interpreter for up to the given number of instructions, once through a
+// runtime vm::bus and once through a vm::static_bus holding the same devices (interrupt controller, timer and
+// framebuffer), and prints how fast each one went. Devices that need the rest of the machine are missing and
+// interrupts aren't serviced, so it measures the bus and the interpreter rather than running the program faithfully.
+
+// Loads an AOT module. Returns nullptr if it can't be loaded.
+const vm::aot_module* load_compiled(const char* path) {
+    // Never unloaded, it's used until the process exits
+    void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "Can't load %s: %s\n", path, dlerror());
+        return nullptr;
+    }
+
+    auto* module = (const vm::aot_module*) dlsym(library, vm::AOT_MODULE_SYMBOL);
+    if (!module) {
+        fprintf(stderr, "%s is not a remi16 AOT module\n", path);
+        return nullptr;
+    }
+    return module;
+}
+
+// Runs a core from the instructions in plain memory until it halts, faults, jumps somewhere else or runs `budget`
+// instructions. Returns the number of instructions executed.
+template<typename Bus>
+u64 run_bare(vm::sakuya16c& cpu, Bus& bus, u64 budget) {
+    u64 count = 0;
+    while (count < budget && !(cpu.status.pending & vm::FAULT_INTERRUPTS)) {
+        u16 pc = cpu.reg(vm::reg::pc);
+        if (!bus.plain_memory(pc) || !bus.plain_memory(u16(pc + 3))) {
+            break;
+        }
+        const u8* fetched = bus.memory().direct_read(pc, sizeof(vm::instr));
+        if (!fetched) {
+            break;
+        }
+        u32 raw;
+        memcpy(&raw, fetched, sizeof(raw));
+        vm::instr instr(raw);
+        if (instr.op == vm::opcode::hlt) {
+            break;
+        }
+        cpu.set(vm::reg::pc, u16(pc + 4));
+        vm::execute(cpu, bus, instr);
+        cpu.stall = 0;
+        count++;
+    }
+    return count;
+}
+
+// Times the same run on both kinds of bus. Returns false if they didn't end in the same state.
+bool bench_buses(const vm::machine& machine, u64 budget) {
+    auto start_from = [&](vm::sakuya16c& cpu, auto& bus) {
+        cpu = machine.cpu;
+        std::span<u8> from = machine.bus.memory().host_memory();
+        std::span<u8> to = bus.memory().host_memory();
+        std::copy(from.begin(), from.end(), to.begin());
+    };
+    auto report = [](const char* name, u64 count, std::chrono::steady_clock::duration time, u64 accesses) {
+        double seconds = std::chrono::duration<double>(time).count();
+        printf("%-11s %" PRIu64 " instructions, %" PRIu64 " bus accesses in %.1f ms (%.1f M instructions/s)\n",
+            name, count, accesses, seconds * 1e3, count / seconds / 1e6);
+    };
+
+    vm::scheduler runtime_sched;
+    vm::sakuya16c runtime_cpu;
+    vm::bus runtime_bus(runtime_cpu);
+    runtime_bus.add_mapper(vm::dev::interrupt_controller());
+    runtime_bus.add_mapper(vm::dev::timer(runtime_sched));
+    runtime_bus.add_mapper(vm::dev::framebuffer(runtime_sched));
+    start_from(runtime_cpu, runtime_bus);
+
+    vm::scheduler static_sched;
+    vm::sakuya16c static_cpu;
+    vm::static_bus<vm::dev::interrupt_controller, vm::dev::timer, vm::dev::framebuffer> static_bus(static_cpu,
+        vm::dev::interrupt_controller(), vm::dev::timer(static_sched), vm::dev::framebuffer(static_sched));
+    start_from(static_cpu, static_bus);
+
+    auto t0 = std::chrono::steady_clock::now();
+    u64 runtime_count = run_bare(runtime_cpu, runtime_bus, budget);
+    auto t1 = std::chrono::steady_clock::now();
+    u64 static_count = run_bare(static_cpu, static_bus, budget);
+    auto t2 = std::chrono::steady_clock::now();
+
+    report("vm::bus", runtime_count, t1 - t0, runtime_bus.access_count());
+    report("static_bus", static_count, t2 - t1, static_bus.access_count());
+
+    std::span<u8> runtime_memory = runtime_bus.memory().host_memory();
+    std::span<u8> static_memory = static_bus.memory().host_memory();
+    bool same = runtime_count == static_count && runtime_bus.access_count() == static_bus.access_count()
+        && memcmp(runtime_cpu.registers, static_cpu.registers, sizeof(runtime_cpu.registers)) == 0
+        && std::equal(runtime_memory.begin(), runtime_memory.end(), static_memory.begin());
+    printf("%s\n", same ? "Both buses ended in the same state" : "The buses ended in different states");
+    return same;
+}
+
+int main(int argc, char** argv) {
+    const char* rom_path = nullptr;
+    const char* compiled_path = nullptr;
+    const char* debug_address = nullptr;
+    const char* introspect_name = nullptr;
+    bool wait = false;
+    u64 bench_budget = 0;
+    usize core_count = 1;
+    auto mode = vm::core_mode::deterministic;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--debug") == 0 && i + 1 < argc) {
+            debug_address = argv[++i];
+        } else if (strcmp(argv[i], "--introspect") == 0 && i + 1 < argc) {
+            introspect_name = argv[++i];
+        } else if (strcmp(argv[i], "--wait") == 0) {
+            wait = true;
+        } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            core_count = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_budget = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--parallel") == 0) {
+            mode = vm::core_mode::parallel;
+        } else if (!rom_path) {
+            rom_path = argv[i];
+        } else if (!compiled_path) {
+            compiled_path = argv[i];
+        } else {
+            rom_path = nullptr;
+            break;
+        }
+    }
+    if (!rom_path || core_count < 1 || core_count > vm::MAX_CORES) {
+        fprintf(stderr, "Usage: %s <rom.remi16> [compiled.so] [--debug <port or socket path>] [--wait] "
+            "[--cores <1-%zu>] [--parallel] [--introspect <name>] [--bench <instructions>]\n", argv[0], vm::MAX_CORES);
+        return 1;
+    }
+
+    auto rom = vm::load_rom_from_file(rom_path);
+    vm::machine machine;
+    machine.load(rom);
+    machine.set_cores(core_count, mode);
+
+    if (bench_budget) {
+        return bench_buses(machine, bench_budget) ? 0 : 1;
+    }
+
+    if (compiled_path) {
+        const vm::aot_module* module = load_compiled(compiled_path);
+        if (module && !machine.attach_compiled(module)) {
+            fprintf(stderr, "%s was compiled from another ROM, falling back to the interpreter\n", compiled_path);
+        }
+    }
+
+    std::unique_ptr<vm::introspection> segment;
+    if (introspect_name) {
+        segment = std::make_unique<vm::introspection>(machine);
+        if (!segment->open(introspect_name)) {
+            fprintf(stderr, "Can't create an introspection segment named %s (is another instance using it?)\n",
+                introspect_name);
+            return 1;
+        }
+        fprintf(stderr, "Introspection segment at %s\n", segment->path().c_str());
+    }
+
+    std::unique_ptr<vm::debug_server> server;
+    if (debug_address) {
+        server = std::make_unique<vm::debug_server>(machine);
+        char* end;
+        unsigned long port = strtoul(debug_address, &end, 10);
+        bool listening = *end == '\0' ? server->listen_tcp(u16(port)) : server->listen_unix(debug_address);
+        if (!listening) {
+            fprintf(stderr, "Can't start a debug server on %s\n", debug_address);
+            return 1;
+        }
+        if (wait) {
+            server->wait_for_debugger();
+        }
+    }
+
+    // A connected debugger can keep the machine going after it stops by itself
+    do {
+        machine.execute();
+    } while (server && server->machine_stopped());
+    if (segment) {
+        segment->publish();
+    }
+
+    vm::state_hasher hasher;
+    printf("%s after %" PRIu64 " instructions, %" PRIu64 " cycles\n", 
+        machine.faulted ? "Faulted" : "Halted", machine.instructions, machine.scheduler.cycles);
+    for (u8 i = 0; i < 16; i++) {
+        printf("%s = $%04x%s", vm::isa::reg_name(vm::reg(i)), machine.cpu.registers[i], i % 8 == 7 ? "\n" : "  ");
+    }
+    for (usize n = 1; n < machine.core_count(); n++) {
+        const auto& core = machine.cores[n - 1];
+        printf("Core %zu %s after %" PRIu64 " instructions\n", n, core.running ? "running" : "stopped", core.instructions);
+        for (u8 i = 0; i < 16; i++) {
+            printf("%s = $%04x%s", vm::isa::reg_name(vm::reg(i)), core.cpu.registers[i], i % 8 == 7 ? "\n" : "  ");
+        }
+    }
+    printf("State hash: %016" PRIx64 "\n", hasher.hash(machine.cpu, machine.bus.memory()));
+
+    return machine.faulted ? 2 : 0;
+}
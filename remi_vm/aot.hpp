@@ -0,0 +1,78 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+
+// Interface between the machine and programs compiled ahead of time by remi_recompiler.
+//
+// The recompiler turns the main region of a ROM into C++ where every instruction is straight-line code on the CPU
+// and bus, which is then built with the host compiler into a shared object exporting an `aot_module` named
+// `AOT_MODULE_SYMBOL`. The machine runs compiled code for as long as it can, and hands control back to the
+// interpreter for everything else (interrupts, hooks, scheduler events, code that couldn't be compiled and code
+// that was written over at runtime).
+namespace vm {
+
+// Bumped every time aot_context or aot_module change, so stale modules are rejected instead of crashing.
+constexpr u32 AOT_ABI_VERSION = 3;
+constexpr const char* AOT_MODULE_SYMBOL = "remi16_aot_module";
+
+// Machine state that compiled code runs on.
+struct aot_context {
+    sakuya16c& cpu;
+    vm::bus& bus;
+    vm::scheduler& scheduler;
+    u64& instructions;
+    // Compiled code never executes the instruction that reaches this count, so machine hooks still run from
+    // the interpreter at the right time.
+    u64 instruction_limit;
+
+    // Whether control must go back to the machine before executing the next instruction.
+    inline bool must_yield() const {
+        return cpu.status.pending 
+            || scheduler.cycles >= scheduler.deadline() 
+            || instructions + 1 >= instruction_limit;
+    }
+    // Accounts for an executed instruction.
+    inline void retire(u8 cycles) {
+        scheduler.cycles += cycles;
+        instructions++;
+    }
+    // Accounts for the cycles an instruction run through vm::execute() stalled for.
+    inline void retire_stall() {
+        scheduler.cycles += cpu.stall;
+        cpu.stall = 0;
+    }
+};
+
+// Runs compiled code starting at the program counter, until a HLT (returns control_flow::halt) or until it has
+// to yield or reaches code that wasn't compiled (returns control_flow::ok).
+typedef control_flow (*aot_entry)(aot_context& ctx);
+
+struct aot_module {
+    u32 abi_version;
+    // Where the code it was compiled from is in memory. The bank only matters for code in the high half.
+    u16 code_addr;
+    u16 code_bank;
+    // Size of that code in bytes
+    u32 code_size;
+    // hash_bytes() of that code
+    u64 code_hash;
+    aot_entry run;
+};
+
+} // namespace vm
@@ -0,0 +1,171 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <cassert>
+#include <cstring>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "./arena.hpp"
+
+namespace vm {
+
+memory_image::~memory_image() {
+#if defined(__linux__)
+    if (view) {
+        munmap((void*) view, size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+std::shared_ptr<const memory_image> memory_image::capture(const memory_arena& arena) {
+    auto image = std::make_shared<memory_image>();
+    image->size = arena.size();
+
+#if defined(__linux__)
+    image->fd = memfd_create("remi16-memory", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    assert(image->fd >= 0 && "Can't create memory image");
+    [[maybe_unused]] int ok = ftruncate(image->fd, image->size);
+    assert(ok == 0);
+
+    usize written = 0;
+    while (written < image->size) {
+        ssize_t result = pwrite(image->fd, arena.data() + written, image->size - written, written);
+        assert(result > 0 && "Can't write memory image");
+        written += result;
+    }
+
+    // Sealed so nothing can change the image under the arenas mapping it
+    fcntl(image->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+    void* view = mmap(nullptr, image->size, PROT_READ, MAP_SHARED, image->fd, 0);
+    assert(view != MAP_FAILED && "Can't map memory image");
+    image->view = (const u8*) view;
+#else
+    image->bytes = std::unique_ptr<u8[]>(new u8[image->size]);
+    memcpy(image->bytes.get(), arena.data(), image->size);
+    image->view = image->bytes.get();
+#endif
+
+    return image;
+}
+
+memory_arena::memory_arena(usize size): length(size) {
+#if defined(__linux__)
+    [[maybe_unused]] void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(mapping != MAP_FAILED && "Can't allocate memory arena");
+    base = (u8*) mapping;
+#else
+    base = (u8*) ::operator new(length, std::align_val_t(4096));
+    memset(base, 0, length);
+#endif
+}
+
+memory_arena::memory_arena(memory_arena&& other): 
+    base(other.base), length(other.length), image(std::move(other.image)), shared_fd(other.shared_fd) {
+    other.base = nullptr;
+    other.length = 0;
+    other.shared_fd = -1;
+}
+
+memory_arena::~memory_arena() {
+    if (!base) {
+        return;
+    }
+#if defined(__linux__)
+    munmap(base, length);
+    if (shared_fd >= 0) {
+        close(shared_fd);
+    }
+#else
+    ::operator delete(base, std::align_val_t(4096));
+#endif
+}
+
+void memory_arena::restore(usize offset, usize size) {
+    assert(offset + size <= length);
+    if (image) {
+        memcpy(base + offset, image->view + offset, size);
+    } else {
+        memset(base + offset, 0, size);
+    }
+}
+
+void memory_arena::map(std::shared_ptr<const memory_image> image) {
+    assert(!image || image->size == length);
+    this->image = std::move(image);
+
+#if defined(__linux__)
+    if (shared_fd >= 0) {
+        restore(0, length);
+        return;
+    }
+    // Replaced in place, so pointers into the arena stay valid
+    [[maybe_unused]] void* mapping = this->image
+        ? mmap(base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, this->image->fd, 0)
+        : mmap(base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+    assert(mapping == base && "Can't map memory image");
+#else
+    restore(0, length);
+#endif
+}
+
+bool memory_arena::protect(usize offset, usize size, bool writable) {
+    assert(offset + size <= length);
+#if defined(__linux__)
+    return mprotect(base + offset, size, writable ? PROT_READ | PROT_WRITE : PROT_READ) == 0;
+#else
+    return false;
+#endif
+}
+
+bool memory_arena::share(int fd, usize offset) {
+#if defined(__linux__)
+    if (shared_fd >= 0) {
+        return false;
+    }
+    int own_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (own_fd < 0) {
+        return false;
+    }
+
+    // Copy the contents first, then replace the pages in place
+    usize written = 0;
+    while (written < length) {
+        ssize_t result = pwrite(own_fd, base + written, length - written, offset + written);
+        if (result <= 0) {
+            close(own_fd);
+            return false;
+        }
+        written += result;
+    }
+    void* mapping = mmap(base, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, own_fd, offset);
+    assert(mapping == base && "Can't map shared memory arena");
+
+    shared_fd = own_fd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace vm
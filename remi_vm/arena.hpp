@@ -0,0 +1,90 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <memory>
+
+#include "./vm.hpp"
+
+namespace vm {
+
+class memory_arena;
+
+// Immutable copy of an arena's contents, which any number of arenas can map copy-on-write.
+//
+// On Linux the contents live in a sealed memfd, so mapping an image costs nothing up front and every arena only
+// pays for the pages it writes to. Elsewhere it's a plain heap copy.
+class memory_image {
+    friend class memory_arena;
+
+    usize size = 0;
+#if defined(__linux__)
+    int fd = -1;
+#else
+    std::unique_ptr<u8[]> bytes;
+#endif
+    // Read-only view of the contents
+    const u8* view = nullptr;
+public:
+    memory_image() = default;
+    memory_image(const memory_image&) = delete;
+    memory_image& operator=(const memory_image&) = delete;
+    ~memory_image();
+
+    // Copies the current contents of an arena.
+    static std::shared_ptr<const memory_image> capture(const memory_arena& arena);
+};
+
+// Page-aligned block of host memory, allocated as a single mapping.
+//
+// An arena starts out zeroed or as a copy-on-write view of a memory_image, and restore() returns parts of it to
+// that state.
+class memory_arena {
+    u8* base = nullptr;
+    usize length = 0;
+    // Image the arena is a view of, or nullptr if it starts out zeroed
+    std::shared_ptr<const memory_image> image;
+    // File the arena lives in after share() (-1 while it's private)
+    int shared_fd = -1;
+public:
+    explicit memory_arena(usize size);
+    memory_arena(memory_arena&& other);
+    memory_arena(const memory_arena&) = delete;
+    memory_arena& operator=(const memory_arena&) = delete;
+    ~memory_arena();
+
+    u8* data() const { return base; }
+    usize size() const { return length; }
+
+    // Restores a range of the arena to its initial state (zeros, or the mapped image).
+    void restore(usize offset, usize size);
+    // Replaces the contents with a copy-on-write view of an image (nullptr to go back to zeros). The image must
+    // have been captured from an arena of the same size. data() doesn't change.
+    void map(std::shared_ptr<const memory_image> image);
+
+    // Makes a page aligned range read-only, or writable again. Remapping the arena (map() and share()) makes it
+    // writable again. Returns false on platforms without page protection.
+    bool protect(usize offset, usize size, bool writable);
+
+    // Moves the contents into a shared mapping of `fd` at `offset` (page aligned), so other processes mapping the
+    // same file see the arena live. data() doesn't change. From then on images are copied in instead of mapped
+    // copy-on-write, since private pages wouldn't be visible through the file.
+    //
+    // The arena keeps its own duplicate of `fd`. Returns false if the file couldn't be mapped, or on platforms
+    // without shared mappings.
+    bool share(int fd, usize offset);
+};
+
+} // namespace vm
@@ -0,0 +1,207 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "./audio.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace vm {
+
+// Amplitude of a channel at full volume. Four channels at full volume just about fill the 16bit range.
+static constexpr i32 AMPLITUDE_SCALE = 32;
+
+// Adds `src` into `dst` with saturation
+static void mix_into(i16* dst, const i16* src, usize count) {
+    usize i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + i));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_adds_epi16(a, b));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = i16(std::clamp(i32(dst[i]) + i32(src[i]), -32768, 32767));
+    }
+}
+
+dev::sound::sound(scheduler& sched, const vm::bus& bus): sched(sched), bus(bus) {
+    // About a tenth of a second of buffering
+    ring = std::make_unique<spsc_ring<i16>>(SAMPLE_RATE / 10);
+}
+
+void dev::sound::on_refill(void* user, u64 now) {
+    auto* self = static_cast<sound*>(user);
+    self->generate_until(now);
+
+    // Next batch, computed from the sample count so the rate doesn't drift
+    u64 next = (self->samples_generated + BATCH) * CPU_CLOCK_HZ / SAMPLE_RATE;
+    self->refill = self->sched.schedule(next, on_refill, self);
+}
+
+void dev::sound::generate_until(u64 cycle) {
+    u64 target = cycle * SAMPLE_RATE / CPU_CLOCK_HZ;
+    alignas(16) i16 batch[BATCH];
+    while (samples_generated < target) {
+        usize count = std::min<u64>(BATCH, target - samples_generated);
+        synthesize(batch, count);
+        // If the host isn't consuming, the newest samples are dropped
+        ring->push(batch, count);
+        samples_generated += count;
+    }
+}
+
+void dev::sound::synthesize(i16* out, usize count) {
+    alignas(16) i16 voice[BATCH];
+    std::fill_n(out, count, i16(0));
+
+    for (usize i = 0; i < CHANNELS; i++) {
+        channel& ch = channels[i];
+        if (!(ch.control & 1) || ch.volume == 0) continue;
+
+        switch (i) {
+        case 0: case 1: synthesize_square(ch, voice, count); break;
+        case 2: synthesize_noise(ch, voice, count); break;
+        case 3: synthesize_sample(ch, voice, count); break;
+        }
+        mix_into(out, voice, count);
+    }
+}
+
+void dev::sound::synthesize_square(channel& ch, i16* out, usize count) {
+    u32 inc = u32((u64(ch.frequency) << 32) / SAMPLE_RATE);
+    i32 amplitude = ch.volume * AMPLITUDE_SCALE;
+    u32 phase = ch.phase;
+    usize i = 0;
+
+#if defined(__SSE2__)
+    // 8 samples per iteration: the sign of each phase selects +amplitude or -amplitude
+    __m128i phase_lo = _mm_setr_epi32(phase, phase + inc, phase + 2 * inc, phase + 3 * inc);
+    __m128i phase_hi = _mm_add_epi32(phase_lo, _mm_set1_epi32(4 * inc));
+    const __m128i step = _mm_set1_epi32(8 * inc);
+    const __m128i amp = _mm_set1_epi32(amplitude);
+    for (; i + 8 <= count; i += 8) {
+        __m128i sign_lo = _mm_srai_epi32(phase_lo, 31);
+        __m128i sign_hi = _mm_srai_epi32(phase_hi, 31);
+        // (amp ^ sign) - sign negates amp where sign is all ones
+        __m128i lo = _mm_sub_epi32(_mm_xor_si128(amp, sign_lo), sign_lo);
+        __m128i hi = _mm_sub_epi32(_mm_xor_si128(amp, sign_hi), sign_hi);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(lo, hi));
+        phase_lo = _mm_add_epi32(phase_lo, step);
+        phase_hi = _mm_add_epi32(phase_hi, step);
+    }
+    phase += u32(i) * inc;
+#endif
+
+    for (; i < count; i++) {
+        out[i] = i16((phase & 0x80000000) ? -amplitude : amplitude);
+        phase += inc;
+    }
+    ch.phase = phase;
+}
+
+void dev::sound::synthesize_noise(channel& ch, i16* out, usize count) {
+    // The LFSR is inherently serial, it's clocked every time the phase wraps around
+    u32 inc = u32((u64(ch.frequency) << 32) / SAMPLE_RATE);
+    i32 amplitude = ch.volume * AMPLITUDE_SCALE;
+    for (usize i = 0; i < count; i++) {
+        u32 next = ch.phase + inc;
+        if (next < ch.phase) {
+            u16 bit = (lfsr ^ (lfsr >> 1)) & 1;
+            lfsr = u16((lfsr >> 1) | (bit << 14));
+        }
+        ch.phase = next;
+        out[i] = i16((lfsr & 1) ? amplitude : -amplitude);
+    }
+}
+
+void dev::sound::synthesize_sample(channel& ch, i16* out, usize count) {
+    u32 step = u32((u64(ch.frequency) << 16) / SAMPLE_RATE);
+    u32 end = u32(ch.sample_length) << 16;
+    i32 volume = ch.volume;
+    // Read straight from memory, avoiding a virtual call per sample
+    const dev::memory& memory = bus.memory();
+
+    for (usize i = 0; i < count; i++) {
+        if (ch.phase >= end) {
+            if ((ch.control & 0b10) && end != 0) {
+                ch.phase %= end;
+            } else {
+                ch.control &= ~1;
+                raise(interrupt::audio);
+                std::fill_n(out + i, count - i, i16(0));
+                return;
+            }
+        }
+        auto sample = i8(memory.read(u16(ch.sample_addr + (ch.phase >> 16))));
+        out[i] = i16(sample * volume / 2);
+        ch.phase += step;
+    }
+}
+
+u8 dev::sound::read(u16 addr) const {
+    const channel& ch = channels[addr / 8];
+    switch (addr % 8) {
+    case 0: return word(ch.frequency).lo;
+    case 1: return word(ch.frequency).hi;
+    case 2: return ch.volume;
+    case 3: return ch.control;
+    case 4: return word(ch.sample_addr).lo;
+    case 5: return word(ch.sample_addr).hi;
+    case 6: return word(ch.sample_length).lo;
+    case 7: return word(ch.sample_length).hi;
+    }
+    return 0;
+}
+
+void dev::sound::write(u16 addr, u8 val) {
+    // Everything up to now was played with the old settings
+    generate_until(sched.cycles);
+
+    channel& ch = channels[addr / 8];
+    auto set_byte = [](u16& reg, bool hi, u8 val) {
+        word w = reg;
+        if (hi) w.hi = val;
+        else w.lo = val;
+        reg = w.val;
+    };
+    switch (addr % 8) {
+    case 0: case 1: set_byte(ch.frequency, addr % 2, val); break;
+    case 2: ch.volume = val; break;
+    case 3: 
+        // Starting a channel restarts it
+        if ((val & 1) && !(ch.control & 1)) ch.phase = 0;
+        ch.control = val;
+        break;
+    case 4: case 5: set_byte(ch.sample_addr, addr % 2, val); break;
+    case 6: case 7: set_byte(ch.sample_length, addr % 2, val); break;
+    }
+}
+
+void dev::sound::reset() {
+    memset(channels, 0, sizeof(channels));
+    lfsr = 1;
+
+    sched.cancel(refill);
+    samples_generated = sched.cycles * SAMPLE_RATE / CPU_CLOCK_HZ;
+    u64 next = (samples_generated + BATCH) * CPU_CLOCK_HZ / SAMPLE_RATE;
+    refill = sched.schedule(next, on_refill, this);
+}
+
+} // namespace vm
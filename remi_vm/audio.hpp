@@ -0,0 +1,91 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <memory>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+#include "./ring_buffer.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Sound generator with 4 channels: two square wave tones (0 and 1), noise (2) and sample playback (3).
+    //
+    // Each channel has 8 bytes of registers, starting at $00, $08, $10 and $18:
+    //   +$00  frequency in Hz (16bit). For the sample channel, the playback rate in samples per second
+    //   +$02  volume (8bit)
+    //   +$03  control (8bit). Bit 0 enables the channel. On the sample channel, bit 1 loops the sample
+    //   +$04  sample address (16bit, sample channel only). Samples are signed 8bit and must be in memory
+    //   +$06  sample length (16bit, sample channel only)
+    //
+    // Raises the audio interrupt when a sample that doesn't loop finishes playing.
+    //
+    // Samples are synthesized in batches from a scheduler event (and right before any register write, so
+    // changes land on the right sample), and handed to the host through a lock-free ring buffer.
+    class sound: public mapper_device {
+    public:
+        static constexpr u16 BASE = 0x7080;
+        static constexpr u32 SAMPLE_RATE = 48000;
+        static constexpr usize CHANNELS = 4;
+        // Samples synthesized per scheduler event
+        static constexpr usize BATCH = 256;
+    private:
+        struct channel {
+            u16 frequency;
+            u8 volume;
+            u8 control;
+            u16 sample_addr;
+            u16 sample_length;
+            // Square/noise phase (32bit fraction of a period), or sample position in 16.16 fixed point
+            u32 phase;
+        };
+        channel channels[CHANNELS] = {};
+        u16 lfsr = 1;
+
+        // Output samples synthesized since reset
+        u64 samples_generated = 0;
+        std::unique_ptr<spsc_ring<i16>> ring;
+
+        scheduler& sched;
+        const vm::bus& bus;
+        event_handle refill;
+
+        static void on_refill(void* user, u64 now);
+        // Synthesizes every sample up to the given cycle.
+        void generate_until(u64 cycle);
+        void synthesize(i16* out, usize count);
+        void synthesize_square(channel& ch, i16* out, usize count);
+        void synthesize_noise(channel& ch, i16* out, usize count);
+        void synthesize_sample(channel& ch, i16* out, usize count);
+    public:
+        sound(scheduler& sched, const vm::bus& bus);
+
+        const char* name() const override { return "SOUND"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + CHANNELS * 8 - 1}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+
+        // Host side: mono signed 16bit samples at SAMPLE_RATE. Only one thread may pop from it.
+        spsc_ring<i16>& output() { return *ring; }
+    };
+} // namespace dev
+
+} // namespace vm
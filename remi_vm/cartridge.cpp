@@ -0,0 +1,186 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <fstream>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define REMI16_MMAP 1
+#else
+#define REMI16_MMAP 0
+#endif
+
+#include "./cartridge.hpp"
+
+namespace vm {
+
+dev::cartridge::cartridge(cartridge&& other):
+    present(other.present), mapping(other.mapping), mapping_size(other.mapping_size), copy(std::move(other.copy)),
+    data(other.data), size(other.size), available(other.available), bank(other.bank), window(other.window),
+    window_size(other.window_size), ram(other.ram) {
+    other.present = false;
+    other.mapping = nullptr;
+    other.mapping_size = 0;
+}
+
+dev::cartridge::~cartridge() {
+    eject();
+}
+
+bool dev::cartridge::insert(const char* path, usize offset, usize size) {
+    eject();
+
+#if REMI16_MMAP
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    usize file_size = usize(info.st_size);
+    available = offset < file_size ? std::min(size, file_size - offset) : 0;
+
+    // The file itself isn't mapped: assemblers rewrite ROMs in place, and a mapping of the file would change under
+    // the program or fault once the file is truncated. The kernel copies the region into an anonymous file instead,
+    // and the mapping of that one is the snapshot the program sees.
+    int snapshot = available > 0 ? memfd_create("remi16-cartridge", MFD_CLOEXEC) : -1;
+    bool copied = snapshot >= 0 && ftruncate(snapshot, off_t(available)) == 0;
+    off_t from = off_t(offset);
+    for (usize left = available; copied && left > 0;) {
+        ssize_t sent = sendfile(snapshot, fd, &from, left);
+        copied = sent > 0;
+        left -= copied ? usize(sent) : 0;
+    }
+    close(fd);
+    if (copied) {
+        mapping = mmap(nullptr, available, PROT_READ, MAP_PRIVATE, snapshot, 0);
+        copied = mapping != MAP_FAILED;
+    }
+    if (snapshot >= 0) {
+        close(snapshot);
+    }
+    if (available > 0 && !copied) {
+        mapping = nullptr;
+        available = 0;
+        return false;
+    }
+    mapping_size = available;
+    data = (const u8*) mapping;
+#else
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    usize file_size = usize(file.tellg());
+    available = offset < file_size ? std::min(size, file_size - offset) : 0;
+    copy = std::unique_ptr<u8[]>(new u8[std::max<usize>(available, 1)]);
+    file.seekg(offset);
+    file.read((char*) copy.get(), available);
+    data = copy.get();
+#endif
+
+    present = true;
+    this->size = size;
+    select(0);
+    return true;
+}
+
+void dev::cartridge::eject() {
+#if REMI16_MMAP
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+    copy.reset();
+    present = false;
+    data = nullptr;
+    size = 0;
+    available = 0;
+    select(0);
+}
+
+void dev::cartridge::select(u16 bank) {
+    this->bank = bank;
+    usize start = usize(bank) * WINDOW_SIZE;
+    window = start < available ? data + start : nullptr;
+    window_size = start < available ? std::min(WINDOW_SIZE, available - start) : 0;
+}
+
+u8 dev::cartridge::read(u16 addr) const {
+    if (!present) {
+        return ram.read(BASE + addr);
+    }
+    if (addr >= WINDOW_OFFSET) {
+        usize offset = addr - WINDOW_OFFSET;
+        return offset < window_size ? window[offset] : 0xff;
+    }
+
+    switch (addr) {
+    case 0x00: return word(bank).lo;
+    case 0x01: return word(bank).hi;
+    case 0x02: return word(u16(std::min<usize>(bank_count(), 0xffff))).lo;
+    case 0x03: return word(u16(std::min<usize>(bank_count(), 0xffff))).hi;
+    default: return 0;
+    }
+}
+
+void dev::cartridge::write(u16 addr, u8 val) {
+    if (!present) {
+        ram.write(BASE + addr, val);
+        return;
+    }
+
+    // The window is read-only
+    word selected = bank;
+    if (addr == 0x00) {
+        selected.lo = val;
+    } else if (addr == 0x01) {
+        selected.hi = val;
+    } else {
+        return;
+    }
+    select(selected.val);
+}
+
+void dev::cartridge::reset() {
+    select(0);
+}
+
+const u8* dev::cartridge::direct_read(u16 addr, u16 size) const {
+    if (!present) {
+        return ram.direct_read(BASE + addr, size);
+    }
+    if (addr < WINDOW_OFFSET || size == 0 || addr - WINDOW_OFFSET + size > window_size) {
+        return nullptr;
+    }
+    return window + (addr - WINDOW_OFFSET);
+}
+
+u8* dev::cartridge::direct_write(u16 addr, u16 size) {
+    return present ? nullptr : ram.direct_write(BASE + addr, size);
+}
+
+} // namespace vm
@@ -0,0 +1,94 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <memory>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Banked cartridge ROM. A read-only 4KiB window shows one bank of a ROM region that can be far bigger than the
+    // address space, selected by a bank register.
+    //
+    // Registers:
+    //   $000        bank visible in the window (16bit)
+    //   $002        number of banks in the cartridge (16bit, read only, 0 without a cartridge)
+    //   $100..$10ff window, read-only. Reads past the end of the cartridge return $ff.
+    //
+    // On Linux the cartridge region is copied by the kernel into an anonymous file that is mapped instead of read, so
+    // the ROM never goes through the heap and switching banks only moves the window pointer. The mapping is a
+    // snapshot: rewriting the ROM file while the cartridge is in doesn't change it.
+    //
+    // Without a cartridge the device isn't there: its addresses are ordinary RAM, and it doesn't claim its pages so
+    // they stay on the plain memory fast path. The bus must be told with bus::update_claims() after inserting or
+    // ejecting.
+    class cartridge: public mapper_device {
+    public:
+        static constexpr u16 BASE = 0x3f00;
+        static constexpr usize WINDOW_OFFSET = 0x100;
+        static constexpr usize WINDOW_SIZE = 0x1000;
+    private:
+        bool present = false;
+        // Mapping of the snapshot of the cartridge region (nullptr if it's empty)
+        void* mapping = nullptr;
+        usize mapping_size = 0;
+        // Fallback copy of the cartridge where files can't be mapped
+        std::unique_ptr<u8[]> copy;
+        // Start of the cartridge, its size, and how much of it is actually in the file
+        const u8* data = nullptr;
+        usize size = 0;
+        usize available = 0;
+
+        u16 bank = 0;
+        // Bytes of the current bank, and how many of them are inside the cartridge
+        const u8* window = nullptr;
+        usize window_size = 0;
+
+        // RAM under the device, used while there's no cartridge
+        memory& ram;
+
+        void select(u16 bank);
+    public:
+        cartridge(memory& ram): ram(ram) {}
+        cartridge(cartridge&& other);
+        cartridge& operator=(cartridge&&) = delete;
+        ~cartridge();
+
+        // Takes `size` bytes of a ROM file starting at `offset` as the cartridge, replacing the previous one. Bytes past
+        // the end of the file read as $ff. Returns false if the file can't be opened, and leaves no cartridge in.
+        bool insert(const char* path, usize offset, usize size);
+        void eject();
+        bool inserted() const { return present; }
+        usize bank_count() const { return (size + WINDOW_SIZE - 1) / WINDOW_SIZE; }
+
+        const char* name() const override { return "CARTRIDGE"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + WINDOW_OFFSET + WINDOW_SIZE - 1}; }
+        bool claims_range() const override { return present; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+
+        // Direct access to the window, so DMA can copy out of the cartridge in bulk
+        const u8* direct_read(u16 addr, u16 size) const override;
+        u8* direct_write(u16 addr, u16 size) override;
+    };
+} // namespace dev
+
+} // namespace vm
@@ -0,0 +1,347 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <cctype>
+
+#include "./condition.hpp"
+#include "./isa.hpp"
+#include "./machine.hpp"
+
+namespace vm {
+
+// Recursive descent parser that writes the bytecode of a condition as it goes
+class condition_parser {
+    using op = breakpoint_condition::op;
+    using instr = breakpoint_condition::instr;
+
+    struct binary_operator {
+        std::string_view token;
+        int precedence;
+        op code;
+    };
+    // Longer tokens first, so they aren't taken for a shorter one they start with
+    static constexpr binary_operator binary_operators[] = {
+        {"||", 1, op::or_else}, {"&&", 2, op::and_then},
+        {"==", 6, op::eq}, {"!=", 6, op::ne}, {"<=", 7, op::le}, {">=", 7, op::ge},
+        {"<<", 8, op::shl}, {">>", 8, op::shr},
+        {"|", 3, op::bitwise_or}, {"^", 4, op::bitwise_xor}, {"&", 5, op::bitwise_and},
+        {"<", 7, op::lt}, {">", 7, op::gt},
+        {"+", 9, op::add}, {"-", 9, op::sub}, {"*", 10, op::mul}, {"/", 10, op::div}, {"%", 10, op::mod},
+    };
+
+    std::string_view source;
+    usize pos = 0;
+    // Values on the stack at this point of the code, and the most there will ever be
+    usize depth = 0;
+    usize max_depth = 0;
+    // Parentheses and unary operators the parser is inside of. Bounded, since conditions come from debugger
+    // packets and each level is a few host stack frames.
+    static constexpr usize MAX_NESTING = 64;
+    usize nesting = 0;
+public:
+    std::vector<instr> code;
+    std::string error;
+
+    condition_parser(std::string_view source): source(source) {}
+
+    bool parse() {
+        if (!expression(0)) {
+            return false;
+        }
+        skip_space();
+        if (pos < source.size()) {
+            return fail("Unexpected character");
+        }
+        if (max_depth > breakpoint_condition::MAX_DEPTH) {
+            return fail("Expression is too deep");
+        }
+        return true;
+    }
+
+private:
+    bool fail(const char* message) {
+        error = std::string(message) + " at column " + std::to_string(pos + 1);
+        return false;
+    }
+
+    void skip_space() {
+        while (pos < source.size() && isspace((unsigned char) source[pos])) {
+            pos++;
+        }
+    }
+
+    bool accept(char c) {
+        skip_space();
+        if (pos < source.size() && source[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    // Adds an instruction that changes the number of values on the stack by `effect`
+    void emit(instr in, int effect) {
+        code.push_back(in);
+        depth += effect;
+        max_depth = std::max(max_depth, depth);
+    }
+
+    bool expression(int min_precedence) {
+        if (!unary()) {
+            return false;
+        }
+        while (true) {
+            skip_space();
+            const binary_operator* found = nullptr;
+            for (const auto& candidate : binary_operators) {
+                if (source.substr(pos).starts_with(candidate.token)) {
+                    found = &candidate;
+                    break;
+                }
+            }
+            if (!found || found->precedence < min_precedence) {
+                return true;
+            }
+            pos += found->token.size();
+
+            // Left associative, so the right side only takes tighter operators
+            if (found->code == op::and_then || found->code == op::or_else) {
+                usize jump = code.size();
+                emit({found->code}, -1);
+                if (!expression(found->precedence + 1)) {
+                    return false;
+                }
+                emit({op::to_bool}, 0);
+                code[jump].target = u16(code.size());
+            } else {
+                if (!expression(found->precedence + 1)) {
+                    return false;
+                }
+                emit({found->code}, -1);
+            }
+        }
+    }
+
+    // Every nested expression goes through here, so this bounds the recursion
+    bool unary() {
+        if (nesting == MAX_NESTING) {
+            return fail("Expression is too deep");
+        }
+        nesting++;
+        bool ok = prefixed();
+        nesting--;
+        return ok;
+    }
+
+    bool prefixed() {
+        if (accept('!')) {
+            if (!unary()) return false;
+            emit({op::logical_not}, 0);
+            return true;
+        }
+        if (accept('~')) {
+            if (!unary()) return false;
+            emit({op::bitwise_not}, 0);
+            return true;
+        }
+        if (accept('-')) {
+            if (!unary()) return false;
+            emit({op::negate}, 0);
+            return true;
+        }
+        return primary();
+    }
+
+    bool primary() {
+        if (accept('(')) {
+            if (!expression(0)) return false;
+            return accept(')') || fail("Expected )");
+        }
+        if (accept('[')) {
+            if (!expression(0)) return false;
+            emit({op::word}, 0);
+            return accept(']') || fail("Expected ]");
+        }
+
+        skip_space();
+        if (pos >= source.size()) {
+            return fail("Expected a value");
+        }
+        if (source[pos] == '$' || isdigit((unsigned char) source[pos])) {
+            return number();
+        }
+        return name();
+    }
+
+    bool number() {
+        int base = 10;
+        if (source[pos] == '$') {
+            base = 16;
+            pos++;
+        } else if (source.substr(pos).starts_with("0x") || source.substr(pos).starts_with("0X")) {
+            base = 16;
+            pos += 2;
+        }
+
+        usize start = pos;
+        u64 value = 0;
+        while (pos < source.size() && isxdigit((unsigned char) source[pos])) {
+            char c = tolower(source[pos]);
+            int digit = c <= '9' ? c - '0' : c - 'a' + 10;
+            if (digit >= base) {
+                break;
+            }
+            value = value * base + digit;
+            pos++;
+        }
+        if (pos == start) {
+            return fail("Expected digits");
+        }
+        emit({op::literal, 0, 0, value}, 1);
+        return true;
+    }
+
+    bool name() {
+        usize start = pos;
+        if (source[pos] == '#') {
+            pos++;
+        }
+        usize name_start = pos;
+        while (pos < source.size() && (isalnum((unsigned char) source[pos]) || source[pos] == '_')) {
+            pos++;
+        }
+        std::string_view name = source.substr(name_start, pos - name_start);
+
+        for (u8 i = 0; i < 16; i++) {
+            // Register names start with #
+            if (name == isa::reg_name(reg(i)) + 1) {
+                emit({op::reg, i}, 1);
+                return true;
+            }
+        }
+        if (source[start] != '#') {
+            if (name == "bank") {
+                emit({op::bank}, 1);
+                return true;
+            }
+            if (name == "instructions") {
+                emit({op::instructions}, 1);
+                return true;
+            }
+            if (name == "cycles") {
+                emit({op::cycles}, 1);
+                return true;
+            }
+        }
+
+        pos = start;
+        return fail(name.empty() ? "Expected a value" : "Unknown name");
+    }
+};
+
+bool breakpoint_condition::compile(std::string_view source, std::string& error) {
+    condition_parser parser(source);
+    if (!parser.parse()) {
+        error = std::move(parser.error);
+        return false;
+    }
+    code = std::move(parser.code);
+    text = source;
+    return true;
+}
+
+// Reads a word without counting it as a bus access, since the program didn't make it
+static u16 peek16(const vm::bus& bus, u16 addr) {
+    auto read = [&](u16 addr) {
+        if (bus.plain_memory(addr)) {
+            return bus.memory().read(addr);
+        }
+        const auto& mapper = bus.find_mapper_for(addr);
+        return mapper->read(mapper->remap_range() ? u16(addr - mapper->range().first) : addr);
+    };
+    return word(read(addr), read(u16(addr + 1))).val;
+}
+
+bool breakpoint_condition::holds(const machine& machine) const {
+    if (code.empty()) {
+        return true;
+    }
+
+    u64 stack[MAX_DEPTH];
+    usize top = 0;
+    usize next = 0;
+    while (next < code.size()) {
+        const instr& in = code[next++];
+        switch (in.code) {
+        case op::literal: stack[top++] = in.value; continue;
+        case op::reg: stack[top++] = machine.cpu.reg(reg(in.index)); continue;
+        case op::bank: stack[top++] = machine.cpu.reg(reg::mb) % dev::memory::bank_count; continue;
+        case op::instructions: stack[top++] = machine.instructions; continue;
+        case op::cycles: stack[top++] = machine.scheduler.cycles; continue;
+
+        case op::word: stack[top - 1] = peek16(machine.bus, u16(stack[top - 1])); continue;
+        case op::negate: stack[top - 1] = -stack[top - 1]; continue;
+        case op::logical_not: stack[top - 1] = !stack[top - 1]; continue;
+        case op::bitwise_not: stack[top - 1] = ~stack[top - 1]; continue;
+        case op::to_bool: stack[top - 1] = stack[top - 1] != 0; continue;
+
+        case op::and_then:
+            if (stack[top - 1] == 0) {
+                next = in.target;
+            } else {
+                top--;
+            }
+            continue;
+        case op::or_else:
+            if (stack[top - 1] != 0) {
+                stack[top - 1] = 1;
+                next = in.target;
+            } else {
+                top--;
+            }
+            continue;
+
+        default:
+            break;
+        }
+
+        // Everything else is a binary operator, whose result replaces the left side
+        u64 rhs = stack[--top];
+        u64& lhs = stack[top - 1];
+        switch (in.code) {
+        case op::mul: lhs *= rhs; break;
+        case op::div: lhs = rhs ? lhs / rhs : 0; break;
+        case op::mod: lhs = rhs ? lhs % rhs : 0; break;
+        case op::add: lhs += rhs; break;
+        case op::sub: lhs -= rhs; break;
+        case op::shl: lhs = rhs < 64 ? lhs << rhs : 0; break;
+        case op::shr: lhs = rhs < 64 ? lhs >> rhs : 0; break;
+        case op::lt: lhs = lhs < rhs; break;
+        case op::le: lhs = lhs <= rhs; break;
+        case op::gt: lhs = lhs > rhs; break;
+        case op::ge: lhs = lhs >= rhs; break;
+        case op::eq: lhs = lhs == rhs; break;
+        case op::ne: lhs = lhs != rhs; break;
+        case op::bitwise_and: lhs &= rhs; break;
+        case op::bitwise_xor: lhs ^= rhs; break;
+        case op::bitwise_or: lhs |= rhs; break;
+        default: break;
+        }
+    }
+    return stack[0] != 0;
+}
+
+} // namespace vm
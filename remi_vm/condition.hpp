@@ -0,0 +1,82 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./vm.hpp"
+
+namespace vm {
+
+class machine;
+
+// Condition of a breakpoint, compiled once into bytecode for a small stack machine so checking it doesn't parse or
+// allocate anything.
+//
+// Conditions are C-like expressions over unsigned 64bit values, for example `r3 == $4141 && [$7f00] > 10`:
+//   r0..r7, pc, ac, sp, fp, im, mb, ps, fl   registers (with or without a leading #)
+//   bank, instructions, cycles               current memory bank, instructions and cycles since reset
+//   [addr]                                   16bit word at an address, read through the bus
+//   $ff, 0xff, 255                           numbers
+//   ( ) ! ~ - * / % + - << >> < <= > >= == != & ^ | && ||
+// with C precedence. && and || short-circuit, so memory isn't read when it doesn't need to be. Dividing by zero
+// gives 0.
+class breakpoint_condition {
+public:
+    // Deepest expression that can be compiled
+    static constexpr usize MAX_DEPTH = 16;
+
+    // Compiles an expression, replacing the current condition. Returns false if it doesn't parse, with the reason
+    // in `error`, and leaves the condition as it was.
+    bool compile(std::string_view source, std::string& error);
+    // Whether the condition holds for the machine as it is now. Empty conditions always hold.
+    bool holds(const machine& machine) const;
+    bool empty() const { return code.empty(); }
+    // Source the condition was compiled from
+    const std::string& source() const { return text; }
+
+private:
+    enum class op: u8 {
+        literal, reg, word, bank, instructions, cycles,
+        negate, logical_not, bitwise_not,
+        mul, div, mod, add, sub, shl, shr,
+        lt, le, gt, ge, eq, ne,
+        bitwise_and, bitwise_xor, bitwise_or,
+        // Short-circuit: if the top of the stack decides the result, replace it with 0 or 1 and jump to `target`,
+        // otherwise drop it and evaluate the right side
+        and_then, or_else,
+        // Replaces the top of the stack with 0 or 1
+        to_bool,
+    };
+
+    struct instr {
+        op code = {};
+        // Register of op::reg
+        u8 index = 0;
+        // Jump target of op::and_then and op::or_else
+        u16 target = 0;
+        // Value of op::literal
+        u64 value = 0;
+    };
+
+    std::vector<instr> code;
+    std::string text;
+
+    friend class condition_parser;
+};
+
+} // namespace vm
@@ -0,0 +1,103 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "./cores.hpp"
+
+namespace vm {
+
+core_worker::~core_worker() {
+    quitting = true;
+    posted.fetch_add(1, std::memory_order_release);
+    posted.notify_one();
+    thread.join();
+}
+
+void core_worker::loop() {
+    u32 seen = 0;
+    for (;;) {
+        posted.wait(seen, std::memory_order_acquire);
+        seen = posted.load(std::memory_order_acquire);
+        if (quitting) {
+            return;
+        }
+        job(user);
+        finished.store(seen, std::memory_order_release);
+        finished.notify_one();
+    }
+}
+
+void core_worker::post(void (*job)(void* user), void* user) {
+    this->job = job;
+    this->user = user;
+    posted.fetch_add(1, std::memory_order_release);
+    posted.notify_one();
+}
+
+void core_worker::wait() {
+    u32 target = posted.load(std::memory_order_relaxed);
+    for (u32 done = finished.load(std::memory_order_acquire); done != target; 
+        done = finished.load(std::memory_order_acquire)) {
+        finished.wait(done, std::memory_order_acquire);
+    }
+}
+
+u8 dev::core_control::read(u16 addr) const {
+    if (addr == 0x0c) {
+        return u8(count);
+    }
+    usize index = addr / 4;
+    if (index + 1 >= count) {
+        return 0;
+    }
+    switch (addr % 4) {
+    case 0x00: return word(entry[index]).lo;
+    case 0x01: return word(entry[index]).hi;
+    case 0x02: 
+        if (requests[index] != request::none) {
+            return requests[index] == request::start;
+        }
+        return cores[index].running.load(std::memory_order_relaxed);
+    default: return 0;
+    }
+}
+
+void dev::core_control::write(u16 addr, u8 val) {
+    usize index = addr / 4;
+    if (addr == 0x0c || index + 1 >= count) {
+        return;
+    }
+    switch (addr % 4) {
+    case 0x00: { word w = entry[index]; w.lo = val; entry[index] = w.val; } break;
+    case 0x01: { word w = entry[index]; w.hi = val; entry[index] = w.val; } break;
+    case 0x02: requests[index] = val & 1 ? request::start : request::stop; break;
+    default: break;
+    }
+}
+
+void dev::core_control::reset() {
+    for (usize i = 0; i < MAX_CORES - 1; i++) {
+        entry[i] = 0;
+        requests[i] = request::none;
+    }
+}
+
+dev::core_control::request dev::core_control::take_request(usize index, u16& entry_point) {
+    request taken = requests[index];
+    requests[index] = request::none;
+    entry_point = entry[index];
+    return taken;
+}
+
+} // namespace vm
@@ -0,0 +1,121 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <atomic>
+#include <thread>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./decode_cache.hpp"
+
+namespace vm {
+
+// Most cores a machine can have, counting the boot core (machine::cpu)
+constexpr usize MAX_CORES = 4;
+static_assert(MAX_CORES <= dev::memory::sharing_cores, "every core must be able to claim memory pages");
+
+// How the secondary cores of a machine are run
+enum class core_mode {
+    // Every core runs on the machine thread, taking turns one quantum at a time. Runs are reproducible.
+    deterministic,
+    // Each secondary core runs its quantum on its own host thread, alongside the boot core. Code that touches
+    // anything but registers and plain memory stops there, and is finished on the machine thread at the end of
+    // the quantum. So does code touching a memory page another core wrote to during the quantum (or read, when
+    // writing), while the boot core waits for the other cores instead (see dev::memory::begin_sharing()). Which
+    // core gets to a page first is as unpredictable as on real hardware.
+    parallel,
+};
+
+// A secondary sakuya16c core. It shares the bus with the boot core, but has its own registers and `mb` view of
+// memory.
+//
+// Devices only ever interrupt the boot core, so secondary cores never service interrupts. They stop when they fault,
+// including bus faults from their own accesses.
+struct core {
+    sakuya16c cpu;
+    // Machine clock the core has caught up to
+    u64 cycles = 0;
+    // Number of instructions executed since it was started
+    u64 instructions = 0;
+    // Cleared when the core halts or faults. Read by devices while the core may be running on its host thread.
+    std::atomic<bool> running = false;
+    // Set when it stopped in the middle of a quantum at code that must run on the machine thread
+    bool needs_machine_thread = false;
+    decode_cache code;
+};
+
+// Host thread that runs jobs for a secondary core in parallel mode.
+class core_worker {
+    std::atomic<u32> posted = 0;
+    std::atomic<u32> finished = 0;
+    void (*job)(void* user) = nullptr;
+    void* user = nullptr;
+    bool quitting = false;
+    // Last, so everything above is initialized before the thread starts using it
+    std::thread thread;
+
+    void loop();
+public:
+    core_worker(): thread(&core_worker::loop, this) {}
+    ~core_worker();
+    core_worker(const core_worker&) = delete;
+    core_worker& operator=(const core_worker&) = delete;
+
+    // Starts running `job` on the worker thread. The previous job must have been waited for.
+    void post(void (*job)(void* user), void* user);
+    // Blocks until the last posted job has finished.
+    void wait();
+};
+
+namespace dev {
+    // Starts and stops the secondary cores.
+    //
+    // Registers, for each secondary core n (1 to MAX_CORES - 1) at $04 * (n - 1):
+    //   $00  entry point (16bit)
+    //   $02  control (8bit). Writing 1 starts the core at its entry point with every other register cleared,
+    //        writing 0 stops it. Reads 1 while the core is running or about to start.
+    // And:
+    //   $0c  number of cores, counting the boot core (8bit, read only)
+    //
+    // Cores only start and stop at the end of the current quantum, so it happens at the same point in both modes.
+    class core_control: public mapper_device {
+    public:
+        enum class request: u8 { none, start, stop };
+    private:
+        core* cores = nullptr;
+        usize count = 1;
+        u16 entry[MAX_CORES - 1] = {};
+        request requests[MAX_CORES - 1] = {};
+    public:
+        static constexpr u16 BASE = 0x7100;
+
+        const char* name() const override { return "CORES"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + 0x0c}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+
+        // Sets the secondary cores the device controls. `count` includes the boot core.
+        void attach(core* cores, usize count) { this->cores = cores; this->count = count; }
+
+        // Returns and clears the pending request for secondary core `index` (0 for core 1).
+        request take_request(usize index, u16& entry_point);
+    };
+} // namespace dev
+
+} // namespace vm
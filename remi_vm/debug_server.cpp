@@ -0,0 +1,666 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define REMI16_SOCKETS 1
+#else
+#define REMI16_SOCKETS 0
+#endif
+
+#include "./debug_server.hpp"
+
+namespace vm {
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses a hex number, advancing `text` past it. Numbers that don't fit saturate instead of wrapping around.
+static u32 parse_hex(std::string_view& text) {
+    u32 value = 0;
+    while (!text.empty() && hex_digit(text[0]) >= 0) {
+        value = value > UINT32_MAX >> 4 ? UINT32_MAX : value << 4 | hex_digit(text[0]);
+        text.remove_prefix(1);
+    }
+    return value;
+}
+
+// Parses two hex digits into a byte. Returns false if either isn't a hex digit.
+static bool parse_hex8(std::string_view text, u8& val) {
+    if (text.size() < 2) return false;
+    int hi = hex_digit(text[0]);
+    int lo = hex_digit(text[1]);
+    if (hi < 0 || lo < 0) return false;
+    val = u8(hi << 4 | lo);
+    return true;
+}
+
+static void append_hex8(std::string& out, u8 val) {
+    static constexpr char digits[] = "0123456789abcdef";
+    out += digits[val >> 4];
+    out += digits[val & 0xf];
+}
+
+// Registers are sent in target byte order (little endian)
+static void append_hex16(std::string& out, u16 val) {
+    append_hex8(out, u8(val));
+    append_hex8(out, u8(val >> 8));
+}
+
+// Parses a register value sent in target byte order. Returns false if any of the 4 digits isn't a hex digit.
+static bool parse_hex16(std::string_view text, u16& val) {
+    u8 lo, hi;
+    if (!parse_hex8(text, lo) || !parse_hex8(text.substr(std::min<usize>(text.size(), 2)), hi)) return false;
+    val = u16(lo | hi << 8);
+    return true;
+}
+
+debug_server::debug_server(vm::machine& target): target(target) {
+    target.attach_debugger(this);
+}
+
+debug_server::~debug_server() {
+    target.scheduler.cancel(poll_event);
+    if (target.attached_hook() == this) {
+        target.attach(nullptr);
+    }
+    target.attach_debugger(nullptr);
+    disconnect();
+#if REMI16_SOCKETS
+    if (listener >= 0) {
+        close(listener);
+    }
+    if (!unix_path.empty()) {
+        unlink(unix_path.c_str());
+    }
+#endif
+}
+
+bool debug_server::listen_tcp(u16 port) {
+#if REMI16_SOCKETS
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    // Loopback only, the protocol has no authentication
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0 || ::listen(fd, 1) != 0) {
+        close(fd);
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    listener = fd;
+    rearm();
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool debug_server::listen_unix(const char* path) {
+#if REMI16_SOCKETS
+    sockaddr_un addr = {};
+    if (strlen(path) >= sizeof(addr.sun_path)) return false;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+
+    unlink(path);
+    if (bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0 || ::listen(fd, 1) != 0) {
+        close(fd);
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    listener = fd;
+    unix_path = path;
+    rearm();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void debug_server::rearm() {
+    target.scheduler.cancel(poll_event);
+    if (listener >= 0) {
+        poll_event = target.scheduler.schedule_in(POLL_INTERVAL, on_poll, this);
+    }
+}
+
+void debug_server::on_poll(void* user, u64 now) {
+    auto* self = static_cast<debug_server*>(user);
+    self->poll();
+    self->rearm();
+}
+
+void debug_server::poll() {
+#if REMI16_SOCKETS
+    if (client < 0) {
+        // A new debugger stops the machine right away
+        if (accept_client()) {
+            serve("S05");
+        }
+        return;
+    }
+
+    // Anything sent while running is either an interrupt request or the start of a packet
+    char buffer[256];
+    ssize_t received = recv(client, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received == 0) {
+        disconnect();
+        return;
+    }
+    if (received < 0) {
+        return;
+    }
+    bool interrupt = false;
+    for (ssize_t i = 0; i < received; i++) {
+        if (buffer[i] == 0x03) interrupt = true;
+        else input += buffer[i];
+    }
+    if (interrupt || input.find('$') != std::string::npos) {
+        serve("S02");
+    }
+#endif
+}
+
+bool debug_server::accept_client() {
+#if REMI16_SOCKETS
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) return false;
+
+    // Accepted sockets are blocking, which is what serving wants
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    if (unix_path.empty()) {
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    }
+
+    client = fd;
+    no_ack = false;
+    input.clear();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void debug_server::disconnect() {
+#if REMI16_SOCKETS
+    if (client >= 0) {
+        close(client);
+    }
+#endif
+    client = -1;
+    memset(breakpoints, 0, sizeof(breakpoints));
+    breakpoint_count = 0;
+    conditions.clear();
+    stepping = false;
+    target.watchpoints.clear();
+}
+
+bool debug_server::wait_for_debugger() {
+#if REMI16_SOCKETS
+    if (listener < 0 || client >= 0) return false;
+
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) & ~O_NONBLOCK);
+    bool accepted = accept_client();
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    return accepted && serve("S05");
+#else
+    return false;
+#endif
+}
+
+bool debug_server::machine_stopped() {
+    if (client < 0) return false;
+
+    std::string reply = target.faulted ? "S0b" : "S05";
+    watch_hit hit;
+    if (!target.faulted && target.watchpoints.take_hit(hit)) {
+        // Stopped by a watchpoint, the machine can go on unless something else asked it to stop too
+        target.stop_requested &= u8(~watchpoints::STOP_BIT);
+        reply = "T05watch:";
+        u32 addr = hit.addr < 0x8000 ? hit.addr : 0x10000 * (1 + u32(hit.bank)) + hit.addr;
+        for (int shift = 16; shift >= 0; shift -= 8) {
+            append_hex8(reply, u8(addr >> shift));
+        }
+        reply += ';';
+    }
+    // A kill request resumes serving but also asks the machine to stop
+    return serve(reply) && !target.stop_requested;
+}
+
+u64 debug_server::on_instruction(vm::machine& machine) {
+    if (!attaching) {
+        u16 pc = machine.cpu.reg(reg::pc);
+        bool breakpoint = breakpoints[pc / 64] & (u64(1) << (pc % 64));
+        if (breakpoint && !conditions.empty()) [[unlikely]] {
+            auto condition = conditions.find(pc);
+            breakpoint = condition == conditions.end() || condition->second.holds(machine);
+        }
+        if (stepping || breakpoint) {
+            stepping = false;
+            in_hook = true;
+            serve("S05");
+            in_hook = false;
+        }
+    }
+    return client >= 0 && wants_instructions() ? machine.instructions + 1 : UINT64_MAX;
+}
+
+void debug_server::update_hook() {
+    if (in_hook) {
+        // on_instruction()'s return value takes care of it
+        return;
+    }
+
+    machine_hook* current = target.attached_hook();
+    if (client >= 0 && wants_instructions()) {
+        if (current == nullptr || current == this) {
+            attaching = true;
+            target.attach(this);
+            attaching = false;
+        }
+    } else if (current == this) {
+        target.attach(nullptr);
+    }
+}
+
+bool debug_server::serve(std::string_view stop_reply) {
+    send_packet(stop_reply);
+
+    std::string packet;
+    while (read_packet(packet)) {
+        if (handle(packet)) {
+            update_hook();
+            return true;
+        }
+        if (client < 0) {
+            break;
+        }
+    }
+
+    disconnect();
+    update_hook();
+    return false;
+}
+
+bool debug_server::handle(std::string_view packet) {
+    if (packet.empty()) {
+        send_packet("");
+        return false;
+    }
+
+    std::string reply;
+    char command = packet[0];
+    std::string_view args = packet.substr(1);
+
+    switch (command) {
+    case '?':
+        send_packet(target.faulted ? "S0b" : "S05");
+        return false;
+
+    case 'g':
+        for (u16 val: target.cpu.registers) {
+            append_hex16(reply, val);
+        }
+        send_packet(reply);
+        return false;
+
+    case 'G': {
+        // Registers missing at the end are left alone, but a bad digit rejects the whole packet
+        u16 values[16];
+        u8 count = 0;
+        for (; count < 16 && args.size() >= 4; count++, args.remove_prefix(4)) {
+            if (!parse_hex16(args, values[count])) {
+                send_packet("E01");
+                return false;
+            }
+        }
+        for (u8 i = 0; i < count; i++) {
+            target.cpu.set(reg(i), values[i]);
+        }
+        send_packet("OK");
+        return false;
+    }
+
+    case 'p': {
+        u32 n = parse_hex(args);
+        if (n >= 16) {
+            send_packet("E01");
+            return false;
+        }
+        append_hex16(reply, target.cpu.reg(reg(n)));
+        send_packet(reply);
+        return false;
+    }
+
+    case 'P': {
+        u32 n = parse_hex(args);
+        u16 val;
+        if (n >= 16 || args.empty() || args[0] != '=' || !parse_hex16(args.substr(1), val)) {
+            send_packet("E01");
+            return false;
+        }
+        target.cpu.set(reg(n), val);
+        send_packet("OK");
+        return false;
+    }
+
+    case 'm': {
+        u32 addr = parse_hex(args);
+        if (args.empty() || args[0] != ',') {
+            send_packet("E01");
+            return false;
+        }
+        args.remove_prefix(1);
+        u32 length = std::min<u32>(parse_hex(args), 0x800);
+        for (u32 i = 0; i < length; i++) {
+            append_hex8(reply, read_byte(addr + i));
+        }
+        send_packet(reply);
+        return false;
+    }
+
+    case 'M': {
+        u32 addr = parse_hex(args);
+        if (args.empty() || args[0] != ',') {
+            send_packet("E01");
+            return false;
+        }
+        args.remove_prefix(1);
+        // Longer writes are refused rather than cut short, since the reply can't say how much was written
+        usize length = parse_hex(args);
+        if (length > 0x800 || args.empty() || args[0] != ':' || args.size() < 1 + length * 2) {
+            send_packet("E01");
+            return false;
+        }
+        args.remove_prefix(1);
+        // Decode everything first, so a bad digit doesn't leave a partial write behind
+        u8 data[0x800];
+        for (usize i = 0; i < length; i++) {
+            if (!parse_hex8(args.substr(i * 2), data[i])) {
+                send_packet("E01");
+                return false;
+            }
+        }
+        // The debugger writing isn't a hit
+        target.watchpoints.disarm();
+        for (usize i = 0; i < length; i++) {
+            write_byte(addr + u32(i), data[i]);
+        }
+        target.watchpoints.arm();
+        send_packet("OK");
+        return false;
+    }
+
+    case 's':
+    case 'c':
+        if (target.attached_hook() != nullptr && target.attached_hook() != this
+            && (command == 's' || breakpoint_count > 0)) {
+            // Another hook (like a replay) is attached, so stepping and breakpoints can't work
+            send_packet("E02");
+            return false;
+        }
+        stepping = command == 's';
+        return true;
+
+    case 'Z':
+    case 'z': {
+        if (args.size() >= 2 && args[0] == '2' && args[1] == ',') {
+            args.remove_prefix(2);
+            u32 addr = parse_hex(args);
+            if (args.empty() || args[0] != ',') {
+                send_packet("E01");
+                return false;
+            }
+            args.remove_prefix(1);
+            u32 length = std::min<u32>(parse_hex(args), 0x10000);
+            // Addresses up to $ffff are in the current bank, like for m and M
+            u16 bank = addr > 0xffff ? u16(addr / 0x10000 - 1) : target.cpu.reg(reg::mb);
+            if (command == 'z') {
+                target.watchpoints.remove(bank, u16(addr), length);
+            } else if (!target.watchpoints.add(bank, u16(addr), length)) {
+                send_packet("E03");
+                return false;
+            }
+            send_packet("OK");
+            return false;
+        }
+
+        // Otherwise only software breakpoints. They don't patch the program, they're checked by the hook.
+        if (args.size() < 2 || args[0] != '0' || args[1] != ',') {
+            send_packet("");
+            return false;
+        }
+        args.remove_prefix(2);
+        u16 addr = u16(parse_hex(args));
+        u64 bit = u64(1) << (addr % 64);
+        bool set = breakpoints[addr / 64] & bit;
+        if (command == 'Z' && !set) {
+            breakpoints[addr / 64] |= bit;
+            breakpoint_count++;
+        } else if (command == 'z' && set) {
+            breakpoints[addr / 64] &= ~bit;
+            breakpoint_count--;
+        }
+        send_packet("OK");
+        return false;
+    }
+
+    case 'q':
+        if (args.starts_with("Supported")) {
+            send_packet("PacketSize=1000;QStartNoAckMode+");
+        } else if (args == "Attached") {
+            send_packet("1");
+        } else if (args == "Remi16.Bank") {
+            append_hex8(reply, u8(target.cpu.reg(reg::mb) % dev::memory::bank_count));
+            send_packet(reply);
+        } else if (args.starts_with("Rcmd,")) {
+            // Hex encoded both ways, output goes in an O packet before the result
+            std::string command;
+            for (usize i = 5; i < args.size(); i += 2) {
+                u8 c;
+                if (!parse_hex8(args.substr(i), c)) {
+                    send_packet("E01");
+                    return false;
+                }
+                command += char(c);
+            }
+            bool ok = true;
+            std::string output = monitor(command, ok);
+            if (!output.empty()) {
+                reply = "O";
+                for (char c : output) {
+                    append_hex8(reply, u8(c));
+                }
+                send_packet(reply);
+            }
+            send_packet(ok ? "OK" : "E01");
+        } else {
+            send_packet("");
+        }
+        return false;
+
+    case 'Q':
+        if (args == "StartNoAckMode") {
+            send_packet("OK");
+            no_ack = true;
+        } else {
+            send_packet("");
+        }
+        return false;
+
+    case 'D':
+        send_packet("OK");
+        disconnect();
+        return true;
+
+    case 'k':
+        // Stops the machine instead of killing anything, the host decides what to do
+        disconnect();
+        target.stop_requested = true;
+        return true;
+
+    default:
+        send_packet("");
+        return false;
+    }
+}
+
+std::string debug_server::monitor(std::string_view command, bool& ok) {
+    auto next_word = [&]() {
+        usize start = command.find_first_not_of(' ');
+        command.remove_prefix(std::min(start, command.size()));
+        std::string_view word = command.substr(0, command.find(' '));
+        command.remove_prefix(word.size());
+        return word;
+    };
+
+    if (next_word() == "cond") {
+        std::string_view addr_text = next_word();
+        if (!addr_text.empty() && addr_text[0] == '$') {
+            addr_text.remove_prefix(1);
+        }
+        if (addr_text.empty()) {
+            ok = false;
+            return "Usage: cond addr [expr]\n";
+        }
+        u16 addr = u16(parse_hex(addr_text));
+        command.remove_prefix(std::min(command.find_first_not_of(' '), command.size()));
+        if (command.empty()) {
+            conditions.erase(addr);
+            return "";
+        }
+
+        breakpoint_condition condition;
+        std::string error;
+        if (!condition.compile(command, error)) {
+            ok = false;
+            return error + "\n";
+        }
+        conditions[addr] = std::move(condition);
+        return "";
+    }
+
+    ok = false;
+    return "Unknown command\n";
+}
+
+bool debug_server::read_packet(std::string& packet) {
+#if REMI16_SOCKETS
+    while (client >= 0) {
+        // Skip acks and anything before the start of a packet
+        usize start = input.find('$');
+        if (start != std::string::npos) {
+            input.erase(0, start);
+            usize end = input.find('#');
+            if (end != std::string::npos && input.size() >= end + 3) {
+                packet = input.substr(1, end - 1);
+                u8 sum = 0;
+                for (char c: packet) sum += u8(c);
+                int expected = hex_digit(input[end + 1]) << 4 | hex_digit(input[end + 2]);
+                input.erase(0, end + 3);
+
+                if (no_ack) return true;
+                if (sum == expected) {
+                    send_all("+");
+                    return true;
+                }
+                send_all("-");
+                continue;
+            }
+        } else {
+            input.clear();
+        }
+
+        char buffer[1024];
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return false;
+        }
+        input.append(buffer, received);
+    }
+#endif
+    return false;
+}
+
+void debug_server::send_packet(std::string_view data) {
+    std::string packet = "$";
+    packet += data;
+    u8 sum = 0;
+    for (char c: data) sum += u8(c);
+    packet += '#';
+    append_hex8(packet, sum);
+    send_all(packet);
+}
+
+bool debug_server::send_all(std::string_view data) {
+#if REMI16_SOCKETS
+    while (client >= 0 && !data.empty()) {
+        ssize_t sent = send(client, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data.remove_prefix(sent);
+    }
+    return data.empty();
+#else
+    return false;
+#endif
+}
+
+u8 debug_server::read_byte(u32 addr) {
+    if (addr <= 0xffff) {
+        return target.bus.read(u16(addr));
+    }
+    const u8* byte = target.bus.memory().bank_read(u16((addr >> 16) - 1), u16(addr), 1);
+    return byte ? *byte : 0;
+}
+
+void debug_server::write_byte(u32 addr, u8 val) {
+    if (addr <= 0xffff) {
+        target.bus.write(u16(addr), val);
+        return;
+    }
+    if (u8* byte = target.bus.memory().bank_write(u16((addr >> 16) - 1), u16(addr), 1)) {
+        *byte = val;
+    }
+}
+
+} // namespace vm
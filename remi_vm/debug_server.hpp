@@ -0,0 +1,124 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "./vm.hpp"
+#include "./scheduler.hpp"
+#include "./machine.hpp"
+#include "./condition.hpp"
+
+namespace vm {
+
+// Remote debug server speaking a dialect of the GDB remote serial protocol, over a Unix domain socket or a
+// loopback TCP port.
+//
+// Supported packets:
+//   ?                     stop reason
+//   g / G                 read / write every register (16 registers, 16bit little endian each)
+//   p n / P n=v           read / write register n
+//   m addr,len            read memory. Addresses up to $ffff go through the bus (current bank), and
+//   M addr,len:bytes      addresses $10000 * (1 + bank) + addr access memory of an explicit bank. At most $800
+//                         bytes per packet: m returns fewer, M fails with E01.
+//   s / c                 step / continue
+//   Z0,addr,k / z0,...    set / remove a breakpoint
+//   Z2,addr,len / z2,...  set / remove a write watchpoint (see remi_vm/watchpoints.hpp). Hits stop the machine with
+//                         a T05watch:addr; reply, addresses being in the same format as for m and M.
+//   qRemi16.Bank          current memory bank
+//   qRcmd,cmd             monitor commands:
+//                           cond addr expr   only stop at the breakpoint at addr when expr holds (see
+//                                            remi_vm/condition.hpp). Without expr, the condition is removed.
+//   D / k                 detach / stop the machine
+//
+// Nothing runs per instruction unless a debugger is connected and has breakpoints set or is stepping (watchpoints
+// don't count, they're caught by the host's page protection): the server only polls its socket from a scheduler
+// event every POLL_INTERVAL cycles. While a debugger is connected it uses the machine hook for breakpoints and
+// stepping, so it can't be combined with replays.
+class debug_server final: public machine_hook {
+public:
+    // Cycles between checks for new connections (or for an interrupt request from a connected debugger)
+    static constexpr u64 POLL_INTERVAL = CPU_CLOCK_HZ / 100;
+
+    // Attaches itself to the machine. The machine must outlive the server.
+    debug_server(vm::machine& target);
+    debug_server(const debug_server&) = delete;
+    debug_server& operator=(const debug_server&) = delete;
+    ~debug_server();
+
+    // Starts listening on a loopback TCP port. Returns false on failure.
+    bool listen_tcp(u16 port);
+    // Starts listening on a Unix domain socket, replacing anything at `path`. Returns false on failure.
+    bool listen_unix(const char* path);
+
+    // Blocks until a debugger connects, then serves it until it resumes execution. Returns false if it couldn't
+    // wait or the debugger detached.
+    bool wait_for_debugger();
+    // Lets a connected debugger inspect the machine after it stopped by itself (HLT or an unhandled fault). Returns
+    // true if the debugger resumed execution, false if there's no debugger or it detached.
+    bool machine_stopped();
+
+    // Schedules the socket poll again. The machine calls this after every reset, since resets drop all events.
+    void rearm();
+
+    u64 on_instruction(machine& machine) override;
+private:
+    vm::machine& target;
+    int listener = -1;
+    int client = -1;
+    std::string unix_path;
+    event_handle poll_event;
+
+    // Breakpoint bitmap, one bit per address
+    u64 breakpoints[0x10000 / 64] = {};
+    usize breakpoint_count = 0;
+    // Conditions of breakpoints, by address. They outlive the breakpoint, since debuggers remove and insert
+    // breakpoints again every time the machine stops.
+    std::unordered_map<u16, breakpoint_condition> conditions;
+    bool stepping = false;
+    // Set while the server attaches itself, so the call from machine::attach() isn't taken as an instruction
+    bool attaching = false;
+    // Set while serving from on_instruction(), where the hook can't be changed
+    bool in_hook = false;
+    bool no_ack = false;
+    // Bytes received but not parsed yet
+    std::string input;
+
+    static void on_poll(void* user, u64 now);
+    void poll();
+    bool accept_client();
+    void disconnect();
+
+    // Serves packets until the debugger resumes or disconnects. Returns true if it resumed.
+    bool serve(std::string_view stop_reply);
+    // Handles a single packet. Returns true if it resumes execution.
+    bool handle(std::string_view packet);
+    // Runs a monitor command, and returns what it prints.
+    std::string monitor(std::string_view command, bool& ok);
+    // Makes the machine call on_instruction() after the next instruction if needed.
+    void update_hook();
+    bool wants_instructions() const { return stepping || breakpoint_count > 0; }
+
+    bool read_packet(std::string& packet);
+    void send_packet(std::string_view data);
+    bool send_all(std::string_view data);
+
+    u8 read_byte(u32 addr);
+    void write_byte(u32 addr, u8 val);
+};
+
+} // namespace vm
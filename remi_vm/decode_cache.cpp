@@ -0,0 +1,51 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <cassert>
+#include <cstring>
+
+#include "./decode_cache.hpp"
+
+namespace vm {
+
+const decoded_instr* decode_cache::fetch(dev::memory& memory, usize page_index, usize offset, usize core) {
+    assert(page_index < dev::memory::page_count && offset + sizeof(instr) <= dev::memory::page_size);
+
+    auto& cached = pages[page_index];
+    if (!cached) [[unlikely]] {
+        cached = std::make_unique<page>();
+    }
+    if (memory.written_since(page_index, cached->mark)) [[unlikely]] {
+        memset(cached->decoded, 0, sizeof(cached->decoded));
+        cached->mark = memory.mark_epoch();
+    }
+
+    u64& bits = cached->decoded[offset / 64];
+    u64 bit = u64(1) << (offset % 64);
+    if (!(bits & bit)) [[unlikely]] {
+        if (core == 0) {
+            memory.claim_for_boot(page_index, page_index, false);
+        } else if (!memory.claim(page_index, core, false)) {
+            return nullptr;
+        }
+        u32 raw;
+        memcpy(&raw, memory.host_memory().data() + page_index * dev::memory::page_size + offset, sizeof(raw));
+        cached->instrs[offset] = decode(instr(raw));
+        bits |= bit;
+    }
+    return &cached->instrs[offset];
+}
+
+} // namespace vm
@@ -0,0 +1,53 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <array>
+#include <memory>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+
+namespace vm {
+
+// Instructions decoded from memory, cached per tracked memory page (see dev::memory::page_count).
+//
+// A cached page keeps the write epoch it was decoded at, and is thrown away the next time it's fetched from
+// after anything wrote to it (the CPU, DMA, a debugger or a reset). Self-modifying code only pays for a
+// re-decode of the page it wrote to, and pages that were never executed cost nothing.
+class decode_cache {
+    struct page {
+        // Epoch mark taken when the page was (re)decoded
+        u64 mark = 0;
+        // One bit per byte offset whose instruction has been decoded. Code doesn't have to be aligned.
+        u64 decoded[dev::memory::page_size / 64] = {};
+        std::array<decoded_instr, dev::memory::page_size> instrs;
+    };
+
+    // Allocated the first time code runs from each page
+    std::unique_ptr<std::unique_ptr<page>[]> pages;
+
+public:
+    decode_cache(): pages(new std::unique_ptr<page>[dev::memory::page_count]) {}
+
+    // Returns the decoded instruction at `offset` into a tracked page. The whole instruction must be inside the
+    // page.
+    //
+    // Decoding claims the page for `core` while cores share memory (see dev::memory::begin_sharing()), the machine
+    // thread claiming as core 0. Returns nullptr if a secondary core's claim failed.
+    const decoded_instr* fetch(dev::memory& memory, usize page, usize offset, usize core = 0);
+};
+
+} // namespace vm
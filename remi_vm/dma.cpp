@@ -0,0 +1,175 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "./dma.hpp"
+
+namespace vm {
+
+namespace {
+    // Where a transfer chunk starts, as seen from one side
+    struct endpoint {
+        mapper_device* device;
+        // Address as the device expects it
+        u16 device_addr;
+        // Bytes from the address until the device (or memory half) ends, or another device takes over
+        u32 contiguous;
+        bool is_memory;
+    };
+
+    endpoint resolve(vm::bus& bus, u16 addr) {
+        const auto& mappers = bus.get_mappers();
+
+        // Later mappers take priority, same as bus::find_mapper_for()
+        usize found = 0;
+        for (usize i = mappers.size(); i-- > 0;) {
+            auto [start, end] = mappers[i]->range();
+            if (addr >= start && addr <= end) {
+                found = i;
+                break;
+            }
+        }
+
+        auto [start, end] = mappers[found]->range();
+        u32 last = end;
+        if (found == 0) {
+            // Memory halves are separate allocations
+            last = addr < 0x8000 ? 0x7fff : 0xffff;
+        }
+        // Stop before any device with priority that starts later
+        for (usize i = found + 1; i < mappers.size(); i++) {
+            u16 other_start = mappers[i]->range().first;
+            if (other_start > addr) {
+                last = std::min<u32>(last, other_start - 1);
+            }
+        }
+
+        mapper_device* device = mappers[found].get();
+        u16 device_addr = device->remap_range() ? u16(addr - start) : addr;
+        return {device, device_addr, last - addr + 1, found == 0};
+    }
+}
+
+void dev::dma::transfer() {
+    bool fill = control & 0b10;
+    u16 src = source;
+    u16 dst = destination;
+    u32 remaining = length;
+
+    while (remaining > 0) {
+        endpoint to = resolve(bus, dst);
+        endpoint from = resolve(bus, src);
+        u16 chunk = u16(std::min({remaining, to.contiguous, fill ? remaining : from.contiguous}));
+
+        u8* out = to.is_memory 
+            ? bus.memory().bank_write(destination_bank, dst, chunk) 
+            : to.device->direct_write(to.device_addr, chunk);
+
+        if (fill) {
+            if (out) {
+                memset(out, fill_value, chunk);
+            } else {
+                for (u16 i = 0; i < chunk; i++) to.device->write(to.device_addr + i, fill_value);
+            }
+        } else {
+            const u8* in = from.is_memory
+                ? bus.memory().bank_read(source_bank, src, chunk)
+                : from.device->direct_read(from.device_addr, chunk);
+
+            if (in && out) {
+                // Source and destination may overlap
+                memmove(out, in, chunk);
+            } else if (out) {
+                for (u16 i = 0; i < chunk; i++) out[i] = from.device->read(from.device_addr + i);
+            } else if (in) {
+                for (u16 i = 0; i < chunk; i++) to.device->write(to.device_addr + i, in[i]);
+            } else {
+                for (u16 i = 0; i < chunk; i++) to.device->write(to.device_addr + i, from.device->read(from.device_addr + i));
+            }
+        }
+
+        src += chunk;
+        dst += chunk;
+        remaining -= chunk;
+    }
+
+    // Stall the CPU for the duration of the transfer
+    sched.cycles += (u64(length) * cost + 15) / 16;
+
+    if (control & 0b100) {
+        raise(interrupt::dma);
+    }
+}
+
+u8 dev::dma::read(u16 addr) const {
+    switch (addr) {
+    case 0x00: return word(source).lo;
+    case 0x01: return word(source).hi;
+    case 0x02: return word(destination).lo;
+    case 0x03: return word(destination).hi;
+    case 0x04: return word(length).lo;
+    case 0x05: return word(length).hi;
+    case 0x06: return source_bank;
+    case 0x07: return destination_bank;
+    case 0x08: return fill_value;
+    case 0x09: return control;
+    case 0x0a: return cost;
+    default: return 0;
+    }
+}
+
+void dev::dma::write(u16 addr, u8 val) {
+    auto set_byte = [](u16& reg, bool hi, u8 val) {
+        word w = reg;
+        if (hi) w.hi = val;
+        else w.lo = val;
+        reg = w.val;
+    };
+
+    switch (addr) {
+    case 0x00: case 0x01: set_byte(source, addr % 2, val); break;
+    case 0x02: case 0x03: set_byte(destination, addr % 2, val); break;
+    case 0x04: case 0x05: set_byte(length, addr % 2, val); break;
+    case 0x06: source_bank = val; break;
+    case 0x07: destination_bank = val; break;
+    case 0x08: fill_value = val; break;
+    case 0x09:
+        control = val;
+        if ((control & 1) && !busy) {
+            busy = true;
+            transfer();
+            busy = false;
+            // Start bit clears itself once done
+            control &= ~1;
+        }
+        break;
+    case 0x0a: cost = val; break;
+    default: break;
+    }
+}
+
+void dev::dma::reset() {
+    source = 0;
+    destination = 0;
+    length = 0;
+    source_bank = 0;
+    destination_bank = 0;
+    fill_value = 0;
+    control = 0;
+    cost = 4;
+}
+
+} // namespace vm
@@ -0,0 +1,71 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+
+namespace vm {
+
+namespace dev {
+    // DMA controller. Copies or fills blocks of memory in one go.
+    //
+    // Registers:
+    //   $00  source address (16bit)
+    //   $02  destination address (16bit)
+    //   $04  length in bytes (16bit)
+    //   $06  source memory bank (8bit)
+    //   $07  destination memory bank (8bit)
+    //   $08  fill value (8bit)
+    //   $09  control (8bit). Bit 0 starts the transfer, bit 1 fills the destination with the fill value instead
+    //        of copying, bit 2 raises the DMA interrupt when the transfer is done
+    //   $0a  cost in cycles per 16 bytes transferred (8bit, 4 after reset)
+    //
+    // The transfer happens as soon as it's started, and the CPU is stalled for its cost. Plain memory on both
+    // sides is moved with memmove/memset, anything else falls back to byte by byte bus accesses.
+    class dma: public mapper_device {
+        u16 source = 0;
+        u16 destination = 0;
+        u16 length = 0;
+        u8 source_bank = 0;
+        u8 destination_bank = 0;
+        u8 fill_value = 0;
+        u8 control = 0;
+        u8 cost = 4;
+        // Set while a transfer runs. A transfer that writes the control register doesn't start another one, so
+        // guest programs can't recurse into transfer() until the host stack runs out.
+        bool busy = false;
+
+        scheduler& sched;
+        vm::bus& bus;
+
+        void transfer();
+    public:
+        static constexpr u16 BASE = 0x70c0;
+
+        dma(scheduler& sched, vm::bus& bus): sched(sched), bus(bus) {}
+
+        const char* name() const override { return "DMA"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + 0x0a}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+    };
+} // namespace dev
+
+} // namespace vm
@@ -0,0 +1,277 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+
+namespace vm {
+
+// Routines run natively for the TRAP instruction (see vm::host_call for their arguments and results). They work
+// on memory as seen through the current bank, and spans wrap around the end of the address space.
+//
+// The CPU stalls for the cycles a routine charges, which only depend on its arguments and the data it processes:
+// - memmove: a cycle per 2 bytes
+// - memset: a cycle per 4 bytes
+// - mulu, muls: 8 cycles
+// - divu, divs: 16 cycles
+// - strcmp: a cycle per 2 bytes compared
+// - lz4_decompress: a cycle per byte read, and one per 2 bytes written
+namespace hostcall {
+    constexpr usize CALL_COUNT = usize(host_call::lz4_decompress) + 1;
+
+    // Plain memory is accessed directly, and anything else (devices) through the bus.
+    inline u8 load(auto& bus, u16 addr) {
+        return bus.plain_memory(addr) ? bus.memory().read(addr) : bus.read(addr);
+    }
+    inline void store(auto& bus, u16 addr, u8 val) {
+        if (bus.plain_memory(addr)) {
+            bus.memory().write(addr, val);
+        } else {
+            bus.write(addr, val);
+        }
+    }
+
+    // Calls f(addr, size, plain) over runs of pages of the same kind, without crossing into the other half of
+    // memory (see op::block()).
+    void for_each_run(auto& bus, u16 addr, u32 remaining, auto&& f) {
+        constexpr u32 page_size = dev::memory::page_size;
+        while (remaining > 0) {
+            bool plain = bus.plain_memory(addr);
+            u32 chunk = std::min(remaining, page_size - addr % page_size);
+            while (chunk < remaining && (addr + chunk) % 0x8000 != 0 && bus.plain_memory(u16(addr + chunk)) == plain) {
+                chunk += std::min(remaining - chunk, page_size);
+            }
+            f(addr, chunk, plain);
+            addr = u16(addr + chunk);
+            remaining -= chunk;
+        }
+    }
+
+    void read_span(auto& bus, u16 addr, u32 size, u8* out) {
+        for_each_run(bus, addr, size, [&](u16 run_addr, u32 run_size, bool plain) {
+            if (plain) {
+                std::memcpy(out, bus.memory().direct_read(run_addr, u16(run_size)), run_size);
+            } else {
+                for (u32 i = 0; i < run_size; i++) {
+                    out[i] = bus.read(u16(run_addr + i));
+                }
+            }
+            out += run_size;
+        });
+    }
+
+    void write_span(auto& bus, u16 addr, u32 size, const u8* in) {
+        for_each_run(bus, addr, size, [&](u16 run_addr, u32 run_size, bool plain) {
+            if (plain) {
+                std::memcpy(bus.memory().direct_write(run_addr, u16(run_size)), in, run_size);
+            } else {
+                for (u32 i = 0; i < run_size; i++) {
+                    bus.write(u16(run_addr + i), in[i]);
+                }
+            }
+            in += run_size;
+        });
+    }
+
+    // Copies in chunks through a buffer, walking backwards when the destination overlaps the end of the source,
+    // so every chunk is read before anything overwrites it.
+    control_flow memmove(sakuya16c& cpu, auto& bus) {
+        constexpr u32 buffer_size = 256;
+        u16 dst = cpu.reg(reg::r0);
+        u16 src = cpu.reg(reg::r1);
+        u32 size = cpu.reg(reg::r2);
+        cpu.stall += (size + 1) / 2;
+
+        u8 buffer[buffer_size];
+        bool backwards = u16(dst - src) != 0 && u16(dst - src) < size;
+        for (u32 done = 0; done < size;) {
+            u32 chunk = std::min(size - done, buffer_size);
+            u16 offset = u16(backwards ? size - done - chunk : done);
+            read_span(bus, u16(src + offset), chunk, buffer);
+            write_span(bus, u16(dst + offset), chunk, buffer);
+            done += chunk;
+        }
+        return control_flow::ok;
+    }
+
+    control_flow memset(sakuya16c& cpu, auto& bus) {
+        u8 val = u8(cpu.reg(reg::r1));
+        u32 size = cpu.reg(reg::r2);
+        cpu.stall += (size + 3) / 4;
+
+        for_each_run(bus, cpu.reg(reg::r0), size, [&](u16 run_addr, u32 run_size, bool plain) {
+            if (plain) {
+                std::memset(bus.memory().direct_write(run_addr, u16(run_size)), val, run_size);
+            } else {
+                for (u32 i = 0; i < run_size; i++) {
+                    bus.write(u16(run_addr + i), val);
+                }
+            }
+        });
+        return control_flow::ok;
+    }
+
+    inline void set_result(sakuya16c& cpu, u32 result) {
+        cpu.set(reg::ac, u16(result));
+        cpu.set(reg::r3, u16(result >> 16));
+    }
+
+    control_flow mulu(sakuya16c& cpu, auto&) {
+        cpu.stall += 8;
+        set_result(cpu, u32(cpu.reg(reg::r0)) * cpu.reg(reg::r1));
+        return control_flow::ok;
+    }
+
+    control_flow muls(sakuya16c& cpu, auto&) {
+        cpu.stall += 8;
+        set_result(cpu, u32(i32(i16(cpu.reg(reg::r0))) * i16(cpu.reg(reg::r1))));
+        return control_flow::ok;
+    }
+
+    control_flow divu(sakuya16c& cpu, auto&) {
+        cpu.stall += 16;
+        u16 a = cpu.reg(reg::r0);
+        u16 b = cpu.reg(reg::r1);
+        cpu.set(reg::ac, b == 0 ? 0xffff : u16(a / b));
+        cpu.set(reg::r3, b == 0 ? a : u16(a % b));
+        return control_flow::ok;
+    }
+
+    // $8000 / -1 doesn't overflow here since the operands are promoted to int, and truncates back to $8000.
+    control_flow divs(sakuya16c& cpu, auto&) {
+        cpu.stall += 16;
+        i16 a = i16(cpu.reg(reg::r0));
+        i16 b = i16(cpu.reg(reg::r1));
+        cpu.set(reg::ac, b == 0 ? 0xffff : u16(a / b));
+        cpu.set(reg::r3, b == 0 ? u16(a) : u16(a % b));
+        return control_flow::ok;
+    }
+
+    control_flow strcmp(sakuya16c& cpu, auto& bus) {
+        u16 a = cpu.reg(reg::r0);
+        u16 b = cpu.reg(reg::r1);
+        i16 result = 0;
+        u32 compared = 0;
+        while (compared < 0x10000) {
+            u8 x = load(bus, u16(a + compared));
+            u8 y = load(bus, u16(b + compared));
+            compared++;
+            if (x != y) {
+                result = x < y ? -1 : 1;
+                break;
+            }
+            if (x == 0) {
+                break;
+            }
+        }
+        cpu.stall += (compared + 1) / 2;
+        cpu.set(reg::ac, u16(result));
+        return control_flow::ok;
+    }
+
+    // LZ4 block format: sequences of a token (literal length and match length nibbles, 15 meaning more length
+    // bytes follow), the literals, and a 16bit little endian match offset into the output. The last sequence
+    // ends after its literals.
+    control_flow lz4_decompress(sakuya16c& cpu, auto& bus) {
+        u16 dst = cpu.reg(reg::r0);
+        u16 src = cpu.reg(reg::r1);
+        u32 size = cpu.reg(reg::r2);
+        u32 in = 0;
+        u32 out = 0;
+        bool malformed = false;
+
+        auto next = [&]() { return load(bus, u16(src + in++)); };
+        auto length = [&](u32 len) {
+            if (len != 15) {
+                return len;
+            }
+            u8 more;
+            do {
+                if (in >= size) {
+                    malformed = true;
+                    return 0u;
+                }
+                more = next();
+                len += more;
+            } while (more == 255);
+            return len;
+        };
+
+        while (in < size && !malformed) {
+            u8 token = next();
+
+            u32 literals = length(token >> 4);
+            if (malformed || literals > size - in || literals > 0xffff - out) {
+                malformed = true;
+                break;
+            }
+            for (u32 i = 0; i < literals; i++) {
+                store(bus, u16(dst + out++), next());
+            }
+            if (in == size) {
+                break;
+            }
+
+            if (size - in < 2) {
+                malformed = true;
+                break;
+            }
+            u16 offset = next();
+            offset |= u16(next() << 8);
+            u32 match = length(token & 0xf) + 4;
+            if (malformed || offset == 0 || offset > out || match > 0xffff - out) {
+                malformed = true;
+                break;
+            }
+            // Byte by byte, since matches may overlap the bytes they produce
+            for (u32 i = 0; i < match; i++, out++) {
+                store(bus, u16(dst + out), load(bus, u16(dst + out - offset)));
+            }
+        }
+
+        cpu.stall += in + (out + 1) / 2;
+        cpu.set(reg::ac, u16(out));
+        cpu.set(reg::r3, malformed);
+        return control_flow::ok;
+    }
+
+    // Routine that runs a host call on a given kind of bus
+    template<typename Bus>
+    using call_func = control_flow (*)(sakuya16c& cpu, Bus& bus);
+
+    // Routine lookup table by call number, in host_call order.
+    template<typename Bus>
+    inline constexpr std::array<call_func<Bus>, CALL_COUNT> call_table = {
+        memmove<Bus>, memset<Bus>, mulu<Bus>, muls<Bus>, divu<Bus>, divs<Bus>, strcmp<Bus>, lz4_decompress<Bus>,
+    };
+
+    // Runs a host call. Unknown call numbers raise an invalid opcode fault.
+    template<typename Bus>
+    control_flow run(sakuya16c& cpu, Bus& bus, u16 call) {
+        if (call >= CALL_COUNT) {
+            cpu.raise(interrupt::invalid_opcode);
+            return control_flow::error;
+        }
+        return call_table<Bus>[call](cpu, bus);
+    }
+}
+
+} // namespace vm
@@ -0,0 +1,300 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <array>
+#include <utility>
+#include <algorithm>
+
+#include "./vm.hpp"
+#include "./isa.hpp"
+#include "./mapper.hpp"
+#include "./packed.hpp"
+#include "./hostcall.hpp"
+
+// The interpreter. Included by ./vm.cpp for vm::bus, and by ./static_bus.hpp for buses built at compile time.
+namespace vm {
+
+// Instructions
+//
+// Each instruction is an overload of `op::handler` tagged with its opcode, taking the operands already decoded
+// according to the opcode's layout in isa::table. Handlers take any bus with the interface of vm::bus, so buses
+// whose devices are known at compile time get their accesses inlined into the handlers.
+namespace op {
+    template<opcode Op>
+    using opcode_tag = std::integral_constant<opcode, Op>;
+
+    // NOP - Performs no operation. 
+    //
+    // Takes no arguments. (null - null - null)
+    control_flow handler(opcode_tag<opcode::nop>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::nop> ops) { 
+        return control_flow::ok; 
+    }
+
+    // HLT - Halts the CPU. 
+    //
+    // Takes no arguments. (null - null - null)
+    control_flow handler(opcode_tag<opcode::hlt>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::hlt> ops) { 
+        return control_flow::halt; 
+    }
+
+    // MOV (lit, reg) - Moves a literal value into a register. 
+    //
+    // Takes two arguments. (16bit literal - 8bit register)
+    control_flow handler(opcode_tag<opcode::mov_lit_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::mov_lit_reg> ops) {
+        cpu.set(ops.reg, ops.lit);
+
+        return control_flow::ok;
+    }
+
+    // MOV (reg, reg) - Moves the value of one register into another.
+    //
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::mov_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::mov_reg_reg> ops) {
+        cpu.set(ops.dst, cpu.reg(ops.src));
+
+        return control_flow::ok;
+    }
+
+    // MOV (reg, mem) - Moves the value of a register into a location in memory.
+    //
+    // Takes two arguments. (8bit register - 16bit pointer literal)
+    control_flow handler(opcode_tag<opcode::mov_reg_mem>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::mov_reg_mem> ops) { 
+        bus.write16(ops.lit, cpu.reg(ops.reg));
+        
+        return control_flow::ok; 
+    }
+
+    // MOV (mem, reg) - Moves the value of a location in memory into a register.
+    //
+    // Takes two arguments. (16bit pointer literal - 8bit register)
+    control_flow handler(opcode_tag<opcode::mov_mem_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::mov_mem_reg> ops) { 
+        u16 value = bus.read16(ops.lit);
+        cpu.set(ops.reg, value);
+
+        return control_flow::ok; 
+    }
+
+    // ADD (reg, reg) - Adds the values of two registers and stores the result in the accumulator. 
+    // 
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::add_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::add_reg_reg> ops) {
+        auto val1 = cpu.reg(ops.src);
+        auto val2 = cpu.reg(ops.dst);
+
+        cpu.set(vm::reg::ac, val1 + val2);
+
+        return control_flow::ok;
+    }
+
+    // RTI - Returns from an interrupt handler, popping `im` and then `pc` from the stack.
+    //
+    // Takes no arguments. (null - null - null)
+    control_flow handler(opcode_tag<opcode::rti>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::rti> ops) {
+        u16 sp = cpu.reg(vm::reg::sp);
+        u16 im = bus.read16(sp);
+        u16 pc = bus.read16(sp + 2);
+
+        cpu.set(vm::reg::sp, sp + 4);
+        cpu.set(vm::reg::im, im);
+        cpu.set(vm::reg::pc, pc);
+
+        return control_flow::ok;
+    }
+
+    // Packed instructions treat each register as two 8bit lanes, and store the result in the accumulator.
+    template<packed::byte_op Op>
+    control_flow packed_lanes(sakuya16c& cpu, isa::operands<isa::layout::reg_reg> ops) {
+        cpu.set(vm::reg::ac, packed::apply_lanes(Op, cpu.reg(ops.src), cpu.reg(ops.dst)));
+
+        return control_flow::ok;
+    }
+
+    // PADDUS (reg, reg) - Adds the lanes of two registers, clamping each lane at 255.
+    //
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::paddus_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::paddus_reg_reg> ops) {
+        return packed_lanes<packed::byte_op::add_saturate>(cpu, ops);
+    }
+
+    // PSUBUS (reg, reg) - Subtracts the lanes of the second register from the lanes of the first, clamping each
+    // lane at 0.
+    //
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::psubus_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::psubus_reg_reg> ops) {
+        return packed_lanes<packed::byte_op::sub_saturate>(cpu, ops);
+    }
+
+    // PMINU (reg, reg) - Keeps the smallest of each pair of lanes.
+    //
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::pminu_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::pminu_reg_reg> ops) {
+        return packed_lanes<packed::byte_op::min>(cpu, ops);
+    }
+
+    // PMAXU (reg, reg) - Keeps the largest of each pair of lanes.
+    //
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::pmaxu_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::pmaxu_reg_reg> ops) {
+        return packed_lanes<packed::byte_op::max>(cpu, ops);
+    }
+
+    // PCMPEQ (reg, reg) - Compares each pair of lanes, setting the lane to $ff where they're equal and to 0 where
+    // they're not.
+    //
+    // Takes two arguments. (8bit register - 8bit register - null)
+    control_flow handler(opcode_tag<opcode::pcmpeq_reg_reg>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::pcmpeq_reg_reg> ops) {
+        word a = cpu.reg(ops.src);
+        word b = cpu.reg(ops.dst);
+        cpu.set(vm::reg::ac, word(u8(a.lo == b.lo ? 0xff : 0), u8(a.hi == b.hi ? 0xff : 0)).val);
+
+        return control_flow::ok;
+    }
+
+    // PSHUF (reg, reg, lit) - Builds the accumulator out of any two lanes of two registers. Bits 0-1 of the
+    // literal pick the low lane and bits 2-3 the high lane: 0 and 1 are the low and high lanes of the first
+    // register, 2 and 3 those of the second.
+    //
+    // Takes three arguments. (8bit register - 8bit register - 8bit literal)
+    control_flow handler(opcode_tag<opcode::pshuf_reg_reg_lit>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::pshuf_reg_reg_lit> ops) {
+        word a = cpu.reg(ops.src);
+        word b = cpu.reg(ops.dst);
+        const u8 lanes[4] = {a.lo, a.hi, b.lo, b.hi};
+        cpu.set(vm::reg::ac, word(lanes[ops.lit & 0b11], lanes[(ops.lit >> 2) & 0b11]).val);
+
+        return control_flow::ok;
+    }
+
+    // Block instructions apply a byte operation between an 8bit literal and every byte of a span of memory, as
+    // seen through the current bank. The first register holds the address and the second the length in bytes.
+    // Spans wrap around the end of the address space.
+    //
+    // Plain memory is processed in bulk, and anything else (devices) byte by byte through the bus. The CPU stalls
+    // for a cycle per 16 bytes.
+    template<packed::byte_op Op>
+    control_flow block(sakuya16c& cpu, auto& bus, isa::operands<isa::layout::reg_reg_lit> ops) {
+        constexpr u32 page_size = dev::memory::page_size;
+        u16 addr = cpu.reg(ops.src);
+        u32 remaining = cpu.reg(ops.dst);
+        cpu.stall += (remaining + 15) / 16;
+
+        while (remaining > 0) {
+            // Gather pages of the same kind, without crossing into the other half of memory
+            bool plain = bus.plain_memory(addr);
+            u32 chunk = std::min(remaining, page_size - addr % page_size);
+            while (chunk < remaining && (addr + chunk) % 0x8000 != 0 && bus.plain_memory(u16(addr + chunk)) == plain) {
+                chunk += std::min(remaining - chunk, page_size);
+            }
+
+            if (plain) {
+                packed::apply_span(Op, bus.memory().direct_write(addr, u16(chunk)), chunk, ops.lit);
+            } else {
+                for (u32 i = 0; i < chunk; i++) {
+                    u16 byte_addr = u16(addr + i);
+                    bus.write(byte_addr, packed::apply(Op, bus.read(byte_addr), ops.lit));
+                }
+            }
+            addr = u16(addr + chunk);
+            remaining -= chunk;
+        }
+
+        return control_flow::ok;
+    }
+
+    // BADDUS (reg, reg, lit) - Adds the literal to every byte of a span of memory, clamping at 255.
+    //
+    // Takes three arguments. (8bit address register - 8bit length register - 8bit literal)
+    control_flow handler(opcode_tag<opcode::baddus_reg_reg_lit>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::baddus_reg_reg_lit> ops) {
+        return block<packed::byte_op::add_saturate>(cpu, bus, ops);
+    }
+
+    // BSUBUS (reg, reg, lit) - Subtracts the literal from every byte of a span of memory, clamping at 0.
+    //
+    // Takes three arguments. (8bit address register - 8bit length register - 8bit literal)
+    control_flow handler(opcode_tag<opcode::bsubus_reg_reg_lit>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::bsubus_reg_reg_lit> ops) {
+        return block<packed::byte_op::sub_saturate>(cpu, bus, ops);
+    }
+
+    // BMINU (reg, reg, lit) - Clamps every byte of a span of memory to at most the literal.
+    //
+    // Takes three arguments. (8bit address register - 8bit length register - 8bit literal)
+    control_flow handler(opcode_tag<opcode::bminu_reg_reg_lit>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::bminu_reg_reg_lit> ops) {
+        return block<packed::byte_op::min>(cpu, bus, ops);
+    }
+
+    // BMAXU (reg, reg, lit) - Clamps every byte of a span of memory to at least the literal.
+    //
+    // Takes three arguments. (8bit address register - 8bit length register - 8bit literal)
+    control_flow handler(opcode_tag<opcode::bmaxu_reg_reg_lit>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::bmaxu_reg_reg_lit> ops) {
+        return block<packed::byte_op::max>(cpu, bus, ops);
+    }
+
+    // TRAP (lit) - Runs the host call numbered by the literal (see vm::host_call). Unknown numbers raise an invalid
+    // opcode fault.
+    //
+    // Takes one argument. (16bit literal)
+    control_flow handler(opcode_tag<opcode::trap_lit>, sakuya16c& cpu, auto& bus, isa::operands_for<opcode::trap_lit> ops) {
+        return hostcall::run(cpu, bus, ops.lit);
+    }
+
+    // Opcodes without an instruction, and instructions naming registers that don't exist, raise an invalid opcode
+    // fault.
+    template<typename Bus>
+    control_flow invalid(sakuya16c& cpu, Bus& bus, instr instr) {
+        cpu.raise(interrupt::invalid_opcode);
+        return control_flow::error;
+    }
+
+    // Decodes the operands of an instruction and calls its handler. Handlers index the registers with their
+    // operands, so register bytes past the last register are caught here.
+    template<opcode Op, typename Bus>
+    control_flow dispatch(sakuya16c& cpu, Bus& bus, instr instr) {
+        if (!isa::operands_for<Op>::valid(instr)) [[unlikely]] {
+            return invalid(cpu, bus, instr);
+        }
+        return handler(opcode_tag<Op>{}, cpu, bus, isa::operands_for<Op>::decode(instr));
+    }
+
+    // Handler that executes one opcode on a given kind of bus
+    template<typename Bus>
+    using handler_func = control_flow (*)(sakuya16c& cpu, Bus& bus, instr instr);
+
+    // Instruction lookup table by opcode (this is to avoid a giant switch statement), generated from isa::table.
+    //
+    // It has an entry for every possible opcode byte, so fetching garbage can never index past the end of it.
+    template<typename Bus, usize I>
+    constexpr handler_func<Bus> opcode_entry() {
+        if constexpr (I < isa::OPCODE_COUNT) {
+            return dispatch<opcode(I), Bus>;
+        } else {
+            return invalid<Bus>;
+        }
+    }
+
+    template<typename Bus, usize... I>
+    constexpr std::array<handler_func<Bus>, sizeof...(I)> make_opcode_table(std::index_sequence<I...>) {
+        return {opcode_entry<Bus, I>()...};
+    }
+    template<typename Bus>
+    inline constexpr auto opcode_table = make_opcode_table<Bus>(std::make_index_sequence<256>());
+
+    // Executes an instruction fetched from the lookup table of a bus.
+    template<typename Bus>
+    control_flow execute(sakuya16c& cpu, Bus& bus, instr instr) {
+        return opcode_table<Bus>[usize(instr.op)](cpu, bus, instr);
+    }
+}
+
+} // namespace vm
@@ -0,0 +1,63 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "./interrupts.hpp"
+
+namespace vm {
+
+u8 dev::interrupt_controller::read(u16 addr) const {
+    if (addr < 0x20) {
+        word vector = vectors[addr / 2];
+        return addr % 2 == 0 ? vector.lo : vector.hi;
+    }
+
+    word raised = irq_target ? irq_target->status.raised : u16(0);
+    switch (addr) {
+    case 0x20: return raised.lo;
+    case 0x21: return raised.hi;
+    default: return 0;
+    }
+}
+
+void dev::interrupt_controller::write(u16 addr, u8 val) {
+    if (addr < 0x20) {
+        word vector = vectors[addr / 2];
+        if (addr % 2 == 0) vector.lo = val;
+        else vector.hi = val;
+        vectors[addr / 2] = vector.val;
+        return;
+    }
+    if (!irq_target) {
+        return;
+    }
+
+    // Each byte of the 16bit registers covers 8 interrupt lines
+    u8 first_line = addr % 2 == 0 ? 0 : 8;
+    for (u8 bit = 0; bit < 8; bit++) {
+        if (!(val & (1 << bit))) continue;
+
+        auto line = static_cast<interrupt>(first_line + bit);
+        switch (addr) {
+        case 0x20: case 0x21: irq_target->acknowledge(line); break;
+        case 0x22: case 0x23: irq_target->raise(line); break;
+        }
+    }
+}
+
+void dev::interrupt_controller::reset() {
+    memset(vectors, 0, sizeof(vectors));
+}
+
+} // namespace vm
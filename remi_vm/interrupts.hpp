@@ -0,0 +1,50 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "./vm.hpp"
+#include "./mapper.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Interrupt controller. Holds the handler address (vector) of every interrupt line, and lets software
+    // inspect, acknowledge and raise interrupts. Masking is done through the `im` register.
+    //
+    // Registers:
+    //   $00..$1f  vectors, one 16bit handler address per interrupt line (0 means no handler)
+    //   $20       raised interrupts (16bit). Writing a 1 to a bit acknowledges that interrupt
+    //   $22       software raise (16bit, write only). Writing a 1 to a bit raises that interrupt
+    //
+    // When an unmasked interrupt is pending, the CPU pushes `pc` and then `im` to the stack, clears `im` and jumps
+    // to the vector. RTI pops them back.
+    class interrupt_controller: public mapper_device {
+        u16 vectors[16] = {};
+    public:
+        static constexpr u16 BASE = 0x7000;
+
+        const char* name() const override { return "INTERRUPTS"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + 0x23}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+
+        u16 vector(interrupt line) const { return vectors[u8(line)]; }
+    };
+} // namespace dev
+
+} // namespace vm
@@ -0,0 +1,180 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <new>
+#include <atomic>
+#include <cstring>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define REMI16_SHARED_MEMORY 1
+#else
+#define REMI16_SHARED_MEMORY 0
+#endif
+
+#include "./introspection.hpp"
+
+namespace vm {
+
+static constexpr char MAGIC[8] = {'R', 'E', 'M', 'I', '1', '6', 'I', 'S'};
+static constexpr u32 READ_ATTEMPTS = 1 << 20;
+
+bool read_state(const introspection_header& header, introspection_state& state) {
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != INTROSPECTION_VERSION) {
+        return false;
+    }
+
+    // Segments are usually mapped read-only, which atomic loads are fine with
+    std::atomic_ref<u32> sequence(const_cast<u32&>(header.sequence));
+    // Updates take nanoseconds, so running out of attempts means the writer died halfway through one
+    for (u32 attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        u32 before = sequence.load(std::memory_order_acquire);
+        if (before % 2 != 0) {
+            continue;
+        }
+        memcpy(&state, &header.state, sizeof(state));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+introspection::introspection(vm::machine& target): target(target) {
+    target.attach_introspection(this);
+}
+
+introspection::~introspection() {
+    target.scheduler.cancel(publish_event);
+    target.attach_introspection(nullptr);
+#if REMI16_SHARED_MEMORY
+    // The memory keeps its own mapping of the segment
+    if (header) {
+        munmap(header, MEMORY_OFFSET);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!shm_name.empty()) {
+        shm_unlink(shm_name.c_str());
+    }
+#endif
+}
+
+bool introspection::open(const char* name) {
+#if REMI16_SHARED_MEMORY
+    if (fd >= 0) {
+        return false;
+    }
+    constexpr usize memory_size = dev::memory::page_count * dev::memory::page_size;
+
+    if (name) {
+        // Readable by everyone, since the point is letting other processes map it. Exclusive, so the segment of
+        // another running instance is never taken over (and only ours gets unlinked).
+        std::string object = std::string("/") + name;
+        fd = shm_open(object.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            shm_name = object;
+        }
+        segment_path = "/dev/shm/" + std::string(name);
+    } else {
+        fd = memfd_create("remi16-introspection", MFD_CLOEXEC);
+        segment_path = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+    }
+
+    void* mapping = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, MEMORY_OFFSET + memory_size) == 0) {
+        mapping = mmap(nullptr, MEMORY_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    // Sharing remaps memory, which drops the watchpoint protection
+    bool shared = false;
+    if (mapping != MAP_FAILED) {
+        target.watchpoints.disarm();
+        shared = target.bus.memory().share(fd, MEMORY_OFFSET);
+        target.watchpoints.arm();
+    }
+    if (!shared) {
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, MEMORY_OFFSET);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!shm_name.empty()) {
+            shm_unlink(shm_name.c_str());
+        }
+        fd = -1;
+        shm_name.clear();
+        segment_path.clear();
+        return false;
+    }
+
+    header = new (mapping) introspection_header();
+    memcpy(header->magic, MAGIC, sizeof(MAGIC));
+    header->version = INTROSPECTION_VERSION;
+    header->header_size = sizeof(introspection_header);
+    header->memory_offset = MEMORY_OFFSET;
+    header->memory_size = memory_size;
+    header->half_size = dev::memory::pages_per_half * dev::memory::page_size;
+    header->bank_count = dev::memory::bank_count;
+
+    publish();
+    rearm();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void introspection::publish() {
+    if (!header) {
+        return;
+    }
+
+    // Odd while writing, so readers know to retry
+    std::atomic_ref<u32> sequence(header->sequence);
+    u32 current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    introspection_state& state = header->state;
+    const auto& cpu = target.cpu;
+    state.cycles = target.scheduler.cycles;
+    state.instructions = target.instructions;
+    memcpy(state.registers, cpu.registers, sizeof(state.registers));
+    state.raised = cpu.status.raised;
+    state.pending = cpu.status.pending;
+    state.faulted = target.faulted;
+
+    sequence.store(current + 2, std::memory_order_release);
+}
+
+void introspection::rearm() {
+    target.scheduler.cancel(publish_event);
+    if (header) {
+        publish_event = target.scheduler.schedule_in(PUBLISH_INTERVAL, on_publish, this);
+    }
+}
+
+void introspection::on_publish(void* user, u64 now) {
+    auto* self = static_cast<introspection*>(user);
+    self->publish();
+    self->rearm();
+}
+
+} // namespace vm
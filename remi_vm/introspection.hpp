@@ -0,0 +1,109 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <string>
+
+#include "./vm.hpp"
+#include "./scheduler.hpp"
+#include "./machine.hpp"
+
+namespace vm {
+
+constexpr u32 INTROSPECTION_VERSION = 1;
+
+// State published at every update. Only consistent when read under the sequence counter, see read_state().
+struct introspection_state {
+    u64 cycles;
+    u64 instructions;
+    // Boot core registers, in vm::reg order
+    u16 registers[16];
+    // Interrupt lines raised and pending (raised and enabled) on the boot core
+    u16 raised;
+    u16 pending;
+    u8 faulted;
+    u8 reserved[7];
+};
+
+// Header at the start of an introspection segment. Plain fixed width fields, so tools in any language can map it.
+//
+// Memory follows at `memory_offset`: the low half, then the high half of each bank, `half_size` bytes each. It's
+// the live memory of the machine, not a copy, so it can be read at any time but isn't synchronized with `state`.
+struct introspection_header {
+    // "REMI16IS"
+    char magic[8];
+    u32 version;
+    u32 header_size;
+    u64 memory_offset;
+    u64 memory_size;
+    u32 half_size;
+    u32 bank_count;
+    // Odd while `state` is being updated. Readers retry until they see the same even value before and after copying.
+    u32 sequence;
+    u32 reserved;
+    introspection_state state;
+};
+
+// Copies the state out of a mapped segment, retrying while it's being updated. Returns false if the segment isn't
+// an introspection segment of a version this build understands, or if it stays mid-update (its writer died while
+// publishing).
+bool read_state(const introspection_header& header, introspection_state& state);
+
+// Exposes a machine to other processes through a shared memory segment, with a header describing it, the boot core
+// state, and the memory banks themselves.
+//
+// Memory is moved into the segment, so external tools observe it live with zero copies. Registers are published
+// every PUBLISH_INTERVAL cycles from a scheduler event, and whenever publish() is called, so nothing is added to
+// the instruction or memory access paths.
+//
+// Linux only: memory images are memfds there already, and the memory stays in the segment for the rest of the
+// machine's life.
+class introspection {
+public:
+    // Cycles between state updates (1ms of guest time)
+    static constexpr u64 PUBLISH_INTERVAL = CPU_CLOCK_HZ / 1000;
+    // Memory starts at the first page after the header
+    static constexpr usize MEMORY_OFFSET = 4096;
+    static_assert(sizeof(introspection_header) <= MEMORY_OFFSET);
+
+    // Attaches itself to the machine. The machine must outlive the segment.
+    introspection(vm::machine& target);
+    introspection(const introspection&) = delete;
+    introspection& operator=(const introspection&) = delete;
+    ~introspection();
+
+    // Creates the segment and moves the machine's memory into it. With a name it's a POSIX shared memory object
+    // (`/name`, usually /dev/shm/name), otherwise an anonymous memfd reachable through /proc. Returns false on
+    // failure, including when a segment with that name already exists, and the machine keeps running as before.
+    bool open(const char* name = nullptr);
+    // Path other processes can open the segment from. Empty until open() succeeds.
+    const std::string& path() const { return segment_path; }
+
+    // Publishes the current state.
+    void publish();
+    // Schedules the periodic update again. The machine calls this after every reset, since resets drop all events.
+    void rearm();
+private:
+    vm::machine& target;
+    int fd = -1;
+    std::string segment_path;
+    std::string shm_name;
+    introspection_header* header = nullptr;
+    event_handle publish_event;
+
+    static void on_publish(void* user, u64 now);
+};
+
+} // namespace vm
@@ -0,0 +1,265 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <iterator>
+
+#include "./vm.hpp"
+
+// Single description of the sakuya16c instruction set.
+//
+// Everything that needs to know about instructions (the interpreter's dispatch table, cycle costs, the assembler
+// and the disassembler) is generated from `isa::table`, so adding an instruction only means adding an opcode, a
+// row in the table and a handler in ./interpreter.hpp.
+namespace vm::isa {
+
+// How the three argument bytes of an instruction are laid out.
+enum class layout: u8 {
+    // (null - null - null)
+    none,
+    // (16bit literal - 8bit register)
+    lit_reg,
+    // (8bit register - 8bit register - null)
+    reg_reg,
+    // (8bit register - 16bit literal)
+    reg_lit,
+    // (8bit register - 8bit register - 8bit literal)
+    reg_reg_lit,
+    // (16bit literal - null)
+    lit,
+};
+
+struct opcode_info {
+    opcode op;
+    // Name shown by the disassembler
+    const char* mnemonic;
+    // Unique name of this overload of the mnemonic
+    const char* name;
+    isa::layout layout;
+    // Cycle cost. Memory accesses take a cycle per byte.
+    u8 cycles;
+};
+
+// The instruction set, indexed by opcode.
+constexpr opcode_info table[] = {
+    {opcode::nop,         "nop", "nop",         layout::none,    1},
+    {opcode::hlt,         "hlt", "hlt",         layout::none,    1},
+
+    {opcode::mov_lit_reg, "mov", "mov_lit_reg", layout::lit_reg, 2},
+    {opcode::mov_reg_reg, "mov", "mov_reg_reg", layout::reg_reg, 1},
+    {opcode::mov_reg_mem, "mov", "mov_reg_mem", layout::reg_lit, 3},
+    {opcode::mov_mem_reg, "mov", "mov_mem_reg", layout::lit_reg, 3},
+
+    {opcode::add_reg_reg, "add", "add_reg_reg", layout::reg_reg, 1},
+
+    {opcode::rti,         "rti", "rti",         layout::none,    5},
+
+    {opcode::paddus_reg_reg,    "paddus", "paddus_reg_reg",    layout::reg_reg,     1},
+    {opcode::psubus_reg_reg,    "psubus", "psubus_reg_reg",    layout::reg_reg,     1},
+    {opcode::pminu_reg_reg,     "pminu",  "pminu_reg_reg",     layout::reg_reg,     1},
+    {opcode::pmaxu_reg_reg,     "pmaxu",  "pmaxu_reg_reg",     layout::reg_reg,     1},
+    {opcode::pcmpeq_reg_reg,    "pcmpeq", "pcmpeq_reg_reg",    layout::reg_reg,     1},
+    {opcode::pshuf_reg_reg_lit, "pshuf",  "pshuf_reg_reg_lit", layout::reg_reg_lit, 1},
+
+    // Block instructions also stall for a cycle per 16 bytes
+    {opcode::baddus_reg_reg_lit, "baddus", "baddus_reg_reg_lit", layout::reg_reg_lit, 4},
+    {opcode::bsubus_reg_reg_lit, "bsubus", "bsubus_reg_reg_lit", layout::reg_reg_lit, 4},
+    {opcode::bminu_reg_reg_lit,  "bminu",  "bminu_reg_reg_lit",  layout::reg_reg_lit, 4},
+    {opcode::bmaxu_reg_reg_lit,  "bmaxu",  "bmaxu_reg_reg_lit",  layout::reg_reg_lit, 4},
+
+    // Host calls also stall for the cycles charged by the routine
+    {opcode::trap_lit, "trap", "trap_lit", layout::lit, 2},
+};
+
+// Number of valid opcodes.
+constexpr usize OPCODE_COUNT = std::size(table);
+
+// Every opcode must have exactly one row, in enum order.
+constexpr bool table_matches_enum() {
+    for (usize i = 0; i < OPCODE_COUNT; i++) {
+        if (table[i].op != opcode(i)) return false;
+    }
+    return true;
+}
+static_assert(table_matches_enum(), "isa::table is out of order or is missing an opcode");
+static_assert(usize(opcode::trap_lit) + 1 == OPCODE_COUNT, "isa::table must have a row for the last opcode");
+
+constexpr bool valid(opcode op) { return usize(op) < OPCODE_COUNT; }
+constexpr const opcode_info& info(opcode op) { return table[usize(op)]; }
+constexpr layout layout_of(opcode op) { return info(op).layout; }
+// Invalid opcodes take a cycle to fault
+constexpr u8 cycles(opcode op) { return valid(op) ? info(op).cycles : 1; }
+
+// Assembly name of a register
+constexpr const char* reg_name(vm::reg reg) {
+    constexpr const char* names[] = {
+        "#pc", "#ac", "#sp", "#fp", "#im", "#mb", "#ps", "#fl",
+        "#r0", "#r1", "#r2", "#r3", "#r4", "#r5", "#r6", "#r7",
+    };
+    return u8(reg) < std::size(names) ? names[u8(reg)] : "#??";
+}
+
+// Whether an operand byte names a register. Anything else would index past sakuya16c::registers.
+constexpr bool valid_reg(u8 byte) { return byte <= u8(vm::reg::r7); }
+
+// Decoded arguments of each layout. Handlers take these instead of the raw instruction, so the decoding is
+// inlined into them. decode() trusts the register bytes, valid() must be checked first.
+template<layout L> struct operands;
+
+template<> struct operands<layout::none> {
+    static constexpr bool valid(instr) { return true; }
+    static constexpr operands decode(instr) { return {}; }
+    constexpr instr encode(opcode op) const { return instr(op); }
+};
+
+template<> struct operands<layout::lit_reg> {
+    u16 lit;
+    vm::reg reg;
+
+    static constexpr bool valid(instr instr) { return valid_reg(instr.args[2]); }
+    static constexpr operands decode(instr instr) {
+        return {u16(instr.args[0] | (instr.args[1] << 8)), vm::reg(instr.args[2])};
+    }
+    constexpr instr encode(opcode op) const { return instr(op, u8(lit), u8(lit >> 8), u8(reg)); }
+};
+
+template<> struct operands<layout::reg_reg> {
+    vm::reg src;
+    vm::reg dst;
+
+    static constexpr bool valid(instr instr) { return valid_reg(instr.args[0]) && valid_reg(instr.args[1]); }
+    static constexpr operands decode(instr instr) { return {vm::reg(instr.args[0]), vm::reg(instr.args[1])}; }
+    constexpr instr encode(opcode op) const { return instr(op, u8(src), u8(dst)); }
+};
+
+template<> struct operands<layout::reg_lit> {
+    vm::reg reg;
+    u16 lit;
+
+    static constexpr bool valid(instr instr) { return valid_reg(instr.args[0]); }
+    static constexpr operands decode(instr instr) {
+        return {vm::reg(instr.args[0]), u16(instr.args[1] | (instr.args[2] << 8))};
+    }
+    constexpr instr encode(opcode op) const { return instr(op, u8(reg), u8(lit), u8(lit >> 8)); }
+};
+
+template<> struct operands<layout::reg_reg_lit> {
+    vm::reg src;
+    vm::reg dst;
+    u8 lit;
+
+    static constexpr bool valid(instr instr) { return valid_reg(instr.args[0]) && valid_reg(instr.args[1]); }
+    static constexpr operands decode(instr instr) {
+        return {vm::reg(instr.args[0]), vm::reg(instr.args[1]), instr.args[2]};
+    }
+    constexpr instr encode(opcode op) const { return instr(op, u8(src), u8(dst), lit); }
+};
+
+template<> struct operands<layout::lit> {
+    u16 lit;
+
+    static constexpr bool valid(instr) { return true; }
+    static constexpr operands decode(instr instr) { return {u16(instr.args[0] | (instr.args[1] << 8))}; }
+    constexpr instr encode(opcode op) const { return instr(op, u8(lit), u8(lit >> 8)); }
+};
+
+template<opcode Op>
+using operands_for = operands<layout_of(Op)>;
+
+// Whether an instruction can be executed: its opcode exists and its register operands name registers. Invalid
+// instructions raise an invalid opcode fault.
+constexpr bool valid(instr instr) {
+    if (!valid(instr.op)) return false;
+    switch (layout_of(instr.op)) {
+    case layout::none: return operands<layout::none>::valid(instr);
+    case layout::lit_reg: return operands<layout::lit_reg>::valid(instr);
+    case layout::reg_reg: return operands<layout::reg_reg>::valid(instr);
+    case layout::reg_lit: return operands<layout::reg_lit>::valid(instr);
+    case layout::reg_reg_lit: return operands<layout::reg_reg_lit>::valid(instr);
+    case layout::lit: return operands<layout::lit>::valid(instr);
+    }
+    return false;
+}
+
+// Encodes an instruction. The operands are checked against the opcode's layout at compile time, eg.
+// `encode<opcode::mov_lit_reg>({0x4141, reg::r5})`
+template<opcode Op>
+constexpr instr encode(operands_for<Op> ops = {}) { return ops.encode(Op); }
+
+// Kind of a disassembled operand
+enum class operand_kind: u8 {
+    reg,
+    lit,
+};
+
+struct operand {
+    operand_kind kind;
+    u16 value;
+};
+
+// An instruction split into its mnemonic and operands, in source order.
+struct disassembly {
+    // Null if the opcode is invalid
+    const opcode_info* info;
+    operand operands[3];
+    u8 count;
+};
+
+constexpr disassembly disassemble(instr instr) {
+    if (!valid(instr.op)) return {nullptr, {}, 0};
+
+    const opcode_info* op = &info(instr.op);
+    auto reg = [](vm::reg reg) { return operand{operand_kind::reg, u16(reg)}; };
+    auto lit = [](u16 lit) { return operand{operand_kind::lit, lit}; };
+
+    switch (op->layout) {
+    case layout::none:
+        return {op, {}, 0};
+    case layout::lit_reg: {
+        auto ops = operands<layout::lit_reg>::decode(instr);
+        return {op, {lit(ops.lit), reg(ops.reg)}, 2};
+    }
+    case layout::reg_reg: {
+        auto ops = operands<layout::reg_reg>::decode(instr);
+        return {op, {reg(ops.src), reg(ops.dst)}, 2};
+    }
+    case layout::reg_lit: {
+        auto ops = operands<layout::reg_lit>::decode(instr);
+        return {op, {reg(ops.reg), lit(ops.lit)}, 2};
+    }
+    case layout::reg_reg_lit: {
+        auto ops = operands<layout::reg_reg_lit>::decode(instr);
+        return {op, {reg(ops.src), reg(ops.dst), lit(ops.lit)}, 3};
+    }
+    case layout::lit: {
+        auto ops = operands<layout::lit>::decode(instr);
+        return {op, {lit(ops.lit)}, 1};
+    }
+    }
+    return {nullptr, {}, 0};
+}
+
+// Encoding and decoding must round-trip for every layout
+static_assert(disassemble(encode<opcode::mov_lit_reg>({0x1234, reg::r3})).operands[0].value == 0x1234);
+static_assert(disassemble(encode<opcode::mov_lit_reg>({0x1234, reg::r3})).operands[1].value == u16(reg::r3));
+static_assert(disassemble(encode<opcode::mov_reg_mem>({reg::r5, 0xbeef})).operands[1].value == 0xbeef);
+static_assert(disassemble(encode<opcode::add_reg_reg>({reg::r1, reg::r2})).operands[1].value == u16(reg::r2));
+static_assert(disassemble(encode<opcode::rti>()).count == 0);
+static_assert(disassemble(encode<opcode::pshuf_reg_reg_lit>({reg::r1, reg::r2, 0b1001})).operands[2].value == 0b1001);
+static_assert(disassemble(encode<opcode::trap_lit>({0x0102})).operands[0].value == 0x0102);
+static_assert(valid(encode<opcode::pshuf_reg_reg_lit>({reg::r7, reg::pc, 0xff})));
+static_assert(!valid(instr(opcode::mov_lit_reg, 0x34, 0x12, 0xf0)));
+
+} // namespace vm::isa
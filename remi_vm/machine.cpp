@@ -0,0 +1,595 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <bit>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+#include "./isa.hpp"
+#include "./machine.hpp"
+#include "./state_hash.hpp"
+#include "./debug_server.hpp"
+#include "./introspection.hpp"
+#include "./rom_loader.hpp"
+
+namespace vm {
+
+machine::machine(): 
+    bus(cpu), 
+    interrupts(bus.add_mapper(dev::interrupt_controller())), 
+    timer(bus.add_mapper(dev::timer(scheduler))),
+    framebuffer(bus.add_mapper(dev::framebuffer(scheduler))),
+    sound(bus.add_mapper(dev::sound(scheduler, bus))),
+    dma(bus.add_mapper(dev::dma(scheduler, bus))),
+    core_control(bus.add_mapper(dev::core_control())),
+    perf(bus.add_mapper(dev::perf_counters(scheduler, bus, cpu, instructions))),
+    ppu(bus.add_mapper(dev::ppu(scheduler, framebuffer))),
+    cartridge(bus.add_mapper(dev::cartridge(bus.memory()))),
+    watchpoints(bus.memory(), stop_requested) {
+    core_control.attach(cores.data(), cores_used);
+}
+
+machine::~machine() {
+    wait_for_workers();
+}
+
+// Regions asking for a random bank (65535) go into the first one, since there's nothing to pick it yet
+static u16 region_bank(const rom_region& region) {
+    return region.bank == 0xffff ? 0 : region.bank;
+}
+
+void machine::load(loaded_rom& rom) {
+    // Start from power-on memory, so nothing from a previous ROM survives
+    boot_image = {};
+    // Mapping an image replaces the protected pages
+    watchpoints.disarm();
+    bus.memory().map_image(nullptr);
+    watchpoints.arm();
+    reset();
+
+    // The first cartridge region goes in the cartridge slot, the others stay in the file
+    cartridge.eject();
+    bus.update_claims();
+    for (auto& [id, region] : rom.regions) {
+        if (region.is_cartridge()) {
+            if (!cartridge.inserted()) {
+                [[maybe_unused]] bool ok = cartridge.insert(rom.path.c_str(), region.rom_offset, region.size);
+                assert(ok && "Can't map the cartridge");
+                bus.update_claims();
+            }
+            continue;
+        }
+        load_region(region, rom.get_region(id));
+    }
+
+    // The main region is the entry point
+    if (auto main = rom.regions.find(0); main != rom.regions.end()) {
+        const rom_region& region = main->second;
+        cpu.set(reg::pc, region.loadat);
+        if (u32(region.loadat) + region.size > 0x8000) {
+            cpu.set(reg::mb, region_bank(region) % dev::memory::bank_count);
+        }
+    }
+
+    boot(capture());
+}
+
+void machine::load_region(const rom_region& region, std::span<const u8> data) {
+    auto& memory = bus.memory();
+    u16 bank = region_bank(region);
+    usize size = std::min<usize>(data.size(), 0x10000 - region.loadat);
+
+    // The low half and the high half of the bank are separate, so they're written separately
+    watchpoints.disarm();
+    usize done = 0;
+    while (done < size) {
+        u16 addr = u16(region.loadat + done);
+        usize chunk = std::min<usize>(size - done, 0x8000 - addr % 0x8000);
+        memcpy(memory.bank_write(bank, addr, u16(chunk)), data.data() + done, chunk);
+        done += chunk;
+    }
+    watchpoints.arm();
+}
+
+decoded_instr machine::fetch_decoded(const sakuya16c& core, decode_cache& cache) {
+    constexpr usize page_size = dev::memory::page_size;
+    u16 pc = core.reg(reg::pc);
+
+    if (pc % page_size <= page_size - sizeof(instr) && bus.plain_memory(pc)) [[likely]] {
+        return *cache.fetch(bus.memory(), dev::memory::page_of(core.reg(reg::mb), pc), pc % page_size);
+    }
+
+    // Code in devices, or straddling two pages, is read byte by byte like any other access
+    u8 bytes[sizeof(instr)];
+    for (usize i = 0; i < sizeof(instr); i++) {
+        bytes[i] = bus.read(u16(pc + i));
+    }
+    u32 raw;
+    memcpy(&raw, bytes, sizeof(raw));
+    return decode(instr(raw));
+}
+
+instr machine::run_instruction() {
+    // All interrupt state is folded into a single flag, so this is the only cost of interrupts when none are
+    // pending
+    if (cpu.status.pending) [[unlikely]] {
+        service_interrupt();
+        if (faulted) {
+            return instr(opcode::hlt);
+        }
+    }
+
+    u16 pc = cpu.reg(reg::pc);
+    decoded_instr next_instr = fetch_decoded(cpu, code);
+    if (next_instr.instr.op != opcode::hlt) {
+        if (coverage) [[unlikely]] {
+            // Shifting the previous address keeps A -> B and B -> A apart
+            coverage[u16(pc ^ previous_location)]++;
+            previous_location = pc >> 1;
+        }
+
+        // Program counter always increments by 4, before executing so instructions can jump
+        cpu.set(reg::pc, pc + 4);
+        // Execute
+        vm::execute(cpu, bus, next_instr);
+
+        scheduler.cycles += isa::cycles(next_instr.instr.op);
+        if (cpu.stall) [[unlikely]] {
+            scheduler.cycles += cpu.stall;
+            cpu.stall = 0;
+        }
+        instructions++;
+        if (instructions == hook_at) [[unlikely]] {
+            hook_at = hook->on_instruction(*this);
+        }
+    }
+
+    return next_instr.instr;
+}
+
+instr machine::step() {
+    instr executed = run_instruction();
+    if (scheduler.cycles >= scheduler.deadline()) {
+        scheduler.run_due();
+    }
+    if (stop_requested) [[unlikely]] {
+        if (watchpoints.handle_stop() && stop_requested == vm::watchpoints::STOP_BIT) {
+            stop_requested = 0;
+        }
+    }
+    return executed;
+}
+
+void machine::execute() {
+    executing = true;
+    // Writes to unwatched bytes of watched pages stop the machine too, and it just goes on, unless something else
+    // asked it to stop in the meantime
+    bool only_watchpoints;
+    do {
+        run_until_stopped();
+        u8 reasons = std::atomic_ref(stop_requested).load(std::memory_order_relaxed);
+        only_watchpoints = reasons == vm::watchpoints::STOP_BIT;
+    } while (watchpoints.handle_stop() && only_watchpoints);
+    executing = false;
+    // Worker threads may still be finishing the quantum, but nothing else touches the machine after this
+    wait_for_workers();
+}
+
+void machine::run_until_stopped() {
+    stop_requested = false;
+    while (!stop_requested) {
+        // Events can only be scheduled earlier by the instructions themselves (through device writes), and the
+        // deadline is re-read every time, so this never overshoots an event by more than one instruction
+        while (scheduler.cycles < scheduler.deadline()) {
+            if (compiled) {
+                if (run_compiled() == control_flow::halt) {
+                    return;
+                }
+                if (scheduler.cycles >= scheduler.deadline()) {
+                    break;
+                }
+            }
+            // Whatever made compiled code yield is handled by the interpreter for one instruction
+            if (run_instruction().op == opcode::hlt || stop_requested) {
+                return;
+            }
+        }
+        scheduler.run_due();
+    }
+}
+
+control_flow machine::run_compiled() {
+    // Whatever wrote over the compiled code keeps running in the interpreter until the next reset
+    if (compiled_code_written()) [[unlikely]] {
+        compiled = false;
+        return control_flow::ok;
+    }
+    // Code in the high half only matches one bank
+    const aot_module& module = *compiled_module;
+    if (u32(module.code_addr) + module.code_size > 0x8000
+        && cpu.reg(reg::mb) % dev::memory::bank_count != module.code_bank % dev::memory::bank_count) {
+        return control_flow::ok;
+    }
+
+    aot_context ctx = {cpu, bus, scheduler, instructions, hook_at};
+    return module.run(ctx);
+}
+
+bool machine::compiled_code_written() const {
+    constexpr usize page_size = dev::memory::page_size;
+    const auto& memory = bus.memory();
+    const aot_module& module = *compiled_module;
+    usize last = (module.code_addr + module.code_size - 1) / page_size;
+    for (usize page = module.code_addr / page_size; page <= last; page++) {
+        if (memory.written_since(dev::memory::page_of(module.code_bank, u16(page * page_size)), compiled_mark)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void machine::validate_compiled() {
+    compiled = false;
+    if (!compiled_module) {
+        return;
+    }
+    const aot_module& module = *compiled_module;
+    if (module.code_size == 0 || u32(module.code_addr) + module.code_size > 0x10000) {
+        return;
+    }
+
+    // Gather the code from both halves if it crosses into the high half
+    const auto& memory = bus.memory();
+    std::vector<u8> code(module.code_size);
+    u32 low = module.code_addr < 0x8000 ? std::min<u32>(module.code_size, 0x8000 - module.code_addr) : 0;
+    if (low > 0) {
+        memcpy(code.data(), memory.bank_read(0, module.code_addr, u16(low)), low);
+    }
+    if (module.code_size > low) {
+        u32 high = module.code_size - low;
+        memcpy(code.data() + low, memory.bank_read(module.code_bank, u16(module.code_addr + low), u16(high)), high);
+    }
+
+    compiled_mark = bus.memory().mark_epoch();
+    compiled = hash_bytes(code.data(), code.size()) == module.code_hash;
+}
+
+void machine::set_cores(usize count, core_mode mode) {
+    assert(count >= 1 && count <= MAX_CORES);
+    wait_for_workers();
+
+    cores_used = count;
+    this->mode = mode;
+    core_control.attach(cores.data(), count);
+
+    workers.clear();
+    if (mode == core_mode::parallel) {
+        for (usize i = 0; i + 1 < count; i++) {
+            workers.push_back(std::make_unique<core_worker>());
+        }
+    }
+    reset();
+}
+
+void machine::schedule_quantum() {
+    if (cores_used > 1) {
+        quantum_end = scheduler.cycles + std::max<u64>(quantum, 1);
+        quantum_event = scheduler.schedule(quantum_end, on_quantum, this);
+    }
+}
+
+void machine::on_quantum(void* user, u64 now) {
+    static_cast<machine*>(user)->end_quantum();
+}
+
+void machine::end_quantum() {
+    wait_for_workers();
+
+    // Catch up in core order, so the interleaving only depends on the program. In parallel mode this only runs
+    // the cores that stopped at something the worker threads can't do.
+    for (usize i = 0; i + 1 < cores_used; i++) {
+        if (cores[i].running) {
+            run_core(cores[i], quantum_end);
+        }
+    }
+
+    for (usize i = 0; i + 1 < cores_used; i++) {
+        core& target = cores[i];
+        u16 entry;
+        switch (core_control.take_request(i, entry)) {
+        case dev::core_control::request::start:
+            target.cpu.reset();
+            target.cpu.set(reg::pc, entry);
+            target.cycles = quantum_end;
+            target.instructions = 0;
+            target.running = true;
+            break;
+        case dev::core_control::request::stop:
+            target.running = false;
+            break;
+        case dev::core_control::request::none:
+            break;
+        }
+    }
+
+    schedule_quantum();
+
+    // The boot core only runs alongside the workers from execute(), which waits for them before returning
+    if (mode == core_mode::parallel && executing) {
+        workers_mark = bus.memory().mark_epoch();
+        bus.memory().begin_sharing(on_contended, this);
+        for (usize i = 0; i + 1 < cores_used; i++) {
+            if (cores[i].running) {
+                jobs[i] = {this, &cores[i], i + 1, quantum_end};
+                workers[i]->post(run_core_parallel, &jobs[i]);
+            }
+        }
+        workers_busy = true;
+    }
+}
+
+void machine::run_core(core& target, u64 until) {
+    target.needs_machine_thread = false;
+    bus.memory().bind(target.cpu);
+
+    // The bus and the devices raise faults on the boot core. Its own are put aside while this core runs, so any
+    // that show up were caused by this core's accesses and are moved over to it.
+    u16 boot_faults = cpu.status.raised & FAULT_INTERRUPTS;
+    cpu.status.raised &= u16(~FAULT_INTERRUPTS);
+
+    while (target.running && target.cycles < until) {
+        decoded_instr next_instr = fetch_decoded(target.cpu, target.code);
+        if (next_instr.instr.op == opcode::hlt) {
+            target.running = false;
+            break;
+        }
+        target.cpu.set(reg::pc, target.cpu.reg(reg::pc) + 4);
+        vm::execute(target.cpu, bus, next_instr);
+        target.cycles += isa::cycles(next_instr.instr.op) + target.cpu.stall;
+        target.cpu.stall = 0;
+        target.instructions++;
+
+        if (u16 faults = cpu.status.raised & FAULT_INTERRUPTS) [[unlikely]] {
+            cpu.status.raised &= u16(~faults);
+            target.cpu.status.raised |= faults;
+            target.cpu.update_pending();
+        }
+        if (target.cpu.status.raised & FAULT_INTERRUPTS) {
+            target.running = false;
+        }
+    }
+
+    cpu.status.raised |= boot_faults;
+    cpu.update_pending();
+    bus.memory().bind(cpu);
+}
+
+// Whether a 16bit access at `addr` only touches plain memory, in the same half
+static bool plain_word(const vm::bus& bus, u16 addr) {
+    return addr % 0x8000 != 0x7fff && bus.plain_memory(addr) && bus.plain_memory(u16(addr + 1));
+}
+
+void machine::run_core_parallel(void* user) {
+    auto& job = *static_cast<parallel_job*>(user);
+    core& target = *job.target;
+    vm::bus& bus = job.owner->bus;
+    dev::memory& memory = bus.memory();
+    constexpr usize page_size = dev::memory::page_size;
+
+    // Only instructions that touch nothing but registers and plain memory run here. Memory is accessed through
+    // the core's own bank, since the memory device follows the boot core, and only in pages no other core claimed
+    // this quantum.
+    while (target.running && target.cycles < job.until) {
+        u16 pc = target.cpu.reg(reg::pc);
+        u16 mb = target.cpu.reg(reg::mb);
+        if (pc % page_size > page_size - sizeof(instr) || !bus.plain_memory(pc)) {
+            target.needs_machine_thread = true;
+            return;
+        }
+        usize page = dev::memory::page_of(mb, pc);
+        const decoded_instr* fetched = target.code.fetch(memory, page, pc % page_size, job.index);
+        if (!fetched) {
+            target.needs_machine_thread = true;
+            return;
+        }
+        decoded_instr next_instr = *fetched;
+        instr ins = next_instr.instr;
+        // The cases below trust the register operands, faults are raised from the machine thread
+        if (!isa::valid(ins)) [[unlikely]] {
+            target.needs_machine_thread = true;
+            return;
+        }
+
+        switch (ins.op) {
+        case opcode::hlt:
+            target.running = false;
+            return;
+        case opcode::nop:
+        case opcode::mov_lit_reg:
+        case opcode::mov_reg_reg:
+        case opcode::add_reg_reg:
+        case opcode::paddus_reg_reg:
+        case opcode::psubus_reg_reg:
+        case opcode::pminu_reg_reg:
+        case opcode::pmaxu_reg_reg:
+        case opcode::pcmpeq_reg_reg:
+        case opcode::pshuf_reg_reg_lit:
+            target.cpu.set(reg::pc, pc + 4);
+            vm::execute(target.cpu, bus, next_instr);
+            break;
+        case opcode::mov_reg_mem: {
+            auto ops = isa::operands_for<opcode::mov_reg_mem>::decode(ins);
+            u8* dst = plain_word(bus, ops.lit) ? memory.core_write(job.index, mb, ops.lit, 2) : nullptr;
+            if (!dst) {
+                target.needs_machine_thread = true;
+                return;
+            }
+            target.cpu.set(reg::pc, pc + 4);
+            word val = target.cpu.reg(ops.reg);
+            dst[0] = val.lo;
+            dst[1] = val.hi;
+            break;
+        }
+        case opcode::mov_mem_reg: {
+            auto ops = isa::operands_for<opcode::mov_mem_reg>::decode(ins);
+            const u8* src = plain_word(bus, ops.lit) ? memory.core_read(job.index, mb, ops.lit, 2) : nullptr;
+            if (!src) {
+                target.needs_machine_thread = true;
+                return;
+            }
+            target.cpu.set(reg::pc, pc + 4);
+            target.cpu.set(ops.reg, word(src[0], src[1]).val);
+            break;
+        }
+        default:
+            target.needs_machine_thread = true;
+            return;
+        }
+
+        target.cycles += isa::cycles(ins.op);
+        target.instructions++;
+    }
+}
+
+void machine::wait_for_workers() {
+    if (!workers_busy) {
+        return;
+    }
+    for (auto& worker : workers) {
+        worker->wait();
+    }
+    workers_busy = false;
+    bus.memory().end_sharing();
+    bus.memory().settle_writes(workers_mark);
+}
+
+void machine::on_contended(void* user) {
+    static_cast<machine*>(user)->wait_for_workers();
+}
+
+void machine::service_interrupt() {
+    // Only called with something pending, but countr_zero(0) would index past the vectors
+    if (cpu.status.pending == 0) [[unlikely]] {
+        return;
+    }
+
+    // Lower lines have higher priority, so faults always go first
+    auto line = static_cast<interrupt>(std::countr_zero(cpu.status.pending));
+    u16 handler = interrupts.vector(line);
+    if (handler == 0) {
+        if (u16(1 << u8(line)) & FAULT_INTERRUPTS) {
+            // The fault is left raised, so the machine keeps refusing to run until it's reset
+            faulted = true;
+            stop_requested = true;
+        } else {
+            // Nobody is listening, drop it
+            cpu.acknowledge(line);
+        }
+        return;
+    }
+
+    cpu.acknowledge(line);
+
+    // Push pc and im, and mask every interrupt while the handler runs
+    u16 sp = cpu.reg(reg::sp);
+    bus.write16(sp - 2, cpu.reg(reg::pc));
+    bus.write16(sp - 4, cpu.reg(reg::im));
+    cpu.set(reg::sp, sp - 4);
+    cpu.set(reg::im, 0);
+    cpu.set(reg::pc, handler);
+}
+
+void machine::reset() {
+    wait_for_workers();
+    for (auto& secondary : cores) {
+        secondary.running = false;
+        secondary.cycles = 0;
+        secondary.instructions = 0;
+    }
+
+    cpu.reset();
+    scheduler.reset();
+    // Restoring memory isn't a write by the program
+    watchpoints.disarm();
+    bus.reset();
+    watchpoints.arm();
+    instructions = 0;
+    previous_location = 0;
+    stop_requested = 0;
+    faulted = false;
+
+    // Memory was already restored by the bus. Machines that weren't booted start at address 0.
+    if (boot_image.memory) {
+        cpu = boot_image.cpu;
+    }
+    validate_compiled();
+
+    // The scheduler dropped every event
+    schedule_quantum();
+    if (debugger) {
+        debugger->rearm();
+    }
+    if (published) {
+        published->rearm();
+    }
+    // The instruction count started over, so the hook's next call has to be asked for again
+    if (hook) {
+        hook_at = hook->on_instruction(*this);
+    }
+}
+
+machine_image machine::capture() const {
+    return {cpu, bus.memory().capture()};
+}
+
+void machine::boot(const machine_image& image) {
+    boot_image = image;
+    watchpoints.disarm();
+    bus.memory().map_image(image.memory);
+    watchpoints.arm();
+    reset();
+}
+
+void machine::input(u16 addr, u8 val) {
+    bus.write(addr, val);
+    if (hook) {
+        hook->on_input(*this, addr, val);
+    }
+}
+
+bool machine::attach_compiled(const aot_module* module) {
+    compiled_module = nullptr;
+    compiled = false;
+    if (!module) {
+        return true;
+    }
+    if (module->abi_version != AOT_ABI_VERSION) {
+        return false;
+    }
+    compiled_module = module;
+    validate_compiled();
+    if (!compiled) {
+        compiled_module = nullptr;
+    }
+    return compiled;
+}
+
+void machine::attach(machine_hook* hook) {
+    this->hook = hook;
+    hook_at = hook ? hook->on_instruction(*this) : UINT64_MAX;
+}
+
+} // namespace vm
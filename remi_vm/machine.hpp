@@ -0,0 +1,251 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <span>
+#include <array>
+#include <vector>
+#include <memory>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./interrupts.hpp"
+#include "./scheduler.hpp"
+#include "./timer.hpp"
+#include "./video.hpp"
+#include "./audio.hpp"
+#include "./dma.hpp"
+#include "./perf.hpp"
+#include "./ppu.hpp"
+#include "./cartridge.hpp"
+#include "./aot.hpp"
+#include "./decode_cache.hpp"
+#include "./cores.hpp"
+#include "./watchpoints.hpp"
+
+namespace vm {
+
+class machine;
+class debug_server;
+class introspection;
+struct loaded_rom;
+struct rom_region;
+
+// Something that wants to run at specific instruction counts, such as a replay recorder or player.
+//
+// This keeps the per-instruction cost of the machine down to a single comparison against `hook_at`.
+class machine_hook {
+public:
+    virtual ~machine_hook() = default;
+
+    // Called once when attached, and then every time the machine reaches the instruction count returned by the
+    // previous call. Returns the next instruction count at which it wants to be called again.
+    virtual u64 on_instruction(machine& machine) = 0;
+    // Called when an external input is fed into the machine through machine::input().
+    virtual void on_input(machine& machine, u16 addr, u8 val) {}
+};
+
+// Size of a coverage bitmap. Each executed pair of consecutive instruction addresses bumps one counter.
+constexpr usize COVERAGE_SIZE = 0x10000;
+
+// State of a booted machine that new machines can start from (see machine::boot()).
+//
+// Memory is shared copy-on-write between every machine booted from the same image, so starting one costs
+// nothing until it writes to memory. Devices aren't part of the image, they start from their reset state.
+struct machine_image {
+    sakuya16c cpu;
+    std::shared_ptr<const memory_image> memory;
+};
+
+// A complete remi16 console: the sakuya16c CPU, the bus it's attached to and the bookkeeping needed to run
+// programs on it.
+//
+// The bus keeps a reference to the CPU, so machines can't be moved or copied.
+class machine {
+public:
+    sakuya16c cpu;
+    // Owns the CPU clock (`scheduler.cycles`) and every timed event of the console
+    vm::scheduler scheduler;
+    vm::bus bus;
+    dev::interrupt_controller& interrupts;
+    dev::timer& timer;
+    dev::framebuffer& framebuffer;
+    dev::sound& sound;
+    dev::dma& dma;
+    dev::core_control& core_control;
+    dev::perf_counters& perf;
+    dev::ppu& ppu;
+    dev::cartridge& cartridge;
+    // Write watchpoints on memory. A watched write stops the machine, see watchpoints::take_hit().
+    vm::watchpoints watchpoints;
+
+    // Secondary cores (core 1 onwards, `cpu` is core 0). Only the first core_count() - 1 are used.
+    std::array<core, MAX_CORES - 1> cores;
+    // Machine cycles each core runs before the next one gets its turn. Changes apply from the next quantum.
+    u64 quantum = 1000;
+
+    // Number of instructions executed since the last reset
+    u64 instructions = 0;
+
+    // Set when something outside the program (like a failed replay) wants execution to stop. Anything can set it to
+    // true, but the watchpoints set their own bit (watchpoints::STOP_BIT), so the machine can tell when they were
+    // the only reason and go on.
+    u8 stop_requested = 0;
+    // Set when a fault was raised with no handler installed. The machine can't continue until it's reset.
+    bool faulted = false;
+
+    machine();
+    ~machine();
+    machine(const machine&) = delete;
+    machine& operator=(const machine&) = delete;
+
+    // Loads every region of a ROM into memory at its address and bank, and boots from it with the program counter
+    // at the main region. Resets go back to this state.
+    void load(loaded_rom& rom);
+    // Writes the data of a region into memory at its address and bank, as the machine is now. Resets still go
+    // back to what load() loaded. Regions that don't fit in the address space are cut short.
+    void load_region(const rom_region& region, std::span<const u8> data);
+
+    // Returns the instruction at the program counter, read through the bus like the CPU does.
+    instr fetch() { return fetch_decoded(cpu, code).instr; }
+    // Services pending interrupts, then fetches and executes a single instruction, runs any scheduler events
+    // that became due, and returns the instruction.
+    //
+    // If the machine faulted, HLT is returned instead since it can't run any further.
+    instr step();
+    // Executes until a HLT instruction is encountered or a stop is requested.
+    //
+    // Execution runs straight up to the next scheduler deadline, runs the events that are due and continues, so
+    // devices are never polled between instructions.
+    void execute();
+
+    // Resets the CPU and every device on the bus. Machines started with boot() go back to their image.
+    void reset();
+
+    // Sets the number of cores (1 to MAX_CORES, counting the boot core) and how they're run, and resets the
+    // machine. Secondary cores start stopped, and are started by the program through the core controller.
+    void set_cores(usize count, core_mode mode = core_mode::deterministic);
+    usize core_count() const { return cores_used; }
+
+    // Captures the CPU and memory, so that any number of machines can be started from this point. Secondary cores
+    // aren't captured: they're stopped in machines started from the image.
+    machine_image capture() const;
+    // Starts the machine from an image captured from another machine running the same program.
+    void boot(const machine_image& image);
+
+    // Feeds an external input (a byte written by the host into a device) into the machine.
+    // All host inputs must go through here so that they can be recorded and replayed.
+    void input(u16 addr, u8 val);
+
+    // Uses code compiled ahead of time by remi_recompiler (nullptr to detach). Returns false, and keeps using the
+    // interpreter, if the module was built for another ABI version or the code it was compiled from isn't in
+    // memory.
+    //
+    // Compiled code stops being used as soon as anything writes to the memory it was compiled from, and is used
+    // again after a reset restores it.
+    bool attach_compiled(const aot_module* module);
+
+    // Starts recording edge coverage into a bitmap of COVERAGE_SIZE hit counters (nullptr to stop). The machine
+    // doesn't take ownership. Compiled code doesn't record coverage.
+    void attach_coverage(u8* bitmap) { coverage = bitmap; }
+
+    // Lets a debug server keep its events scheduled across resets. Called by the debug server itself.
+    void attach_debugger(debug_server* server) { debugger = server; }
+    // Same for an introspection segment. Called by the segment itself.
+    void attach_introspection(introspection* segment) { published = segment; }
+
+    // Attaches a hook (nullptr to detach). The machine doesn't take ownership.
+    void attach(machine_hook* hook);
+    machine_hook* attached_hook() const { return hook; }
+
+private:
+    // Fetches the instruction at the program counter of a core, through its decode cache when the program counter
+    // is in plain memory. The memory must be bound to the core.
+    decoded_instr fetch_decoded(const sakuya16c& core, decode_cache& cache);
+    // Executes a single instruction without running scheduler events.
+    instr run_instruction();
+    // Jumps to the handler of the highest priority pending interrupt.
+    void service_interrupt();
+    // Runs compiled code until it has to yield back to the interpreter.
+    control_flow run_compiled();
+    // Runs the loop of execute().
+    void run_until_stopped();
+
+    // Schedules the end of the next quantum, if there are secondary cores.
+    void schedule_quantum();
+    static void on_quantum(void* user, u64 now);
+    // Brings every secondary core up to the end of the quantum, applies core controller requests, and hands the
+    // next quantum to the worker threads in parallel mode.
+    void end_quantum();
+    // Runs a secondary core on the machine thread until it reaches `until` cycles or stops.
+    void run_core(core& core, u64 until);
+    // Runs a secondary core on its worker thread, until it reaches the end of the quantum or something that
+    // must run on the machine thread.
+    static void run_core_parallel(void* user);
+    // Waits until no worker thread is running a core.
+    void wait_for_workers();
+    // Called when the boot core needs a memory page a worker thread claimed (see dev::memory::begin_sharing())
+    static void on_contended(void* user);
+
+    // Enables compiled code if the memory it was compiled from holds the same code again.
+    void validate_compiled();
+    // Whether the memory compiled code was built from has been written since it was validated.
+    bool compiled_code_written() const;
+
+    machine_hook* hook = nullptr;
+    // Instruction count at which the hook must run next
+    u64 hook_at = UINT64_MAX;
+
+    // Attached module, and whether its code is still the one in memory
+    const aot_module* compiled_module = nullptr;
+    bool compiled = false;
+    // Epoch mark taken when the compiled code was last validated
+    u64 compiled_mark = 0;
+
+    decode_cache code;
+
+    usize cores_used = 1;
+    core_mode mode = core_mode::deterministic;
+    event_handle quantum_event;
+    // Machine cycle the current quantum ends at
+    u64 quantum_end = 0;
+    // Parallel mode only, one per secondary core
+    std::vector<std::unique_ptr<core_worker>> workers;
+    struct parallel_job {
+        machine* owner;
+        core* target;
+        // Core number the target claims memory pages as (the boot core is 0)
+        usize index;
+        u64 until;
+    };
+    std::array<parallel_job, MAX_CORES - 1> jobs = {};
+    // Set while execute() runs, since that's the only time worker threads can run alongside the boot core
+    bool executing = false;
+    bool workers_busy = false;
+    // Epoch mark taken before the workers started, to settle their writes once they stop
+    u64 workers_mark = 0;
+
+    debug_server* debugger = nullptr;
+    introspection* published = nullptr;
+
+    u8* coverage = nullptr;
+    // Hashed address of the previous instruction, for edge coverage
+    u16 previous_location = 0;
+
+    // Image reset() goes back to (no memory image means power-on state)
+    machine_image boot_image = {};
+};
+
+} // namespace vm
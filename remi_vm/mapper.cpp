@@ -14,7 +14,9 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "./mapper.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace vm {
 
@@ -29,8 +31,7 @@ u16 mapper_device::read16(u16 addr) const {
         range_start = 0;
     }
     if (addr == 0xffff) {
-        // TODO out of range interrupt
-        assert(false && "out of range");
+        raise(interrupt::bus_fault);
         return u16(b1);
     }
 
@@ -40,8 +41,8 @@ u16 mapper_device::read16(u16 addr) const {
         u8 b2 = read(b2_addr);
         return word(b1, b2).val;
     } else {
-        // TODO out of range interrupt
-        assert(false && "byte 2 address out of device range");
+        // byte 2 address out of device range
+        raise(interrupt::bus_fault);
         return u16(b1);
     }
 }
@@ -58,8 +59,7 @@ void mapper_device::write16(u16 addr, u16 val) {
         range_start = 0;
     }
     if (addr == 0xffff) {
-        // TODO out of range interrupt
-        assert(false && "out of range");
+        raise(interrupt::bus_fault);
         return;
     }
 
@@ -68,8 +68,8 @@ void mapper_device::write16(u16 addr, u16 val) {
     if (b2_addr >= range_start && b2_addr <= range_end) {
         write(b2_addr, word_val.hi);
     } else {
-        // TODO out of range interrupt
-        assert(false && "byte 2 address out of device range");
+        // byte 2 address out of device range
+        raise(interrupt::bus_fault);
         return;
     }
 }
@@ -81,9 +81,8 @@ void mapper_device::read_region(u16 addr, u16 size, u8* ptr) const {
         range_end = range_end - range_start;
         range_start = 0;
     }
-    if (addr < range_start || addr + size > range_end) {
-        // TODO out of range interrupt
-        assert(false && "out of range");
+    if (addr < range_start || u32(addr) + size > u32(range_end) + 1) {
+        raise(interrupt::bus_fault);
         return;
     }
 
@@ -99,9 +98,8 @@ void mapper_device::write_region(u16 addr, std::span<u8> data) {
         range_end = range_end - range_start;
         range_start = 0;
     }
-    if (addr <= range_start || addr + data.size() >= range_end) {
-        // TODO out of range interrupt
-        assert(false && "out of range");
+    if (addr < range_start || addr + data.size() > usize(range_end) + 1) {
+        raise(interrupt::bus_fault);
         return;
     }
 
@@ -118,10 +116,11 @@ std::unique_ptr<mapper_device>& bus::find_mapper_for(u16 addr) {
         return mappers[0];
     }
 
-    for (auto& mapper : mappers) {
-        auto [range_start, range_end] = mapper->range();
+    // Search backwards, so devices take priority over the memory mapper (which covers the whole address space)
+    for (auto it = mappers.rbegin(); it != mappers.rend(); it++) {
+        auto [range_start, range_end] = (*it)->range();
         if (addr >= range_start && addr <= range_end) {
-            return mapper;
+            return *it;
         }
     }
 
@@ -138,10 +137,11 @@ const std::unique_ptr<mapper_device>& bus::find_mapper_for(u16 addr) const {
         return mappers[0];
     }
 
-    for (auto& mapper : mappers) {
-        auto [range_start, range_end] = mapper->range();
+    // Search backwards, so devices take priority over the memory mapper (which covers the whole address space)
+    for (auto it = mappers.rbegin(); it != mappers.rend(); it++) {
+        auto [range_start, range_end] = (*it)->range();
         if (addr >= range_start && addr <= range_end) {
-            return mapper;
+            return *it;
         }
     }
 
@@ -149,65 +149,215 @@ const std::unique_ptr<mapper_device>& bus::find_mapper_for(u16 addr) const {
     return mappers[0];
 }
 
+// Converts a bus address to the address a device expects
+static u16 device_addr(const mapper_device& mapper, u16 addr) {
+    return mapper.remap_range() ? u16(addr - mapper.range().first) : addr;
+}
+
+u8 bus::read(u16 addr) const {
+    accesses++;
+    // Plain memory skips the mapper search, and the memory mapper is final so the call isn't virtual
+    if (plain_memory(addr)) [[likely]] {
+        return memory().read(addr);
+    }
+    auto& mapper = find_mapper_for(addr);
+    return mapper->read(device_addr(*mapper, addr));
+}
+
+void bus::write(u16 addr, u8 val) {
+    accesses++;
+    if (plain_memory(addr)) [[likely]] {
+        memory().write(addr, val);
+        return;
+    }
+    auto& mapper = find_mapper_for(addr);
+    mapper->write(device_addr(*mapper, addr), val);
+}
+
+u16 bus::read16(u16 addr) const {
+    accesses++;
+    if (plain_memory(addr)) [[likely]] {
+        return memory().read16(addr);
+    }
+    auto& mapper = find_mapper_for(addr);
+    return mapper->read16(device_addr(*mapper, addr));
+}
+
+void bus::write16(u16 addr, u16 val) {
+    accesses++;
+    if (plain_memory(addr)) [[likely]] {
+        memory().write16(addr, val);
+        return;
+    }
+    auto& mapper = find_mapper_for(addr);
+    mapper->write16(device_addr(*mapper, addr), val);
+}
+
+void bus::claim_pages(const mapper_device& mapper) {
+    // The memory mapper is the first one, and covers everything
+    if (mappers.size() == 1 || !mapper.claims_range()) {
+        return;
+    }
+    auto [range_start, range_end] = mapper.range();
+    for (usize page = range_start >> 8; page <= usize(range_end >> 8); page++) {
+        device_pages[page / 64] |= u64(1) << (page % 64);
+    }
+}
+
+void bus::update_claims() {
+    std::fill(std::begin(device_pages), std::end(device_pages), 0);
+    for (usize i = 1; i < mappers.size(); i++) {
+        claim_pages(*mappers[i]);
+    }
+}
+
 void bus::reset() {
+    accesses = 0;
     for (auto& mapper : mappers) {
         mapper->reset();
     }
 }
 
 // Devices
-dev::memory::memory(const vm::sakuya16c& cpu): cpu(cpu) {
-    lh = std::unique_ptr<u8[]>(new u8[0x8000]);
+dev::memory::memory(const vm::sakuya16c& cpu): arena(0x8000 * (1 + bank_count)), cpu(&cpu) {
+    page_epochs = std::unique_ptr<u64[]>(new u64[page_count]);
+    page_users = std::unique_ptr<u8[]>(new u8[page_count]());
 
-    hh0 = std::unique_ptr<u8[]>(new u8[0x8000]);
-    hh1 = std::unique_ptr<u8[]>(new u8[0x8000]);
-    hh2 = std::unique_ptr<u8[]>(new u8[0x8000]);
-    hh3 = std::unique_ptr<u8[]>(new u8[0x8000]);
-
-    reset();
+    // The arena starts out zeroed, and every page counts as written for observers that haven't seen it yet
+    std::fill_n(page_epochs.get(), page_count, epoch);
+    reset_mark = mark_epoch();
 }
 
 void dev::memory::reset() {
-    // clear all arrays to 0
-    memset(lh.get(), 0, 0x8000);
-    memset(hh0.get(), 0, 0x8000);
-    memset(hh1.get(), 0, 0x8000);
-    memset(hh2.get(), 0, 0x8000);
-    memset(hh3.get(), 0, 0x8000);
+    // Restore runs of pages written since the last reset. They're marked as written again since their contents
+    // changed back.
+    usize page = 0;
+    while (page < page_count) {
+        if (!written_since(page, reset_mark)) {
+            page++;
+            continue;
+        }
+        usize first = page;
+        while (page < page_count && written_since(page, reset_mark)) {
+            page++;
+        }
+        arena.restore(first * page_size, (page - first) * page_size);
+        mark_written(first, page - 1);
+    }
+    reset_mark = mark_epoch();
 }
 
-u8 dev::memory::read(u16 addr) const { 
-    if (addr < 0x8000) {
-        return lh[addr];
+void dev::memory::map_image(std::shared_ptr<const memory_image> image) {
+    arena.map(std::move(image));
+    // Everything changed, so every page counts as written in the current epoch
+    std::fill_n(page_epochs.get(), page_count, epoch);
+    reset_mark = mark_epoch();
+}
+
+void dev::memory::mark_written(usize first_page, usize last_page) {
+    for (usize page = first_page; page <= last_page; page++) {
+        set_page_epoch(page);
     }
+}
 
-    u16 mb = cpu.reg(reg::mb) % 4; // 4 is the number of memory banks
-    switch (mb) {
-    case 0: return hh0[addr - 0x8000];
-    case 1: return hh1[addr - 0x8000];
-    case 2: return hh2[addr - 0x8000];
-    case 3: return hh3[addr - 0x8000];
-    default: 
-        assert(false && "unreachable");
-        return 0;
+void dev::memory::settle_writes(u64 mark) {
+    for (usize page = 0; page < page_count; page++) {
+        if (written_since(page, mark)) {
+            set_page_epoch(page);
+        }
     }
 }
 
-void dev::memory::write(u16 addr, u8 val) {
-    if (addr <= 0x8000) {
-        lh[addr] = val;
-        return;
+void dev::memory::begin_sharing(void (*contended)(void* user), void* user) {
+    // Nobody else is running yet, so the claims of the previous quantum can be dropped
+    memset(page_users.get(), 0, page_count);
+    this->contended = contended;
+    contended_user = user;
+    sharing = true;
+}
+
+void dev::memory::claim_for_boot_contended(usize first_page, usize last_page, bool write) const {
+    for (usize page = first_page; page <= last_page; page++) {
+        if (!claim(page, 0, write)) {
+            contended(contended_user);
+            assert(!sharing);
+            return;
+        }
+    }
+}
+
+u8 dev::memory::read_shared(u16 addr) const {
+    usize offset = host_offset(cpu->reg(reg::mb), addr);
+    claim_for_boot_contended(offset / page_size, offset / page_size, false);
+    return arena.data()[offset];
+}
+
+void dev::memory::write_shared(u16 addr, u8 val) {
+    usize offset = host_offset(cpu->reg(reg::mb), addr);
+    claim_for_boot_contended(offset / page_size, offset / page_size, true);
+    set_page_epoch(offset / page_size);
+    arena.data()[offset] = val;
+}
+
+u8* dev::memory::locate(u16 bank, u16 addr, u16 size) const {
+    usize offset = addr % 0x8000;
+    if (size == 0 || offset + size > 0x8000) {
+        return nullptr;
+    }
+    return half(addr < 0x8000 ? 0 : 1 + bank % bank_count) + offset;
+}
+
+const u8* dev::memory::core_read(usize core, u16 bank, u16 addr, u16 size) {
+    u8* data = locate(bank, addr, size);
+    if (!data || !claim(page_of(bank, addr), core, false) || !claim(page_of(bank, u16(addr + size - 1)), core, false)) {
+        return nullptr;
     }
+    return data;
+}
 
-    u16 mb = cpu.reg(reg::mb) % 4; // 4 is the number of memory banks
-    switch (mb) {
-    case 0: hh0[addr - 0x8000] = val; break;
-    case 1: hh1[addr - 0x8000] = val; break;
-    case 2: hh2[addr - 0x8000] = val; break;
-    case 3: hh3[addr - 0x8000] = val; break;
-    default: 
-        assert(false && "unreachable");
+u8* dev::memory::core_write(usize core, u16 bank, u16 addr, u16 size) {
+    u8* data = locate(bank, addr, size);
+    usize first = page_of(bank, addr);
+    usize last = page_of(bank, u16(addr + size - 1));
+    if (!data || !claim(first, core, true) || !claim(last, core, true)) {
+        return nullptr;
     }
+    mark_written(first, last);
+    return data;
+}
+
+const u8* dev::memory::direct_read(u16 addr, u16 size) const {
+    return bank_read(cpu->reg(reg::mb) % bank_count, addr, size);
+}
+
+u8* dev::memory::direct_write(u16 addr, u16 size) {
+    return bank_write(cpu->reg(reg::mb) % bank_count, addr, size);
+}
+
+const u8* dev::memory::bank_read(u16 bank, u16 addr, u16 size) const {
+    u8* data = locate(bank, addr, size);
+    if (data) {
+        claim_for_boot(page_of(bank, addr), page_of(bank, u16(addr + size - 1)), false);
+    }
+    return data;
+}
+
+u8* dev::memory::bank_write(u16 bank, u16 addr, u16 size) {
+    u8* data = locate(bank, addr, size);
+    if (data) {
+        usize first = page_of(bank, addr);
+        usize last = page_of(bank, u16(addr + size - 1));
+        claim_for_boot(first, last, true);
+        mark_written(first, last);
+    }
+    return data;
+}
+
+std::span<const u8> dev::memory::page(usize page) const {
+    assert(page < page_count);
+    claim_for_boot(page, page, false);
+    usize offset = (page % pages_per_half) * page_size;
+    return {half(page / pages_per_half) + offset, page_size};
 }
 
 } // namespace vm
\ No newline at end of file
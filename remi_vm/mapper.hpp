@@ -18,17 +18,29 @@
 #include <vector>
 #include <span>
 #include <memory>
+#include <atomic>
+#include <cassert>
 
 #include "./vm.hpp"
+#include "./arena.hpp"
 
 namespace vm {
 
 class mapper_device {
+    friend class bus;
+    template<typename... Devices> friend class static_bus;
 public:
+    // The bus owns its devices through this base class
+    virtual ~mapper_device() = default;
+
     // Get device name
     virtual const char* name() const = 0;
     // At what memory address does this device start and end.
     virtual std::pair<u16, u16> range() const = 0;
+    // Whether the bus must send accesses to the range through the device. Devices that are sometimes absent (like
+    // an empty cartridge slot) return false meanwhile, so the range stays on the plain memory fast path. They must
+    // still forward anything that reaches them to memory. See bus::update_claims().
+    virtual bool claims_range() const { return true; }
     // If this returns true, the bus will call the device's read() and write() functions
     // with remapped adresses.
     //
@@ -51,23 +63,70 @@ public:
 
     void read_region(u16 addr, u16 size, u8* ptr) const;
     void write_region(u16 addr, std::span<u8> data);
+
+    // Direct access to the host memory backing [addr, addr + size), for bulk transfers. Returns nullptr if the
+    // range is not plain contiguous memory, in which case read() and write() must be used instead.
+    virtual const u8* direct_read(u16 addr, u16 size) const { return nullptr; }
+    // Same as direct_read(), but for writing. The device considers the whole range written.
+    virtual u8* direct_write(u16 addr, u16 size) { return nullptr; }
+
+protected:
+    // CPU that receives the interrupts raised by this device. Set by the bus when the device is added to it.
+    sakuya16c* irq_target = nullptr;
+
+    // Raises an interrupt on the CPU this device is attached to.
+    void raise(interrupt line) const { 
+        if (irq_target) irq_target->raise(line); 
+    }
 };
 
 namespace dev {
-    class memory: public mapper_device {
-        // Low half (Same across all banks)
-        std::unique_ptr<u8[]> lh;
-
-        // High half (bank 0)
-        std::unique_ptr<u8[]> hh0;
-        // High half (bank 1)
-        std::unique_ptr<u8[]> hh1;
-        // High half (bank 2)
-        std::unique_ptr<u8[]> hh2;
-        // High half (bank 3)
-        std::unique_ptr<u8[]> hh3;
-
-        const vm::sakuya16c& cpu;
+    class memory final: public mapper_device {
+    public:
+        // Number of switchable banks in the high half
+        static constexpr usize bank_count = 4;
+        // Granularity of write tracking, in bytes
+        static constexpr usize page_size = 0x100;
+        // Pages per half (both the low half and each high bank are 0x8000 bytes)
+        static constexpr usize pages_per_half = 0x8000 / page_size;
+        // Total number of tracked pages: the low half followed by every high bank
+        static constexpr usize page_count = pages_per_half * (1 + bank_count);
+    private:
+        // Every half in a single arena: the low half (same across all banks), followed by the high half of each
+        // bank
+        memory_arena arena;
+
+        // Epoch of the last write to each page. See mark_epoch(). Parallel cores write memory from their own
+        // threads, so epochs are only accessed through std::atomic_ref while the machine runs. A code page that
+        // keeps writing to itself can start a new epoch every other instruction, so they're 64bit to never wrap.
+        std::unique_ptr<u64[]> page_epochs;
+        u64 epoch = 1;
+        // Epoch mark of the last reset. Only pages written since then need restoring.
+        u64 reset_mark = 0;
+
+        // Cores that used each page since sharing began (see begin_sharing()): bit n for core n reading it, and
+        // bit 4 + n for core n writing it. Accessed through std::atomic_ref.
+        std::unique_ptr<u8[]> page_users;
+        bool sharing = false;
+        void (*contended)(void* user) = nullptr;
+        void* contended_user = nullptr;
+
+        // Core whose `mb` selects the bank of the high half
+        const vm::sakuya16c* cpu;
+
+        // Low half (0) or high half of a bank (1 + bank)
+        u8* half(usize index) const;
+        void mark_written(usize first_page, usize last_page);
+        void set_page_epoch(usize page) {
+            u64 current = std::atomic_ref(epoch).load(std::memory_order_relaxed);
+            std::atomic_ref(page_epochs[page]).store(current, std::memory_order_relaxed);
+        }
+        void claim_for_boot_contended(usize first_page, usize last_page, bool write) const;
+        // read() and write() for the boot core while sharing
+        u8 read_shared(u16 addr) const;
+        void write_shared(u16 addr, u8 val);
+        // Host memory of a range through a bank, without claiming it. Null if it crosses into the other half.
+        u8* locate(u16 bank, u16 addr, u16 size) const;
     public:
         memory(const vm::sakuya16c& cpu);
 
@@ -78,22 +137,179 @@ namespace dev {
         u8 read(u16 addr) const override;
         void write(u16 addr, u8 val) override;
         void reset() override;
+
+        // Makes the high half follow the `mb` register of another core.
+        void bind(const vm::sakuya16c& cpu) { this->cpu = &cpu; }
+
+        // Most cores that can share memory, counting the boot core
+        static constexpr usize sharing_cores = 4;
+
+        // Secondary cores in parallel mode access memory from their own threads, alongside the boot core. From
+        // begin_sharing() to end_sharing(), every core claims each page before touching it: during that time a
+        // page can be read by any number of cores, or read and written by a single one.
+        //
+        // The boot core's accesses through this device claim pages on their own. If another core got to one first,
+        // `contended` is called to wait for the other cores to stop, and it must call end_sharing().
+        void begin_sharing(void (*contended)(void* user), void* user);
+        void end_sharing() { sharing = false; }
+        // Claims a page for core `core` (0 being the boot core). Returns false if another core already claimed it
+        // in a conflicting way, in which case the core must leave the page alone until sharing ends. Claims hold
+        // until then, so a core must stop claiming after a conflict.
+        bool claim(usize page, usize core, bool write) const;
+        // Claims pages for the boot core from the machine thread, if sharing (see begin_sharing()).
+        void claim_for_boot(usize first_page, usize last_page, bool write) const {
+            if (sharing) [[unlikely]] {
+                claim_for_boot_contended(first_page, last_page, write);
+            }
+        }
+        // Direct access for a secondary core through an explicit bank, while sharing. Null if the range crosses into
+        // the other half, or if another core claimed one of its pages.
+        const u8* core_read(usize core, u16 bank, u16 addr, u16 size);
+        u8* core_write(usize core, u16 bank, u16 addr, u16 size);
+
+        // Direct access through the current bank
+        const u8* direct_read(u16 addr, u16 size) const override;
+        u8* direct_write(u16 addr, u16 size) override;
+        // Direct access through an explicit bank. Ranges can't cross from the low half into the high half.
+        const u8* bank_read(u16 bank, u16 addr, u16 size) const;
+        u8* bank_write(u16 bank, u16 addr, u16 size);
+
+        // Copies the contents of every bank into an image that other memories can map with map_image().
+        std::shared_ptr<const memory_image> capture() const { return memory_image::capture(arena); }
+        // Replaces the contents of every bank with a copy-on-write view of an image (nullptr for zeros). From then
+        // on, resetting goes back to the image instead of zeros.
+        //
+        // Resets only restore the pages written since the previous one, so they cost nothing for untouched memory.
+        void map_image(std::shared_ptr<const memory_image> image);
+        // Moves every bank into a shared file mapping, for live introspection. See memory_arena::share().
+        bool share(int fd, usize offset) { return arena.share(fd, offset); }
+
+        // Returns the tracked page holding an address, as seen through a bank.
+        static usize page_of(u16 bank, u16 addr) {
+            usize index = addr < 0x8000 ? 0 : 1 + bank % bank_count;
+            return index * pages_per_half + (addr % 0x8000) / page_size;
+        }
+        // Returns the bytes of a tracked page. Pages are numbered as described in `page_count`.
+        std::span<const u8> page(usize page) const;
+
+        // Host memory holding every half, in the same order as the tracked pages.
+        std::span<u8> host_memory() const { return {arena.data(), arena.size()}; }
+        // Returns where an address, as seen through a bank, is in host_memory().
+        static usize host_offset(u16 bank, u16 addr) { return page_of(bank, addr) * page_size + addr % page_size; }
+        // Makes a page aligned range of host_memory() read-only, or writable again. See memory_arena::protect().
+        bool protect(usize offset, usize size, bool writable) { return arena.protect(offset, size, writable); }
+
+        // Starts a new write epoch and returns it. Every page written from now on will report
+        // `written_since(page, mark)` as true, so any number of observers can track dirty pages
+        // independently by keeping their own mark.
+        //
+        // Safe to call from any thread.
+        u64 mark_epoch() { return std::atomic_ref(epoch).fetch_add(1, std::memory_order_relaxed) + 1; }
+        // Whether a page has been written since `mark` was returned by mark_epoch().
+        bool written_since(usize page, u64 mark) const {
+            return std::atomic_ref(page_epochs[page]).load(std::memory_order_relaxed) >= mark;
+        }
+        // Counts every page written since `mark` as written in the current epoch.
+        //
+        // A core on another thread can store an epoch that's already stale by the time its write lands, so an
+        // observer that marked in between would never see the write. The machine calls this with a mark taken
+        // before the threads started, once they've all stopped, so no write is missed past the quantum.
+        void settle_writes(u64 mark);
     };
 } // namespace dev
 
+// Defined here so buses can inline plain memory accesses
+inline u8* dev::memory::half(usize index) const {
+    assert(index <= bank_count);
+    return arena.data() + index * 0x8000;
+}
+
+inline bool dev::memory::claim(usize page, usize core, bool write) const {
+    u8 wanted = u8((write ? 0x11 : 0x01) << core);
+    std::atomic_ref users(page_users[page]);
+    if ((users.load(std::memory_order_relaxed) & wanted) == wanted) [[likely]] {
+        return true;
+    }
+    // Whichever core claims second sees the other's bits, so two conflicting claims can't both succeed
+    u8 others = users.fetch_or(wanted, std::memory_order_relaxed) & u8(~(0x11 << core));
+    // Readers only conflict with writers
+    return !(others & (write ? 0xff : 0xf0));
+}
+
+inline u8 dev::memory::read(u16 addr) const {
+    // Claiming is out of line, so the fast path only pays for the check
+    if (sharing) [[unlikely]] {
+        return read_shared(addr);
+    }
+    if (addr < 0x8000) {
+        return arena.data()[addr];
+    }
+
+    u16 mb = cpu->reg(reg::mb) % bank_count;
+    return half(1 + mb)[addr - 0x8000];
+}
+
+inline void dev::memory::write(u16 addr, u8 val) {
+    if (sharing) [[unlikely]] {
+        return write_shared(addr, val);
+    }
+    if (addr < 0x8000) {
+        arena.data()[addr] = val;
+        set_page_epoch(addr / page_size);
+        return;
+    }
+
+    u16 mb = cpu->reg(reg::mb) % bank_count;
+    set_page_epoch(pages_per_half * (1 + mb) + (addr - 0x8000) / page_size);
+    half(1 + mb)[addr - 0x8000] = val;
+}
+
 class bus {
     std::vector<std::unique_ptr<mapper_device>> mappers;
+    vm::sakuya16c& cpu;
+    // Number of read(), write(), read16() and write16() calls since reset, for the performance counters
+    mutable u64 accesses = 0;
+    // One bit per 256 byte page of the address space that a device other than memory claims part of
+    u64 device_pages[4] = {};
+
+    void claim_pages(const mapper_device& mapper);
 public:
-    bus(const vm::sakuya16c& cpu) { add_mapper(dev::memory(cpu)); }
+    bus(vm::sakuya16c& cpu): cpu(cpu) { add_mapper(dev::memory(cpu)); }
 
-    // Adds a mapper to the bus.
+    // Adds a mapper to the bus and returns it. Mappers added later take priority over earlier ones, so devices
+    // can be placed over the memory mapper.
     template<typename M> requires std::is_base_of_v<mapper_device, M>
-    void add_mapper(M&& mapper) { mappers.push_back(std::make_unique<M>(std::forward<M>(mapper))); }\
+    M& add_mapper(M&& mapper) { 
+        auto& added = mappers.emplace_back(std::make_unique<M>(std::forward<M>(mapper)));
+        added->irq_target = &cpu;
+        claim_pages(*added);
+        return static_cast<M&>(*added);
+    }
+
+    // Recomputes the pages devices claim, after a device starts or stops claiming its range.
+    void update_claims();
 
     std::unique_ptr<mapper_device>& find_mapper_for(u16 addr);
     const std::unique_ptr<mapper_device>& find_mapper_for(u16 addr) const;
 
+    // Reads and writes through the device that claims the address, remapping it if the device asks for it.
+    // Each call counts as one access.
+    u8 read(u16 addr) const;
+    void write(u16 addr, u8 val);
+    u16 read16(u16 addr) const;
+    void write16(u16 addr, u16 val);
+
     const std::vector<std::unique_ptr<mapper_device>>& get_mappers() const { return mappers; }
+    // Reads and writes made through the bus since reset. Instruction fetches don't go through here.
+    u64 access_count() const { return accesses; }
+
+    // Whether the whole 256 byte page holding an address goes to the memory mapper, so it can be accessed
+    // directly.
+    bool plain_memory(u16 addr) const { return !((device_pages[addr >> 14] >> ((addr >> 8) % 64)) & 1); }
+
+    // The "MEMORY" mapper is always the first one on the bus.
+    dev::memory& memory() { return static_cast<dev::memory&>(*mappers[0]); }
+    const dev::memory& memory() const { return static_cast<const dev::memory&>(*mappers[0]); }
 
     void reset();
 };
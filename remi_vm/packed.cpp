@@ -0,0 +1,58 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "./packed.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace vm::packed {
+
+#if defined(__SSE2__)
+template<byte_op Op>
+static __m128i apply_vector(__m128i a, __m128i b) {
+    if constexpr (Op == byte_op::add_saturate) return _mm_adds_epu8(a, b);
+    if constexpr (Op == byte_op::sub_saturate) return _mm_subs_epu8(a, b);
+    if constexpr (Op == byte_op::min) return _mm_min_epu8(a, b);
+    if constexpr (Op == byte_op::max) return _mm_max_epu8(a, b);
+}
+#endif
+
+template<byte_op Op>
+static void apply_span(u8* data, usize size, u8 value) {
+    usize i = 0;
+#if defined(__SSE2__)
+    const __m128i values = _mm_set1_epi8(char(value));
+    for (; i + 16 <= size; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (data + i));
+        _mm_storeu_si128((__m128i*) (data + i), apply_vector<Op>(bytes, values));
+    }
+#endif
+    for (; i < size; i++) {
+        data[i] = apply(Op, data[i], value);
+    }
+}
+
+void apply_span(byte_op op, u8* data, usize size, u8 value) {
+    switch (op) {
+    case byte_op::add_saturate: apply_span<byte_op::add_saturate>(data, size, value); break;
+    case byte_op::sub_saturate: apply_span<byte_op::sub_saturate>(data, size, value); break;
+    case byte_op::min: apply_span<byte_op::min>(data, size, value); break;
+    case byte_op::max: apply_span<byte_op::max>(data, size, value); break;
+    }
+}
+
+} // namespace vm::packed
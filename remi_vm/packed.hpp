@@ -0,0 +1,54 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <algorithm>
+
+#include "./vm.hpp"
+
+// Byte-wise operations behind the packed and block instructions.
+//
+// Packed instructions run them on the two lanes of a register, and block instructions on whole spans of memory,
+// 16 bytes at a time with SSE2 when it's available.
+namespace vm::packed {
+
+enum class byte_op: u8 {
+    // Unsigned add, clamping at 255
+    add_saturate,
+    // Unsigned subtract, clamping at 0
+    sub_saturate,
+    min,
+    max,
+};
+
+constexpr u8 apply(byte_op op, u8 a, u8 b) {
+    switch (op) {
+    case byte_op::add_saturate: return u8(std::min(a + b, 0xff));
+    case byte_op::sub_saturate: return u8(std::max(a - b, 0));
+    case byte_op::min: return std::min(a, b);
+    case byte_op::max: return std::max(a, b);
+    }
+    return a;
+}
+
+// Applies an operation to both lanes of two words.
+inline u16 apply_lanes(byte_op op, word a, word b) {
+    return word(apply(op, a.lo, b.lo), apply(op, a.hi, b.hi)).val;
+}
+
+// Applies an operation between every byte of `data` and `value`, in place.
+void apply_span(byte_op op, u8* data, usize size, u8 value);
+
+} // namespace vm::packed
@@ -0,0 +1,49 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "./perf.hpp"
+#include "./video.hpp"
+
+namespace vm {
+
+u8 dev::perf_counters::read(u16 addr) const {
+    if (addr < 0x04) {
+        return 0;
+    }
+    u32 counter = latched[(addr - 0x04) / 4];
+    return u8(counter >> (8 * (addr % 4)));
+}
+
+void dev::perf_counters::write(u16 addr, u8 val) {
+    if (addr != 0x00) {
+        return;
+    }
+    u64 cycles = sched.cycles;
+    latched[0] = u32(cycles);
+    latched[1] = u32(instructions);
+    latched[2] = u32(bus.access_count());
+    latched[3] = u32(cpu.bank_switches);
+    // 16.16 frames. Splitting off whole frames first keeps the multiplication from overflowing.
+    constexpr u64 frame = framebuffer::CYCLES_PER_FRAME;
+    latched[4] = u32((cycles / frame) << 16 | ((cycles % frame) << 16) / frame);
+}
+
+void dev::perf_counters::reset() {
+    for (u32& counter : latched) {
+        counter = 0;
+    }
+}
+
+} // namespace vm
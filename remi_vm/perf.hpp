@@ -0,0 +1,62 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Performance counters, so programs can measure their own code.
+    //
+    // Registers:
+    //   $00  latch (8bit, write only). Writing anything copies every counter into the registers below, which
+    //        keep their value until the next latch, so both halves of a counter always match.
+    //   $04  cycles elapsed (32bit)
+    //   $08  instructions retired by the boot core (32bit)
+    //   $0c  bus accesses, not counting instruction fetches (32bit)
+    //   $10  writes to `mb` that switched the bank, by the boot core (32bit)
+    //   $14  time elapsed in frames of 1/60 s (32bit, 16.16 fixed point)
+    //
+    // Counters are 32bit and wrap around. Measure a routine by latching before and after it and subtracting.
+    //
+    // Nothing is counted by the device itself: latching reads the counts the machine already keeps.
+    class perf_counters: public mapper_device {
+        const scheduler& sched;
+        const vm::bus& bus;
+        const sakuya16c& cpu;
+        const u64& instructions;
+
+        // Latched counters, in register order
+        u32 latched[5] = {};
+    public:
+        static constexpr u16 BASE = 0x7140;
+
+        perf_counters(const scheduler& sched, const vm::bus& bus, const sakuya16c& cpu, const u64& instructions): 
+            sched(sched), bus(bus), cpu(cpu), instructions(instructions) {}
+
+        const char* name() const override { return "PERF"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + 0x17}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+    };
+} // namespace dev
+
+} // namespace vm
@@ -0,0 +1,298 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "./ppu.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace vm {
+
+void composite_scanline(
+    const u8* bg, const u8* bg_front, const u8* sprites, const u8* sprites_behind, u8 backdrop, usize count,
+    u8* dst
+) {
+    usize i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fill = _mm_set1_epi8(char(backdrop));
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i*) (bg + i));
+        __m128i front = _mm_loadu_si128((const __m128i*) (bg_front + i));
+        __m128i s = _mm_loadu_si128((const __m128i*) (sprites + i));
+        __m128i behind = _mm_loadu_si128((const __m128i*) (sprites_behind + i));
+        __m128i bg_clear = _mm_cmpeq_epi8(b, zero);
+
+        // Background, or the backdrop where it's transparent
+        __m128i base = _mm_or_si128(_mm_andnot_si128(bg_clear, b), _mm_and_si128(bg_clear, fill));
+        // Sprites are hidden where they're transparent, or where an opaque background pixel wins priority
+        __m128i hidden = _mm_or_si128(
+            _mm_cmpeq_epi8(s, zero), _mm_andnot_si128(bg_clear, _mm_or_si128(front, behind))
+        );
+        __m128i out = _mm_or_si128(_mm_and_si128(hidden, base), _mm_andnot_si128(hidden, s));
+        _mm_storeu_si128((__m128i*) (dst + i), out);
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t fill = vdupq_n_u8(backdrop);
+
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t b = vld1q_u8(bg + i);
+        uint8x16_t s = vld1q_u8(sprites + i);
+        uint8x16_t bg_clear = vceqq_u8(b, zero);
+
+        uint8x16_t base = vbslq_u8(bg_clear, fill, b);
+        uint8x16_t hidden = vorrq_u8(
+            vceqq_u8(s, zero), vbicq_u8(vorrq_u8(vld1q_u8(bg_front + i), vld1q_u8(sprites_behind + i)), bg_clear)
+        );
+        vst1q_u8(dst + i, vbslq_u8(hidden, base, s));
+    }
+#endif
+
+    for (; i < count; i++) {
+        bool bg_opaque = bg[i] != 0;
+        u8 base = bg_opaque ? bg[i] : backdrop;
+        bool hidden = sprites[i] == 0 || (bg_opaque && (bg_front[i] | sprites_behind[i]));
+        dst[i] = hidden ? base : sprites[i];
+    }
+}
+
+dev::ppu::ppu(scheduler& sched, framebuffer& target): target(target), sched(sched) {
+    mem = std::unique_ptr<u8[]>(new u8[MEMORY_SIZE]);
+    memset(mem.get(), 0, MEMORY_SIZE);
+}
+
+void dev::ppu::on_frame(void* user, u64 now) {
+    auto* self = static_cast<ppu*>(user);
+    self->draw();
+
+    self->next_frame += framebuffer::CYCLES_PER_FRAME;
+    self->frame_event = self->sched.schedule(self->next_frame, on_frame, self);
+}
+
+u8 dev::ppu::read(u16 addr) const {
+    if (addr >= WINDOW_OFFSET) {
+        usize offset = page * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+        return offset < MEMORY_SIZE ? mem[offset] : 0;
+    }
+
+    switch (addr) {
+    case 0x00: return control;
+    case 0x01: return page;
+    case 0x02: return scroll_x;
+    case 0x03: return scroll_y;
+    case 0x04: return backdrop;
+    default: return 0;
+    }
+}
+
+void dev::ppu::write(u16 addr, u8 val) {
+    if (addr >= WINDOW_OFFSET) {
+        usize offset = page * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+        if (offset >= MEMORY_SIZE || mem[offset] == val) {
+            return;
+        }
+        mem[offset] = val;
+        mem_written = true;
+        touched(offset, 1);
+        return;
+    }
+
+    u8* reg = nullptr;
+    switch (addr) {
+    case 0x00: reg = &control; break;
+    case 0x01: page = val; return;
+    case 0x02: reg = &scroll_x; break;
+    case 0x03: reg = &scroll_y; break;
+    case 0x04: reg = &backdrop; break;
+    default: return;
+    }
+    // Every other register changes the whole screen
+    if (*reg != val) {
+        *reg = val;
+        mark_all_dirty();
+    }
+}
+
+const u8* dev::ppu::direct_read(u16 addr, u16 size) const {
+    if (addr < WINDOW_OFFSET || size == 0 || addr - WINDOW_OFFSET + size > WINDOW_SIZE) {
+        return nullptr;
+    }
+    usize offset = page * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+    return offset + size <= MEMORY_SIZE ? mem.get() + offset : nullptr;
+}
+
+u8* dev::ppu::direct_write(u16 addr, u16 size) {
+    if (!direct_read(addr, size)) {
+        return nullptr;
+    }
+    usize offset = page * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+    mem_written = true;
+    touched(offset, size);
+    return mem.get() + offset;
+}
+
+void dev::ppu::reset() {
+    if (mem_written) {
+        memset(mem.get(), 0, MEMORY_SIZE);
+        mem_written = false;
+    }
+    memset(drawn_sprites, 0, sizeof(drawn_sprites));
+    sprites_written = false;
+    control = 0;
+    page = 0;
+    scroll_x = 0;
+    scroll_y = 0;
+    backdrop = 0;
+    mark_all_dirty();
+
+    sched.cancel(frame_event);
+    next_frame = sched.cycles + framebuffer::CYCLES_PER_FRAME;
+    frame_event = sched.schedule(next_frame, on_frame, this);
+}
+
+void dev::ppu::touched(usize offset, usize size) {
+    usize end = offset + size;
+    if (offset < SPRITE_OFFSET) {
+        // Every tilemap row the range touches, at the current scroll
+        usize last = std::min(end, SPRITE_OFFSET) - 1;
+        constexpr usize ROW_BYTES = MAP_TILES * 2;
+        for (usize row = (offset - MAP_OFFSET) / ROW_BYTES; row <= (last - MAP_OFFSET) / ROW_BYTES; row++) {
+            isize top = isize(u8(row * TILE_SIZE - scroll_y));
+            mark_lines(top, TILE_SIZE);
+            // Rows wrapping around the bottom of the map show at the top of the screen
+            mark_lines(top - 256, TILE_SIZE);
+        }
+    }
+    if (offset < SPRITE_OFFSET + SPRITE_COUNT * 4 && end > SPRITE_OFFSET) {
+        // Sprites are compared against the table drawn last, since the lines they leave must be drawn again too
+        sprites_written = true;
+    }
+    if (end > PATTERN_OFFSET) {
+        mark_all_dirty();
+    }
+}
+
+void dev::ppu::mark_sprite(const u8* entry) {
+    mark_lines(isize(entry[0]) - isize(TILE_SIZE), TILE_SIZE);
+}
+
+void dev::ppu::mark_lines(isize first, isize count) {
+    for (isize y = std::max(first, isize(0)); y < std::min(first + count, isize(HEIGHT)); y++) {
+        dirty_lines[y / 64] |= u64(1) << (y % 64);
+    }
+}
+
+void dev::ppu::mark_all_dirty() {
+    mark_lines(0, HEIGHT);
+}
+
+void dev::ppu::draw() {
+    if (sprites_written) {
+        const u8* table = mem.get() + SPRITE_OFFSET;
+        for (usize i = 0; i < SPRITE_COUNT * 4; i += 4) {
+            if (memcmp(table + i, drawn_sprites + i, 4) != 0) {
+                mark_sprite(drawn_sprites + i);
+                mark_sprite(table + i);
+            }
+        }
+        memcpy(drawn_sprites, table, sizeof(drawn_sprites));
+        sprites_written = false;
+    }
+    if (!(control & (background_enabled | sprites_enabled))) {
+        return;
+    }
+
+    alignas(16) u8 line[WIDTH];
+    for (usize y = 0; y < HEIGHT; y++) {
+        if (dirty_lines[y / 64] & (u64(1) << (y % 64))) {
+            draw_line(y, line);
+            target.write_row(y, line);
+        }
+    }
+    memset(dirty_lines, 0, sizeof(dirty_lines));
+}
+
+void dev::ppu::draw_line(usize y, u8* dst) const {
+    alignas(16) u8 bg[WIDTH] = {};
+    alignas(16) u8 bg_front[WIDTH] = {};
+    alignas(16) u8 sprites[WIDTH] = {};
+    alignas(16) u8 sprites_behind[WIDTH] = {};
+
+    if (control & background_enabled) {
+        // The whole line of the map, then the part of it scrolled into view
+        constexpr usize MAP_WIDTH = MAP_TILES * TILE_SIZE;
+        u8 map_line[MAP_WIDTH];
+        u8 map_front[MAP_WIDTH];
+        usize map_y = (y + scroll_y) % MAP_WIDTH;
+        const u8* entries = mem.get() + MAP_OFFSET + map_y / TILE_SIZE * MAP_TILES * 2;
+        for (usize tx = 0; tx < MAP_TILES; tx++) {
+            u8 attributes = entries[tx * 2 + 1];
+            tile_row(entries[tx * 2], map_y % TILE_SIZE, attributes, map_line + tx * TILE_SIZE);
+            memset(map_front + tx * TILE_SIZE, attributes & priority ? 0xff : 0, TILE_SIZE);
+        }
+        for (usize x = 0; x < WIDTH; x++) {
+            bg[x] = map_line[(x + scroll_x) % MAP_WIDTH];
+            bg_front[x] = map_front[(x + scroll_x) % MAP_WIDTH];
+        }
+    }
+
+    if (control & sprites_enabled) {
+        // Backwards, so lower entries end up on top
+        for (usize i = SPRITE_COUNT; i-- > 0;) {
+            const u8* entry = mem.get() + SPRITE_OFFSET + i * 4;
+            isize row = isize(y) - (isize(entry[0]) - isize(TILE_SIZE));
+            if (row < 0 || row >= isize(TILE_SIZE)) {
+                continue;
+            }
+            u8 pixels[TILE_SIZE];
+            tile_row(entry[2], usize(row), entry[3], pixels);
+            isize left = isize(entry[1]) - isize(TILE_SIZE);
+            for (usize px = 0; px < TILE_SIZE; px++) {
+                isize x = left + isize(px);
+                if (x < 0 || x >= isize(WIDTH) || pixels[px] == 0) {
+                    continue;
+                }
+                sprites[x] = pixels[px];
+                sprites_behind[x] = entry[3] & priority ? 0xff : 0;
+            }
+        }
+    }
+
+    composite_scanline(bg, bg_front, sprites, sprites_behind, backdrop, WIDTH, dst);
+}
+
+void dev::ppu::tile_row(u8 tile, usize row, u8 attributes, u8* dst) const {
+    if (attributes & flip_y) {
+        row = TILE_SIZE - 1 - row;
+    }
+    const u8* src = mem.get() + PATTERN_OFFSET + tile * TILE_BYTES + row * TILE_SIZE / 2;
+    for (usize i = 0; i < TILE_SIZE / 2; i++) {
+        dst[i * 2] = src[i] >> 4;
+        dst[i * 2 + 1] = src[i] & 0x0f;
+    }
+    if (attributes & flip_x) {
+        std::reverse(dst, dst + TILE_SIZE);
+    }
+}
+
+} // namespace vm
@@ -0,0 +1,134 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <memory>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+#include "./video.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Tile and sprite picture processing unit. Draws a scrolling tilemap and sprites into the framebuffer once per
+    // frame, so a whole screen is driven by a few hundred writes instead of one write per pixel.
+    //
+    // Registers:
+    //   $000       control (8bit). Bit 0 enables the background, bit 1 enables sprites. While both are clear
+    //              the PPU leaves the framebuffer alone, so programs can keep drawing pixels themselves.
+    //   $001       page of PPU memory visible in the window (8bit)
+    //   $002       background scroll x (8bit)
+    //   $003       background scroll y (8bit)
+    //   $004       backdrop color, drawn where no layer has a pixel (8bit)
+    //   $100..$1ff PPU memory window
+    //
+    // PPU memory:
+    //   $0000..$07ff tilemap, 32x32 entries of (tile, attributes). It's 256x256 pixels and wraps around.
+    //   $0800..$08ff sprite table, 64 entries of (y, x, tile, attributes). Sprites are 8x8 and drawn with their
+    //                top left corner at (x - 8, y - 8), so 0 hides them. Lower entries are drawn on top.
+    //   $1000..$2fff tile patterns, 256 tiles of 8 rows of 4 bytes, two pixels per byte (high nibble first)
+    //
+    // Pixels are palette indices, 0 is transparent. Attributes: bit 0 flips horizontally, bit 1 flips vertically,
+    // bit 7 gives priority (background tiles are drawn over sprites, sprites are drawn behind the background).
+    //
+    // Only scanlines whose inputs changed since the last frame are drawn again, and only pixels that changed
+    // reach the framebuffer, so static screens cost almost nothing.
+    class ppu: public mapper_device {
+    public:
+        static constexpr u16 BASE = 0x7180;
+        static constexpr usize WINDOW_OFFSET = 0x100;
+        static constexpr usize WINDOW_SIZE = 0x100;
+        static constexpr usize MAP_OFFSET = 0x0000;
+        static constexpr usize MAP_TILES = 32;
+        static constexpr usize SPRITE_OFFSET = 0x0800;
+        static constexpr usize SPRITE_COUNT = 64;
+        static constexpr usize PATTERN_OFFSET = 0x1000;
+        static constexpr usize TILE_SIZE = 8;
+        static constexpr usize TILE_BYTES = TILE_SIZE * TILE_SIZE / 2;
+        static constexpr usize MEMORY_SIZE = PATTERN_OFFSET + 256 * TILE_BYTES;
+        static constexpr usize WIDTH = framebuffer::WIDTH;
+        static constexpr usize HEIGHT = framebuffer::HEIGHT;
+
+        enum control_bits: u8 {
+            background_enabled = 1 << 0,
+            sprites_enabled = 1 << 1,
+        };
+        enum attribute_bits: u8 {
+            flip_x = 1 << 0,
+            flip_y = 1 << 1,
+            priority = 1 << 7,
+        };
+    private:
+        std::unique_ptr<u8[]> mem;
+        // Sprite table as of the last frame drawn, to find the scanlines moved sprites left or entered
+        u8 drawn_sprites[SPRITE_COUNT * 4] = {};
+        bool sprites_written = false;
+        // Whether PPU memory was written since the last reset, so resets can skip clearing it
+        bool mem_written = false;
+
+        u8 control = 0;
+        u8 page = 0;
+        u8 scroll_x = 0;
+        u8 scroll_y = 0;
+        u8 backdrop = 0;
+
+        // Scanlines that must be drawn again (one bit per scanline)
+        u64 dirty_lines[(HEIGHT + 63) / 64] = {};
+
+        framebuffer& target;
+        scheduler& sched;
+        event_handle frame_event;
+        u64 next_frame = 0;
+
+        static void on_frame(void* user, u64 now);
+        // Marks the scanlines affected by a write to [offset, offset + size) of PPU memory
+        void touched(usize offset, usize size);
+        // Marks the scanlines covered by a sprite table entry
+        void mark_sprite(const u8* entry);
+        void mark_lines(isize first, isize count);
+        void mark_all_dirty();
+        // Draws the dirty scanlines into the framebuffer
+        void draw();
+        void draw_line(usize y, u8* dst) const;
+        // Decodes one row of a tile into 8 palette indices
+        void tile_row(u8 tile, usize row, u8 attributes, u8* dst) const;
+    public:
+        ppu(scheduler& sched, framebuffer& target);
+
+        const char* name() const override { return "PPU"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + WINDOW_OFFSET + WINDOW_SIZE - 1}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+
+        // Direct access to the window, so DMA can upload tiles in bulk
+        const u8* direct_read(u16 addr, u16 size) const override;
+        u8* direct_write(u16 addr, u16 size) override;
+    };
+} // namespace dev
+
+// Composites one scanline: sprite pixels over background pixels over the backdrop, where 0 is transparent.
+// Sprite pixels whose `sprites_behind` byte is 0xff, or that are under a background pixel whose `bg_front` byte is
+// 0xff, only show where the background is transparent. Vectorized with SSE2 or NEON when available.
+void composite_scanline(
+    const u8* bg, const u8* bg_front, const u8* sprites, const u8* sprites_behind, u8 backdrop, usize count,
+    u8* dst
+);
+
+} // namespace vm
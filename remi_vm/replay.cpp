@@ -0,0 +1,146 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <cassert>
+
+#include "./replay.hpp"
+
+namespace vm {
+
+// helpers to read and write binary data (because the << and >> operators use string format so we can't use them)
+template <typename T>
+static void write(std::ofstream& file, T data) { file.write((const char*) &data, sizeof(T)); }
+template <typename T>
+static T read(std::ifstream& file) {
+    T data = {};
+    file.read((char*) &data, sizeof(T));
+    return data;
+}
+
+replay_recorder::replay_recorder(const char* path, u64 interval): interval(interval) {
+    assert(interval > 0);
+    file = std::ofstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    // magic (4 bytes)
+    write(file, u8(0x7f)); write(file, u8('r')); write(file, u8('r')); write(file, u8('p'));
+    // version (1 byte) and reserved (3 bytes)
+    write(file, REPLAY_VERSION);
+    write(file, u8(0)); write(file, u16(0));
+    // interval (8 bytes)
+    write(file, interval);
+}
+
+u64 replay_recorder::on_instruction(machine& machine) {
+    write(file, replay_record_tag::hash);
+    write(file, machine.instructions);
+    write(file, hasher.hash(machine.cpu, machine.bus.memory()));
+
+    return machine.instructions + interval;
+}
+
+void replay_recorder::on_input(machine& machine, u16 addr, u8 val) {
+    write(file, replay_record_tag::input);
+    write(file, machine.instructions);
+    write(file, addr);
+    write(file, val);
+}
+
+void replay_recorder::finish(const machine& machine) {
+    write(file, replay_record_tag::end);
+    write(file, machine.instructions);
+    file.close();
+}
+
+replay_player::replay_player(const char* path) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+
+    u8 magic[4] = {};
+    file.read((char*) &magic, sizeof(magic));
+    if (!file || magic[0] != 0x7f || magic[1] != 'r' || magic[2] != 'r' || magic[3] != 'p') {
+        return;
+    }
+    if (read<u8>(file) != REPLAY_VERSION) {
+        return;
+    }
+    read<u8>(file); read<u16>(file); // reserved
+    interval = read<u64>(file);
+
+    // Replays are small (a few bytes per input and per hash), so just load them all up front
+    while (file) {
+        replay_record record = {};
+        record.tag = read<replay_record_tag>(file);
+        record.instruction = read<u64>(file);
+        switch (record.tag) {
+        case replay_record_tag::end: break;
+        case replay_record_tag::input:
+            record.addr = read<u16>(file);
+            record.value = read<u8>(file);
+            break;
+        case replay_record_tag::hash:
+            record.hash = read<u64>(file);
+            break;
+        default:
+            return;
+        }
+        if (!file) {
+            return;
+        }
+
+        records.push_back(record);
+        if (record.tag == replay_record_tag::end) {
+            status = replay_status::playing;
+            return;
+        }
+    }
+}
+
+u64 replay_player::on_instruction(machine& machine) {
+    if (status != replay_status::playing) {
+        machine.stop_requested = true;
+        return UINT64_MAX;
+    }
+    // The machine was reset while playing, so the replay starts over with it
+    if (next_record > 0 && machine.instructions < records[next_record - 1].instruction) {
+        next_record = 0;
+    }
+
+    // Records are stored in the order they happened, so everything for this instruction count is contiguous
+    while (records[next_record].instruction == machine.instructions) {
+        const replay_record& record = records[next_record];
+        switch (record.tag) {
+        case replay_record_tag::end:
+            status = replay_status::finished;
+            machine.stop_requested = true;
+            return UINT64_MAX;
+        case replay_record_tag::input:
+            machine.input(record.addr, record.value);
+            break;
+        case replay_record_tag::hash:
+            actual_hash = hasher.hash(machine.cpu, machine.bus.memory());
+            if (actual_hash != record.hash) {
+                status = replay_status::mismatch;
+                failed_at = record;
+                machine.stop_requested = true;
+                return UINT64_MAX;
+            }
+            break;
+        }
+        next_record++;
+    }
+
+    return records[next_record].instruction;
+}
+
+} // namespace vm
@@ -0,0 +1,103 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <fstream>
+#include <vector>
+
+#include "./machine.hpp"
+#include "./state_hash.hpp"
+
+namespace vm {
+
+// Replay files (.r16r) log every external input fed into a machine along with the instruction count at which it
+// happened, plus a hash of the whole machine state every `interval` instructions. Playing a replay back on the
+// same ROM must reproduce the exact same hashes, otherwise something in the VM is not deterministic, and the
+// first mismatching hash narrows it down to a window of `interval` instructions.
+//
+// Layout (little endian):
+//   magic (4 bytes)        0x7f 'r' 'r' 'p'
+//   version (1 byte)
+//   reserved (3 bytes)
+//   interval (8 bytes)     instructions between state hashes
+//   records...             each one is a tag (1 byte), an instruction count (8 bytes) and a payload:
+//     end   (tag 0)        no payload
+//     input (tag 1)        address (2 bytes), value (1 byte)
+//     hash  (tag 2)        state hash (8 bytes)
+constexpr u8 REPLAY_VERSION = 1;
+
+enum class replay_record_tag: u8 {
+    end = 0,
+    input,
+    hash,
+};
+
+struct replay_record {
+    replay_record_tag tag;
+    u64 instruction;
+    u16 addr = 0;
+    u8 value = 0;
+    u64 hash = 0;
+};
+
+// Records a replay of a machine. Attach it right after resetting the machine.
+class replay_recorder: public machine_hook {
+    std::ofstream file;
+    state_hasher hasher;
+    u64 interval;
+public:
+    replay_recorder(const char* path, u64 interval = 10000);
+
+    u64 on_instruction(machine& machine) override;
+    void on_input(machine& machine, u16 addr, u8 val) override;
+
+    // Writes the end record and closes the file. Detach the recorder from the machine before calling this.
+    void finish(const machine& machine);
+};
+
+enum class replay_status {
+    // Still playing back
+    playing,
+    // Every hash matched until the end of the recording
+    finished,
+    // A hash didn't match (see `replay_player::failed_at`)
+    mismatch,
+    // The file doesn't exist or is not a valid replay
+    invalid,
+};
+
+// Plays back a replay on a machine, verifying the recorded state hashes. Attach it right after resetting the
+// machine. Playback stops the machine at the end of the recording or at the first mismatching hash, and starts
+// over if the machine is reset.
+class replay_player: public machine_hook {
+    std::vector<replay_record> records;
+    usize next_record = 0;
+    state_hasher hasher;
+    u64 interval = 0;
+public:
+    replay_status status = replay_status::invalid;
+    // On mismatch, the hash record that failed. The divergence happened within the `interval` instructions
+    // that precede it.
+    replay_record failed_at = {};
+    u64 actual_hash = 0;
+
+    replay_player(const char* path);
+
+    u64 on_instruction(machine& machine) override;
+
+    u64 hash_interval() const { return interval; }
+};
+
+} // namespace vm
@@ -0,0 +1,81 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include "./vm.hpp"
+
+namespace vm {
+
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// One thread may push and one (other) thread may pop at the same time without any locking. Capacity is rounded
+// up to a power of two. The indices are free running, and each one lives in its own cache line so the producer
+// and the consumer don't fight over it.
+template<typename T> requires std::is_trivially_copyable_v<T>
+class spsc_ring {
+    std::unique_ptr<T[]> data;
+    usize mask;
+
+    alignas(64) std::atomic<usize> head = 0; // written by the producer
+    alignas(64) std::atomic<usize> tail = 0; // written by the consumer
+public:
+    spsc_ring(usize capacity) {
+        usize size = 1;
+        while (size < capacity) size *= 2;
+        data = std::unique_ptr<T[]>(new T[size]);
+        mask = size - 1;
+    }
+
+    usize capacity() const { return mask + 1; }
+    // Approximate when called from a thread that is neither the producer nor the consumer.
+    usize size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    // Producer side. Pushes as many items as fit and returns how many were pushed.
+    usize push(const T* items, usize count) {
+        usize h = head.load(std::memory_order_relaxed);
+        usize t = tail.load(std::memory_order_acquire);
+        count = std::min(count, capacity() - (h - t));
+
+        // Copy in at most two pieces (before and after wrapping around)
+        usize start = h & mask;
+        usize first = std::min(count, capacity() - start);
+        std::copy_n(items, first, data.get() + start);
+        std::copy_n(items + first, count - first, data.get());
+
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Pops up to `count` items and returns how many were popped.
+    usize pop(T* items, usize count) {
+        usize t = tail.load(std::memory_order_relaxed);
+        usize h = head.load(std::memory_order_acquire);
+        count = std::min(count, h - t);
+
+        usize start = t & mask;
+        usize first = std::min(count, capacity() - start);
+        std::copy_n(data.get() + start, first, items);
+        std::copy_n(data.get(), count - first, items + first);
+
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+};
+
+} // namespace vm
@@ -0,0 +1,157 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <cassert>
+#include <cstring>
+
+#include "./rom_loader.hpp"
+#include "./state_hash.hpp"
+
+namespace vm {
+
+// helpers to read binary data from ROM file (because the >> operator reads in string format so we can't use that)
+template <typename T>
+T read(std::ifstream& file) {
+    T data = {};
+    file.read((char*) &data, sizeof(T));
+    return data;
+}
+
+// Reads the header and region table. Returns false if the file is not a remi16 ROM file (or is cut short).
+static bool read_region_table(std::ifstream& file, std::unordered_map<u32, rom_region>& regions) {
+    // magic (4 bytes)
+    u8 magic[4] = {};
+    file.read((char*) &magic, sizeof(magic));
+
+    if (magic[0] != 0x7f || magic[1] != 'r' || magic[2] != '1' || magic[3] != '6') {
+        return false;
+    }
+
+    // major version (1 byte)
+    u8 major_version = read<u8>(file);
+    // minor version (1 byte)
+    u8 minor_version = read<u8>(file);
+
+    // region count (2 bytes)
+    u16 region_count = read<u16>(file);
+    // Populate regions
+    regions.clear();
+    regions.reserve(region_count);
+    for (u16 i = 0; i < region_count; i++) {
+        // region id (4 bytes)
+        u32 region_id = read<u32>(file);
+        // region offset (4 bytes)
+        u32 region_offset = read<u32>(file);
+        // region size, low 16 bits (2 bytes)
+        u32 region_size = read<u16>(file);
+        // region loadat (2 bytes)
+        u16 region_loadat = read<u16>(file);
+        // region bank (2 bytes)
+        u16 region_bank = read<u16>(file);
+        // region size, high 16 bits (2 bytes). Only cartridges get that big.
+        region_size |= u32(read<u16>(file)) << 16;
+
+        regions[region_id] = rom_region {region_offset, region_size, region_loadat, region_bank, };
+    }
+
+    return bool(file);
+}
+
+// Loads a remi16 ROM from a file. Crashes if the file doesn't exist or is not a remi16 ROM file.s
+loaded_rom load_rom_from_file(const char* filename) {
+    loaded_rom rom = {};
+    rom.path = filename;
+    rom.file = std::ifstream(filename, std::ios::in | std::ios::binary);
+
+    if (!read_region_table(rom.file, rom.regions)) {
+        assert(false && "Invalid ROM file");
+    }
+
+    return rom;
+}
+
+const std::vector<u8>& loaded_rom::get_region(u32 region_id) {
+    if (!loaded_region_data.contains(region_id)) {
+        assert(regions.contains(region_id));
+
+        loaded_region_data[region_id] = std::vector<u8>(regions[region_id].size);
+        file.seekg(regions[region_id].rom_offset);
+        file.read((char*) loaded_region_data[region_id].data(), regions[region_id].size);
+        region_hashes[region_id] = hash_bytes(loaded_region_data[region_id].data(), regions[region_id].size);
+
+        return loaded_region_data[region_id];
+    } else {
+        return loaded_region_data[region_id];
+    }
+}
+
+rom_reload loaded_rom::reload() {
+    rom_reload result;
+
+    // Opened again, the file may have been replaced instead of rewritten
+    std::ifstream new_file(path, std::ios::in | std::ios::binary);
+    std::unordered_map<u32, rom_region> new_regions;
+    if (!new_file || !read_region_table(new_file, new_regions)) {
+        return result;
+    }
+
+    // Read every loaded region before touching anything, so a half written file changes nothing
+    std::unordered_map<u32, std::vector<u8>> new_data;
+    for (const auto& [id, data]: loaded_region_data) {
+        auto region = new_regions.find(id);
+        if (region == new_regions.end()) {
+            result.layout_changed = true;
+            continue;
+        }
+        if (!region->second.same_placement(regions[id])) {
+            result.layout_changed = true;
+        }
+
+        std::vector<u8> bytes(region->second.size);
+        new_file.seekg(region->second.rom_offset);
+        new_file.read((char*) bytes.data(), bytes.size());
+        if (!new_file) {
+            return result;
+        }
+        new_data[id] = std::move(bytes);
+    }
+
+    for (auto& [id, bytes]: new_data) {
+        u64 hash = hash_bytes(bytes.data(), bytes.size());
+        if (hash == region_hashes[id]) {
+            continue;
+        }
+
+        auto& data = loaded_region_data[id];
+        if (data.size() == bytes.size()) {
+            memcpy(data.data(), bytes.data(), bytes.size());
+        } else {
+            data = std::move(bytes);
+        }
+        region_hashes[id] = hash;
+        result.changed.push_back(id);
+    }
+
+    // Regions that don't exist anymore
+    std::erase_if(loaded_region_data, [&](const auto& entry) { return !new_regions.contains(entry.first); });
+    std::erase_if(region_hashes, [&](const auto& entry) { return !new_regions.contains(entry.first); });
+
+    file = std::move(new_file);
+    regions = std::move(new_regions);
+    result.ok = true;
+    return result;
+}
+
+} // namespace vm
\ No newline at end of file
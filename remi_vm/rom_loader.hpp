@@ -0,0 +1,74 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+
+#include "./vm.hpp"
+
+namespace vm {
+
+// Bank of regions that stay in the ROM file, and are seen through the cartridge window instead of loaded into memory
+constexpr u16 CARTRIDGE_BANK = 0xfffe;
+
+struct rom_region {
+    u32 rom_offset;
+    u32 size;
+    u16 loadat;
+    u16 bank;
+
+    bool is_cartridge() const { return bank == CARTRIDGE_BANK; }
+
+    // Whether the region is placed the same way in both tables
+    bool same_placement(const rom_region& other) const {
+        return size == other.size && loadat == other.loadat && bank == other.bank;
+    }
+};
+
+// Result of loaded_rom::reload()
+struct rom_reload {
+    // False if the file couldn't be read or isn't a remi16 ROM (it may still be being written). Nothing changed.
+    bool ok = false;
+    // Loaded regions whose contents changed. They have been patched into `loaded_region_data`.
+    std::vector<u32> changed;
+    // Whether any loaded region was removed, resized or moved to another address or bank, which the running
+    // program can't survive
+    bool layout_changed = false;
+};
+
+struct loaded_rom {
+    std::string path;
+    std::ifstream file;
+    std::unordered_map<u32, rom_region> regions;
+    std::unordered_map<u32, std::vector<u8>> loaded_region_data;
+    // hash_bytes() of each loaded region
+    std::unordered_map<u32, u64> region_hashes;
+
+    // Crashes if region doesn't exist. Cartridge regions can be read this way too, but they're meant to be mapped.
+    const std::vector<u8>& get_region(u32 region_id);
+
+    // Reads the ROM file again, and updates the regions that changed. Only the region table and the regions that
+    // were already loaded are read.
+    //
+    // Regions that keep their size are patched in place, so pointers into `loaded_region_data` stay valid for them.
+    rom_reload reload();
+};
+
+loaded_rom load_rom_from_file(const char* filename);
+
+} // namespace vm
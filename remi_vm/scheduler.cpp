@@ -0,0 +1,201 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+#include "./scheduler.hpp"
+
+namespace vm {
+
+scheduler::scheduler() {
+    std::fill(std::begin(slots), std::end(slots), NONE);
+    memset(occupied, 0, sizeof(occupied));
+    reset();
+}
+
+void scheduler::reset() {
+    // Bump every generation so old handles don't match anything anymore
+    free_list = NONE;
+    for (u32 i = 0; i < events.size(); i++) {
+        events[i].generation++;
+        events[i].slot = NONE;
+        events[i].next = free_list;
+        free_list = i;
+    }
+
+    // Only occupied slots have a list to drop
+    for (usize level = 0; level < LEVELS; level++) {
+        for (usize word = 0; word < SLOTS / 64; word++) {
+            for (u64 bits = occupied[level][word]; bits; bits &= bits - 1) {
+                slots[level * SLOTS + word * 64 + std::countr_zero(bits)] = NONE;
+            }
+            occupied[level][word] = 0;
+        }
+    }
+
+    cycles = 0;
+    wheel_time = 0;
+    next_deadline = UINT64_MAX;
+}
+
+event_handle scheduler::schedule(u64 deadline, event_callback callback, void* user) {
+    u32 index;
+    if (free_list != NONE) {
+        index = free_list;
+        free_list = events[index].next;
+    } else {
+        index = u32(events.size());
+        events.push_back({});
+    }
+
+    event& e = events[index];
+    e.deadline = deadline;
+    e.callback = callback;
+    e.user = user;
+    insert(index);
+
+    next_deadline = find_next_deadline();
+    return {index, e.generation};
+}
+
+void scheduler::cancel(event_handle handle) {
+    if (!scheduled(handle)) {
+        return;
+    }
+
+    unlink(handle.index);
+    event& e = events[handle.index];
+    e.generation++;
+    e.next = free_list;
+    free_list = handle.index;
+
+    next_deadline = find_next_deadline();
+}
+
+bool scheduler::scheduled(event_handle handle) const {
+    return handle.index < events.size() 
+        && events[handle.index].generation == handle.generation
+        && events[handle.index].slot != NONE;
+}
+
+void scheduler::run_due() {
+    while (next_deadline <= cycles) {
+        wheel_time = next_deadline;
+
+        // Find the slot that produced the deadline. Lower levels always come first.
+        usize level = 0, slot = 0;
+        for (; level < LEVELS; level++) {
+            slot = (wheel_time >> (8 * level)) & 0xff;
+            if (occupied[level][slot / 64] & (u64(1) << (slot % 64))) break;
+        }
+        assert(level < LEVELS);
+        u32& head = slots[level * SLOTS + slot];
+
+        if (level == 0) {
+            // Every event in a level 0 slot has the exact same deadline. Events are popped one by one because
+            // callbacks may schedule or cancel other events.
+            while (head != NONE) {
+                u32 index = head;
+                unlink(index);
+
+                event& e = events[index];
+                event_callback callback = e.callback;
+                void* user = e.user;
+                e.generation++;
+                e.next = free_list;
+                free_list = index;
+
+                callback(user, cycles);
+            }
+        } else {
+            // The wheel reached the start of a higher level slot, so move its events closer to the deadline
+            while (head != NONE) {
+                u32 index = head;
+                unlink(index);
+                insert(index);
+            }
+        }
+
+        next_deadline = find_next_deadline();
+    }
+}
+
+void scheduler::insert(u32 index) {
+    event& e = events[index];
+    u64 time = std::max(e.deadline, wheel_time);
+
+    // The level is the highest byte in which the deadline differs from the wheel time. This way each slot is
+    // always ahead of the wheel on its level, and slots never wrap around.
+    u64 diff = time ^ wheel_time;
+    usize level = diff == 0 ? 0 : (63 - std::countl_zero(diff)) / 8;
+    usize slot = (time >> (8 * level)) & 0xff;
+
+    u32& head = slots[level * SLOTS + slot];
+    e.slot = u32(level * SLOTS + slot);
+    e.prev = NONE;
+    e.next = head;
+    if (head != NONE) {
+        events[head].prev = index;
+    }
+    head = index;
+    occupied[level][slot / 64] |= u64(1) << (slot % 64);
+}
+
+void scheduler::unlink(u32 index) {
+    event& e = events[index];
+    if (e.prev != NONE) {
+        events[e.prev].next = e.next;
+    } else {
+        slots[e.slot] = e.next;
+    }
+    if (e.next != NONE) {
+        events[e.next].prev = e.prev;
+    }
+
+    if (slots[e.slot] == NONE) {
+        usize level = e.slot / SLOTS, slot = e.slot % SLOTS;
+        occupied[level][slot / 64] &= ~(u64(1) << (slot % 64));
+    }
+    e.slot = NONE;
+}
+
+u64 scheduler::find_next_deadline() const {
+    for (usize level = 0; level < LEVELS; level++) {
+        usize shift = 8 * level;
+        usize current = (wheel_time >> shift) & 0xff;
+        // Level 0 slots hold events due exactly at the slot time, including the current one. Higher level
+        // slots need to be cascaded when the wheel reaches them, which is always after the current one.
+        usize start = level == 0 ? current : current + 1;
+
+        for (usize word = start / 64; word < SLOTS / 64; word++) {
+            u64 bits = occupied[level][word];
+            if (word == start / 64) {
+                bits &= ~u64(0) << (start % 64);
+            }
+            if (bits == 0) continue;
+
+            u64 slot = word * 64 + std::countr_zero(bits);
+            // Bits above this level stay the same as the wheel time, bits below are 0
+            u64 high = shift + 8 >= 64 ? 0 : (wheel_time >> (shift + 8)) << (shift + 8);
+            return high | (slot << shift);
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+} // namespace vm
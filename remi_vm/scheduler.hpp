@@ -0,0 +1,102 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <vector>
+
+#include "./vm.hpp"
+
+namespace vm {
+
+// Identifies a scheduled event so it can be cancelled. Handles of events that already ran or were cancelled
+// are harmless to cancel again.
+struct event_handle {
+    u32 index = UINT32_MAX;
+    u32 generation = 0;
+};
+
+// Called when an event is due. `now` is the current cycle, which may be later than the deadline if the
+// instruction that crossed it took more than one cycle.
+typedef void (*event_callback)(void* user, u64 now);
+
+// Central scheduler for everything in the console that happens at a point in time (timer expiry, vblank, audio
+// buffer refill...). It also owns the CPU clock.
+//
+// Devices never get ticked: they schedule an event for the cycle they care about and the machine runs straight
+// up to the next deadline. Events are kept in a hierarchical timing wheel (8 levels of 256 slots, one per byte
+// of the 64bit deadline), so scheduling and cancelling are O(1) and finding the next deadline only scans
+// occupancy bitmaps.
+class scheduler {
+public:
+    // Cycles elapsed since reset. The machine advances it as instructions execute.
+    u64 cycles = 0;
+
+    scheduler();
+
+    // Schedules `callback` to run at cycle `deadline`. Deadlines in the past run as soon as possible.
+    event_handle schedule(u64 deadline, event_callback callback, void* user);
+    // Schedules `callback` to run `delay` cycles from now.
+    event_handle schedule_in(u64 delay, event_callback callback, void* user) { 
+        return schedule(cycles + delay, callback, user); 
+    }
+    // Cancels an event if it hasn't run yet.
+    void cancel(event_handle handle);
+    // Whether an event is still waiting to run.
+    bool scheduled(event_handle handle) const;
+
+    // Cycle at which run_due() must be called next (UINT64_MAX if nothing is scheduled). It may be earlier than
+    // the next event deadline, when the wheel needs to move events closer to their deadline.
+    u64 deadline() const { return next_deadline; }
+    // Runs every event due at or before the current cycle.
+    void run_due();
+
+    // Drops every event and rewinds the clock to 0. Only costs as much as the number of events.
+    void reset();
+
+private:
+    static constexpr usize LEVELS = 8;
+    static constexpr usize SLOTS = 256;
+    static constexpr u32 NONE = UINT32_MAX;
+
+    struct event {
+        u64 deadline;
+        event_callback callback;
+        void* user;
+        // Intrusive list links inside a slot (or the free list)
+        u32 prev, next;
+        u32 generation;
+        // Slot the event is in (level * SLOTS + slot), or NONE if it's not scheduled
+        u32 slot;
+    };
+
+    std::vector<event> events;
+    u32 free_list = NONE;
+
+    // Head of the event list of each slot
+    u32 slots[LEVELS * SLOTS];
+    // Bitmap of non-empty slots, per level
+    u64 occupied[LEVELS][SLOTS / 64];
+
+    // Time the wheel has been advanced to. Slots are relative to it.
+    u64 wheel_time = 0;
+    // Cached result of find_next_deadline()
+    u64 next_deadline = UINT64_MAX;
+
+    void insert(u32 index);
+    void unlink(u32 index);
+    u64 find_next_deadline() const;
+};
+
+} // namespace vm
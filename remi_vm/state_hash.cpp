@@ -0,0 +1,115 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "./state_hash.hpp"
+
+namespace vm {
+
+namespace {
+    constexpr u64 PRIME1 = 0x9E3779B185EBCA87ull;
+    constexpr u64 PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr u64 PRIME3 = 0x165667B19E3779F9ull;
+    constexpr u64 PRIME4 = 0x85EBCA77C2B2AE63ull;
+    constexpr u64 PRIME5 = 0x27D4EB2F165667C5ull;
+
+    inline u64 rotl(u64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    // Unaligned little endian loads
+    inline u64 load64(const u8* p) { u64 v; memcpy(&v, p, sizeof(v)); return v; }
+    inline u32 load32(const u8* p) { u32 v; memcpy(&v, p, sizeof(v)); return v; }
+
+    inline u64 round(u64 acc, u64 lane) {
+        acc += lane * PRIME2;
+        acc = rotl(acc, 31);
+        return acc * PRIME1;
+    }
+
+    inline u64 merge_round(u64 acc, u64 val) {
+        acc ^= round(0, val);
+        return acc * PRIME1 + PRIME4;
+    }
+}
+
+u64 hash_bytes(const void* data, usize size, u64 seed) {
+    const u8* p = static_cast<const u8*>(data);
+    const u8* end = p + size;
+    u64 h;
+
+    if (size >= 32) {
+        // Four independent accumulators so the CPU can work on them in parallel
+        u64 v1 = seed + PRIME1 + PRIME2;
+        u64 v2 = seed + PRIME2;
+        u64 v3 = seed;
+        u64 v4 = seed - PRIME1;
+        do {
+            v1 = round(v1, load64(p));
+            v2 = round(v2, load64(p + 8));
+            v3 = round(v3, load64(p + 16));
+            v4 = round(v4, load64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += u64(size);
+
+    // Tail
+    for (; end - p >= 8; p += 8) {
+        h ^= round(0, load64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4) {
+        h ^= u64(load32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= u64(*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+u64 state_hasher::hash(const sakuya16c& cpu, dev::memory& memory) {
+    // Rehash only the pages written since the last time
+    for (usize page = 0; page < dev::memory::page_count; page++) {
+        if (memory.written_since(page, mark)) {
+            auto bytes = memory.page(page);
+            page_hashes[page] = hash_bytes(bytes.data(), bytes.size(), page);
+        }
+    }
+    mark = memory.mark_epoch();
+
+    // The final hash covers the CPU state and the hash of every page
+    u64 h = hash_bytes(cpu.registers, sizeof(cpu.registers));
+    h = hash_bytes(&cpu.status, sizeof(cpu.status), h);
+    return hash_bytes(page_hashes, sizeof(page_hashes), h);
+}
+
+} // namespace vm
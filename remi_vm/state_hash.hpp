@@ -0,0 +1,38 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "./vm.hpp"
+#include "./mapper.hpp"
+
+namespace vm {
+
+// Fast non-cryptographic 64-bit hash (XXH64). Good for detecting changes, useless for anything security related.
+u64 hash_bytes(const void* data, usize size, u64 seed = 0);
+
+// Hashes the whole machine state: the sakuya16c registers and status, and every memory bank.
+//
+// Hashing is incremental. The hash of every memory page is cached, and only pages written since the previous
+// call are rehashed, so hashing a machine that barely touched memory costs about as much as hashing the
+// registers. A hasher must always be used with the same memory device.
+class state_hasher {
+    u64 page_hashes[dev::memory::page_count] = {};
+    // Epoch mark of the last hash (0 means nothing has been hashed yet, so every page is dirty)
+    u64 mark = 0;
+public:
+    u64 hash(const sakuya16c& cpu, dev::memory& memory);
+};
+
+} // namespace vm
@@ -0,0 +1,185 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <tuple>
+#include <type_traits>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./interpreter.hpp"
+
+namespace vm {
+
+// Bus whose devices are fixed at compile time, for configurations that never add devices at runtime.
+//
+// Same interface as vm::bus, but the devices are stored by value and every access is dispatched by a chain of
+// range checks generated from the device list, with non-virtual calls, so the compiler can inline memory and small
+// device handlers into the interpreter. Later devices in the list take priority, same as vm::bus::add_mapper().
+//
+//     static_bus<dev::interrupt_controller, dev::timer> bus(cpu, dev::interrupt_controller(), dev::timer(sched));
+//     vm::execute(cpu, bus, instr);
+//
+// The memory mapper is always present and comes before every device in the list.
+template<typename... Devices>
+class static_bus {
+    static_assert((std::is_base_of_v<mapper_device, Devices> && ...), "static_bus devices must be mapper devices");
+
+    vm::sakuya16c& cpu;
+    dev::memory mem;
+    std::tuple<Devices...> devices;
+    // Number of read(), write(), read16() and write16() calls since reset, for the performance counters
+    mutable u64 accesses = 0;
+    // One bit per 256 byte page of the address space that a device other than memory claims part of
+    u64 device_pages[4] = {};
+
+    // Calls `access(device, addr)` with the highest priority device claiming an address, and the address remapped
+    // if the device asks for it. Calls are made on the exact device type, so they aren't virtual.
+    template<usize I = sizeof...(Devices), typename Self, typename F>
+    static decltype(auto) route(Self& self, u16 addr, F&& access) {
+        if constexpr (I == 0) {
+            return access(self.mem, addr);
+        } else {
+            auto& device = std::get<I - 1>(self.devices);
+            using device_type = std::tuple_element_t<I - 1, std::tuple<Devices...>>;
+            auto [range_start, range_end] = device.device_type::range();
+            if (addr >= range_start && addr <= range_end) {
+                return access(device, device.device_type::remap_range() ? u16(addr - range_start) : addr);
+            }
+            return route<I - 1>(self, addr, std::forward<F>(access));
+        }
+    }
+
+    // Whether the second byte of a 16bit access at (device) address `addr` is still inside the device, the same
+    // check mapper_device::read16() and write16() do.
+    template<typename D>
+    static bool second_byte_in_range(const D& device, u16 addr) {
+        auto [range_start, range_end] = device.D::range();
+        if (device.D::remap_range()) {
+            range_end = range_end - range_start;
+            range_start = 0;
+        }
+        return addr != 0xffff && u16(addr + 1) >= range_start && u16(addr + 1) <= range_end;
+    }
+
+    void claim_pages(const mapper_device& mapper) {
+        if (!mapper.claims_range()) {
+            return;
+        }
+        auto [range_start, range_end] = mapper.range();
+        for (usize page = range_start >> 8; page <= usize(range_end >> 8); page++) {
+            device_pages[page / 64] |= u64(1) << (page % 64);
+        }
+    }
+public:
+    static_bus(vm::sakuya16c& cpu, Devices&&... devices): cpu(cpu), mem(cpu), devices(std::move(devices)...) {
+        mem.irq_target = &cpu;
+        std::apply([&](auto&... device) {
+            ((device.irq_target = &cpu, claim_pages(device)), ...);
+        }, this->devices);
+    }
+    static_bus(const static_bus&) = delete;
+    static_bus& operator=(const static_bus&) = delete;
+
+    // Returns the device of a type in the list.
+    template<typename D>
+    D& get() { return std::get<D>(devices); }
+    template<typename D>
+    const D& get() const { return std::get<D>(devices); }
+
+    u8 read(u16 addr) const {
+        accesses++;
+        if (plain_memory(addr)) [[likely]] {
+            return mem.read(addr);
+        }
+        return route(*this, addr, [](const auto& device, u16 device_addr) {
+            using D = std::remove_cvref_t<decltype(device)>;
+            return device.D::read(device_addr);
+        });
+    }
+
+    void write(u16 addr, u8 val) {
+        accesses++;
+        if (plain_memory(addr)) [[likely]] {
+            mem.write(addr, val);
+            return;
+        }
+        route(*this, addr, [&](auto& device, u16 device_addr) {
+            using D = std::remove_cvref_t<decltype(device)>;
+            device.D::write(device_addr, val);
+        });
+    }
+
+    u16 read16(u16 addr) const {
+        accesses++;
+        auto access = [&](const auto& device, u16 device_addr) {
+            using D = std::remove_cvref_t<decltype(device)>;
+            u8 lo = device.D::read(device_addr);
+            if (!second_byte_in_range(device, device_addr)) {
+                cpu.raise(interrupt::bus_fault);
+                return u16(lo);
+            }
+            return word(lo, device.D::read(u16(device_addr + 1))).val;
+        };
+        if (plain_memory(addr)) [[likely]] {
+            return access(mem, addr);
+        }
+        return route(*this, addr, access);
+    }
+
+    void write16(u16 addr, u16 val) {
+        accesses++;
+        auto access = [&](auto& device, u16 device_addr) {
+            using D = std::remove_cvref_t<decltype(device)>;
+            device.D::write(device_addr, word(val).lo);
+            if (!second_byte_in_range(device, device_addr)) {
+                cpu.raise(interrupt::bus_fault);
+                return;
+            }
+            device.D::write(u16(device_addr + 1), word(val).hi);
+        };
+        if (plain_memory(addr)) [[likely]] {
+            access(mem, addr);
+            return;
+        }
+        route(*this, addr, access);
+    }
+
+    // Reads and writes made through the bus since reset. Instruction fetches don't go through here.
+    u64 access_count() const { return accesses; }
+
+    // Whether the whole 256 byte page holding an address goes to the memory mapper, so it can be accessed
+    // directly.
+    bool plain_memory(u16 addr) const { return !((device_pages[addr >> 14] >> ((addr >> 8) % 64)) & 1); }
+
+    dev::memory& memory() { return mem; }
+    const dev::memory& memory() const { return mem; }
+
+    void reset() {
+        accesses = 0;
+        mem.reset();
+        std::apply([](auto&... device) {
+            (device.reset(), ...);
+        }, devices);
+    }
+};
+
+// Executes a single instruction on a static bus, with the bus accesses of every handler inlined.
+template<typename... Devices>
+control_flow execute(sakuya16c& cpu, static_bus<Devices...>& bus, instr instr) {
+    return op::execute(cpu, bus, instr);
+}
+
+} // namespace vm
@@ -0,0 +1,80 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "./timer.hpp"
+
+namespace vm {
+
+void dev::timer::on_expiry(void* user, u64 now) {
+    auto* self = static_cast<timer*>(user);
+    self->raise(interrupt::timer);
+
+    if ((self->control & 0b10) && self->period != 0) {
+        // From the previous deadline rather than the current cycle, which can be past it by a whole instruction
+        // and its stall, so the period doesn't drift
+        self->deadline += self->period * PRESCALER;
+        self->expiry = self->sched.schedule(self->deadline, on_expiry, self);
+    } else {
+        self->control &= ~0b01;
+    }
+}
+
+void dev::timer::start() {
+    sched.cancel(expiry);
+    if ((control & 0b01) && period != 0) {
+        deadline = sched.cycles + period * PRESCALER;
+        expiry = sched.schedule(deadline, on_expiry, this);
+    }
+}
+
+u8 dev::timer::read(u16 addr) const {
+    switch (addr) {
+    case 0x00: return word(period).lo;
+    case 0x01: return word(period).hi;
+    case 0x02: return control;
+    case 0x04: case 0x05: {
+        u64 remaining = 0;
+        if (sched.scheduled(expiry)) {
+            // The clock can be slightly past the deadline until the scheduler gets to run the event
+            remaining = (deadline - std::min(deadline, sched.cycles)) / PRESCALER;
+        }
+        word val = u16(std::min<u64>(remaining, 0xffff));
+        return addr == 0x04 ? val.lo : val.hi;
+    }
+    default: return 0;
+    }
+}
+
+void dev::timer::write(u16 addr, u8 val) {
+    switch (addr) {
+    case 0x00: { word w = period; w.lo = val; period = w.val; } break;
+    case 0x01: { word w = period; w.hi = val; period = w.val; } break;
+    case 0x02: 
+        control = val & 0b11;
+        start();
+        break;
+    default: break;
+    }
+}
+
+void dev::timer::reset() {
+    sched.cancel(expiry);
+    period = 0;
+    control = 0;
+}
+
+} // namespace vm
@@ -0,0 +1,59 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Programmable interval timer. Raises the timer interrupt when it expires, optionally reloading itself.
+    //
+    // Registers:
+    //   $00  period (16bit), in units of 16 cycles
+    //   $02  control (8bit). Bit 0 starts the timer, bit 1 makes it repeat. Writing restarts the timer.
+    //   $04  remaining time (16bit, read only), in units of 16 cycles
+    //
+    // The timer doesn't count anything while running: it schedules its expiry and computes the remaining time
+    // from the scheduler clock when read.
+    class timer: public mapper_device {
+        scheduler& sched;
+        event_handle expiry;
+        u64 deadline = 0;
+        u16 period = 0;
+        u8 control = 0;
+
+        static void on_expiry(void* user, u64 now);
+        void start();
+    public:
+        static constexpr u16 BASE = 0x7040;
+        // Cycles per timer tick
+        static constexpr u64 PRESCALER = 16;
+
+        timer(scheduler& sched): sched(sched) {}
+
+        const char* name() const override { return "TIMER"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + 0x05}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+    };
+} // namespace dev
+
+} // namespace vm
@@ -0,0 +1,250 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+
+#include "./video.hpp"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace vm {
+
+void palette_to_rgba(const u8* indices, usize count, const u32 palette[16], u32* dst) {
+    usize i = 0;
+
+#if defined(__SSSE3__) || defined(__aarch64__)
+    // Split the palette into one 16 byte table per channel, so each channel of 16 pixels is a single table lookup
+    alignas(16) u8 planes[4][16];
+    for (usize color = 0; color < 16; color++) {
+        for (usize channel = 0; channel < 4; channel++) {
+            planes[channel][color] = u8(palette[color] >> (8 * channel));
+        }
+    }
+#endif
+
+#if defined(__SSSE3__)
+    const __m128i r_table = _mm_load_si128((const __m128i*) planes[0]);
+    const __m128i g_table = _mm_load_si128((const __m128i*) planes[1]);
+    const __m128i b_table = _mm_load_si128((const __m128i*) planes[2]);
+    const __m128i a_table = _mm_load_si128((const __m128i*) planes[3]);
+    const __m128i index_mask = _mm_set1_epi8(0x0f);
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*) (indices + i)), index_mask);
+        __m128i r = _mm_shuffle_epi8(r_table, idx);
+        __m128i g = _mm_shuffle_epi8(g_table, idx);
+        __m128i b = _mm_shuffle_epi8(b_table, idx);
+        __m128i a = _mm_shuffle_epi8(a_table, idx);
+
+        // Interleave the channels back into RGBA pixels
+        __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+        __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+        __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i*) (dst + i + 4), _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i*) (dst + i + 8), _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128((__m128i*) (dst + i + 12), _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+#elif defined(__aarch64__)
+    uint8x16x4_t tables = {{vld1q_u8(planes[0]), vld1q_u8(planes[1]), vld1q_u8(planes[2]), vld1q_u8(planes[3])}};
+    const uint8x16_t index_mask = vdupq_n_u8(0x0f);
+
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t idx = vandq_u8(vld1q_u8(indices + i), index_mask);
+        uint8x16x4_t rgba = {{
+            vqtbl1q_u8(tables.val[0], idx), vqtbl1q_u8(tables.val[1], idx),
+            vqtbl1q_u8(tables.val[2], idx), vqtbl1q_u8(tables.val[3], idx),
+        }};
+        // Interleaving store, writes the channels back as RGBA pixels
+        vst4q_u8((u8*) (dst + i), rgba);
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[i] = palette[indices[i] & 0x0f];
+    }
+}
+
+// Converts a $0RGB color to RGBA8888, with R in the lowest byte so it's first in memory
+static u32 rgb444_to_rgba(u16 color) {
+    u32 r = ((color >> 8) & 0xf) * 0x11;
+    u32 g = ((color >> 4) & 0xf) * 0x11;
+    u32 b = (color & 0xf) * 0x11;
+    return r | (g << 8) | (b << 16) | (0xffu << 24);
+}
+
+dev::framebuffer::framebuffer(scheduler& sched): sched(sched) {
+    vram = std::unique_ptr<u8[]>(new u8[VRAM_SIZE]);
+    memset(vram.get(), 0, VRAM_SIZE);
+    mark_all_dirty();
+}
+
+void dev::framebuffer::on_vblank(void* user, u64 now) {
+    auto* self = static_cast<framebuffer*>(user);
+    self->frame++;
+    self->raise(interrupt::vblank);
+
+    // Frames are counted from the previous deadline, so late events don't make the frame rate drift
+    self->next_vblank += CYCLES_PER_FRAME;
+    self->vblank = self->sched.schedule(self->next_vblank, on_vblank, self);
+}
+
+u8 dev::framebuffer::read(u16 addr) const {
+    if (addr >= WINDOW_OFFSET) {
+        usize offset = bank * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+        return offset < VRAM_SIZE ? vram[offset] : 0;
+    }
+
+    switch (addr) {
+    case 0x00: return bank;
+    case 0x02: return word(frame).lo;
+    case 0x03: return word(frame).hi;
+    default: break;
+    }
+    if (addr >= 0x10 && addr < 0x30) {
+        word color = palette[(addr - 0x10) / 2];
+        return addr % 2 == 0 ? color.lo : color.hi;
+    }
+    return 0;
+}
+
+void dev::framebuffer::write(u16 addr, u8 val) {
+    if (addr >= WINDOW_OFFSET) {
+        usize offset = bank * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+        if (offset >= VRAM_SIZE || vram[offset] == val) {
+            return;
+        }
+        vram[offset] = val;
+        vram_written = true;
+        mark_dirty(offset % WIDTH, offset / WIDTH);
+        return;
+    }
+
+    if (addr == 0x00) {
+        bank = val % BANK_COUNT;
+    } else if (addr >= 0x10 && addr < 0x30) {
+        usize index = (addr - 0x10) / 2;
+        word color = palette[index];
+        if (addr % 2 == 0) color.lo = val;
+        else color.hi = val;
+        palette[index] = color.val;
+        palette_rgba[index] = rgb444_to_rgba(color.val);
+        // Every pixel using this color changes
+        mark_all_dirty();
+    }
+}
+
+usize dev::framebuffer::vram_offset(u16 addr, u16 size) const {
+    if (addr < WINDOW_OFFSET || size == 0 || addr - WINDOW_OFFSET + size > WINDOW_SIZE) {
+        return VRAM_SIZE;
+    }
+    usize offset = bank * WINDOW_SIZE + (addr - WINDOW_OFFSET);
+    return offset + size <= VRAM_SIZE ? offset : VRAM_SIZE;
+}
+
+const u8* dev::framebuffer::direct_read(u16 addr, u16 size) const {
+    usize offset = vram_offset(addr, size);
+    return offset < VRAM_SIZE ? vram.get() + offset : nullptr;
+}
+
+u8* dev::framebuffer::direct_write(u16 addr, u16 size) {
+    usize offset = vram_offset(addr, size);
+    if (offset >= VRAM_SIZE) {
+        return nullptr;
+    }
+    // Every row the range touches, over the whole width
+    for (usize y = offset / WIDTH; y <= (offset + size - 1) / WIDTH; y++) {
+        dirty_rows[y / 64] |= u64(1) << (y % 64);
+    }
+    dirty_min_x = 0;
+    dirty_max_x = WIDTH - 1;
+    vram_written = true;
+    return vram.get() + offset;
+}
+
+void dev::framebuffer::reset() {
+    if (vram_written) {
+        memset(vram.get(), 0, VRAM_SIZE);
+        vram_written = false;
+    }
+    for (usize i = 0; i < 16; i++) {
+        palette[i] = 0;
+        palette_rgba[i] = rgb444_to_rgba(0);
+    }
+    bank = 0;
+    frame = 0;
+    mark_all_dirty();
+
+    sched.cancel(vblank);
+    next_vblank = sched.cycles + CYCLES_PER_FRAME;
+    vblank = sched.schedule(next_vblank, on_vblank, this);
+}
+
+void dev::framebuffer::mark_dirty(usize x, usize y) {
+    if (!any_dirty()) {
+        dirty_min_x = u16(x);
+        dirty_max_x = u16(x);
+    } else {
+        dirty_min_x = std::min(dirty_min_x, u16(x));
+        dirty_max_x = std::max(dirty_max_x, u16(x));
+    }
+    dirty_rows[y / 64] |= u64(1) << (y % 64);
+}
+
+void dev::framebuffer::mark_all_dirty() {
+    for (usize y = 0; y < HEIGHT; y++) {
+        dirty_rows[y / 64] |= u64(1) << (y % 64);
+    }
+    dirty_min_x = 0;
+    dirty_max_x = WIDTH - 1;
+}
+
+bool dev::framebuffer::any_dirty() const {
+    for (u64 rows : dirty_rows) {
+        if (rows) return true;
+    }
+    return false;
+}
+
+void dev::framebuffer::clear_dirty() {
+    memset(dirty_rows, 0, sizeof(dirty_rows));
+}
+
+void dev::framebuffer::write_row(usize y, const u8* src) {
+    u8* row = vram.get() + y * WIDTH;
+    usize first = 0;
+    while (first < WIDTH && row[first] == src[first]) first++;
+    if (first == WIDTH) {
+        return;
+    }
+    usize last = WIDTH - 1;
+    while (row[last] == src[last]) last--;
+
+    memcpy(row + first, src + first, last - first + 1);
+    vram_written = true;
+    mark_dirty(first, y);
+    mark_dirty(last, y);
+}
+
+void dev::framebuffer::convert_row(usize x, usize y, usize width, u32* dst) const {
+    palette_to_rgba(vram.get() + y * WIDTH + x, width, palette_rgba, dst);
+}
+
+} // namespace vm
@@ -0,0 +1,108 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <span>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+#include "./scheduler.hpp"
+
+namespace vm {
+
+namespace dev {
+    // Palette indexed framebuffer. Every pixel is one byte of VRAM holding a palette index (only the low 4 bits
+    // are used), and VRAM is too big for the address space so it's seen through a banked 4KiB window.
+    //
+    // Registers:
+    //   $000       VRAM bank visible in the window (8bit)
+    //   $002       frame counter (16bit, read only), incremented every vblank
+    //   $010..$02f palette, 16 colors in $0RGB format (16bit each)
+    //   $100..$10ff VRAM window
+    //
+    // Raises the vblank interrupt 60 times per second of guest time.
+    //
+    // The host only converts and uploads what changed: writes mark their row as dirty and grow the dirty
+    // column span, and palette writes mark the whole screen as dirty.
+    class framebuffer: public mapper_device {
+    public:
+        static constexpr u16 BASE = 0x5e00;
+        static constexpr usize WIDTH = 160;
+        static constexpr usize HEIGHT = 120;
+        static constexpr usize WINDOW_OFFSET = 0x100;
+        static constexpr usize WINDOW_SIZE = 0x1000;
+        static constexpr usize VRAM_SIZE = WIDTH * HEIGHT;
+        static constexpr usize BANK_COUNT = (VRAM_SIZE + WINDOW_SIZE - 1) / WINDOW_SIZE;
+        static constexpr u64 CYCLES_PER_FRAME = CPU_CLOCK_HZ / 60;
+    private:
+        std::unique_ptr<u8[]> vram;
+        // Guest palette in $0RGB format, and the same colors converted to RGBA8888 for the host
+        u16 palette[16] = {};
+        u32 palette_rgba[16] = {};
+        u8 bank = 0;
+        u16 frame = 0;
+        // Whether VRAM was written since the last reset, so resets can skip clearing it
+        bool vram_written = false;
+
+        // Dirty rows (one bit per row) and the column span touched since the last clear_dirty()
+        u64 dirty_rows[(HEIGHT + 63) / 64] = {};
+        u16 dirty_min_x = 0;
+        u16 dirty_max_x = 0;
+
+        scheduler& sched;
+        event_handle vblank;
+        u64 next_vblank = 0;
+
+        static void on_vblank(void* user, u64 now);
+        // VRAM offset of a window address, or VRAM_SIZE if [addr, addr + size) is not entirely inside VRAM
+        usize vram_offset(u16 addr, u16 size) const;
+        void mark_dirty(usize x, usize y);
+        void mark_all_dirty();
+    public:
+        framebuffer(scheduler& sched);
+
+        const char* name() const override { return "FRAMEBUFFER"; }
+        std::pair<u16, u16> range() const override { return {BASE, BASE + WINDOW_OFFSET + WINDOW_SIZE - 1}; }
+        bool remap_range() const override { return true; }
+
+        u8 read(u16 addr) const override;
+        void write(u16 addr, u8 val) override;
+        void reset() override;
+
+        // Direct access to the VRAM window, so DMA can fill the screen in bulk
+        const u8* direct_read(u16 addr, u16 size) const override;
+        u8* direct_write(u16 addr, u16 size) override;
+
+        // Host side
+        std::span<const u8> pixels() const { return {vram.get(), VRAM_SIZE}; }
+        bool row_dirty(usize y) const { return dirty_rows[y / 64] & (u64(1) << (y % 64)); }
+        bool any_dirty() const;
+        // Column span [min_x, max_x] written since the last clear_dirty(). Only meaningful if any_dirty().
+        std::pair<usize, usize> dirty_columns() const { return {dirty_min_x, dirty_max_x}; }
+        void clear_dirty();
+
+        // Replaces row `y` of VRAM with WIDTH pixels, only marking what changed as dirty. Used by the PPU.
+        void write_row(usize y, const u8* src);
+
+        // Converts `width` pixels of row `y`, starting at column `x`, into RGBA8888 (R first in memory).
+        void convert_row(usize x, usize y, usize width, u32* dst) const;
+    };
+} // namespace dev
+
+// Converts palette indices to RGBA8888 through a 16 color palette. Only the low 4 bits of each index are used.
+// Vectorized with SSSE3 or NEON when available.
+void palette_to_rgba(const u8* indices, usize count, const u32 palette[16], u32* dst);
+
+} // namespace vm
@@ -79,7 +79,7 @@ enum class reg: u8 {
 
 // Operation code for sakuya16c assembly instructions.
 //
-// Documentation for what each instruction does is in ./vm.cpp
+// Documentation for what each instruction does is in ./interpreter.hpp, and each opcode needs a row in isa::table (./isa.hpp)
 enum class opcode: u8 {
     nop = 0,
     hlt,
@@ -90,6 +90,46 @@ enum class opcode: u8 {
     mov_mem_reg,
 
     add_reg_reg,
+
+    rti,
+
+    // Packed instructions, treating registers as two 8bit lanes (`lo` and `hi`)
+    paddus_reg_reg,
+    psubus_reg_reg,
+    pminu_reg_reg,
+    pmaxu_reg_reg,
+    pcmpeq_reg_reg,
+    pshuf_reg_reg_lit,
+
+    // Block instructions, applying a byte operation to a span of memory
+    baddus_reg_reg_lit,
+    bsubus_reg_reg_lit,
+    bminu_reg_reg_lit,
+    bmaxu_reg_reg_lit,
+
+    // Runs a routine natively on the host (see host_call)
+    trap_lit,
+};
+
+// Routines the host runs natively for TRAP, numbered by its literal. Arguments are in r0, r1 and r2, and results
+// in ac (and r3). See ./hostcall.hpp.
+enum class host_call: u16 {
+    // Copies r2 bytes from r1 to r0, as if through a temporary buffer (like memmove)
+    memmove,
+    // Fills r2 bytes at r0 with the low byte of r1
+    memset,
+    // Unsigned and signed 16bit multiplication of r0 by r1. ac is the low word of the result and r3 the high word.
+    mulu,
+    muls,
+    // Unsigned and signed 16bit division of r0 by r1. ac is the quotient and r3 the remainder. Dividing by zero
+    // gives a quotient of $ffff (-1 signed) and a remainder of r0, and $8000 / -1 gives $8000 and 0.
+    divu,
+    divs,
+    // Compares the NUL terminated strings at r0 and r1 (at most 64KiB). ac is -1, 0 or 1.
+    strcmp,
+    // Decompresses the LZ4 block of r2 bytes at r1 into r0. ac is the number of bytes written, and r3 is 0, or 1 if
+    // the block is malformed (everything up to the error is written).
+    lz4_decompress,
 };
 
 // An instruction is ALWAYS 4 bytes wide, no matter the argument number. 
@@ -100,11 +140,7 @@ struct instr {
     u8 args[3];
 
     // Constructor (8bit argument - 8bit argument - 8bit argument)
-    instr(opcode op, u8 arg1 = 0, u8 arg2 = 0, u8 arg3 = 0): op(op) {
-        args[0] = arg1;
-        args[1] = arg2;
-        args[2] = arg3;
-    }
+    constexpr instr(opcode op, u8 arg1 = 0, u8 arg2 = 0, u8 arg3 = 0): op(op), args{arg1, arg2, arg3} {}
 
     // Constructor (8bit argument - 16bit argument)
     instr(opcode op, u8 arg1, word arg2): op(op) {
@@ -127,8 +163,34 @@ struct instr {
 };
 static_assert(sizeof(instr) == 4);
 
+// Interrupt lines of the sakuya16c. Each one has a bit in the `im` register and in the status flags, and a
+// vector in the interrupt controller.
+enum class interrupt: u8 {
+    // A memory access went outside of a device's range
+    bus_fault = 0,
+    // The CPU tried to execute an invalid instruction
+    invalid_opcode,
+    // Raised by software through the interrupt controller
+    software,
+    // A timer expired
+    timer,
+    // The display finished drawing a frame
+    vblank,
+    // A sound sample finished playing
+    audio,
+    // A DMA transfer finished
+    dma,
+};
+
+// Faults can't be masked by `im`.
+constexpr u16 FAULT_INTERRUPTS = (1 << u8(interrupt::bus_fault)) | (1 << u8(interrupt::invalid_opcode));
+
 struct status {
-    // todo
+    // Interrupts that have been raised but not serviced yet (one bit per interrupt line)
+    u16 raised = 0;
+    // Raised interrupts that are not masked. The interpreter only ever checks this, so it must be kept in sync
+    // with `raised` and `im` (see sakuya16c::update_pending())
+    u16 pending = 0;
 };
 
 // Value returned from an instruction to indicate the state of the CPU
@@ -141,6 +203,9 @@ enum class control_flow {
     error,
 };
 
+// Clock frequency of the sakuya16c, in cycles per second.
+constexpr u64 CPU_CLOCK_HZ = 4'000'000;
+
 // The sakuya16c is a 16-bit fantasy CPU made for the remi16 fantasy console.
 //
 // It executes 4-byte instructions (dwordcode?)
@@ -148,22 +213,69 @@ struct sakuya16c {
     // Registers are stored contiguously in an array and indexed by helper methods.
     u16 registers[16] = {};
     // Status flags
-    status status = {};
+    vm::status status = {};
+    // Writes that changed `mb` since reset, for the performance counters
+    u64 bank_switches = 0;
+    // Cycles the instruction being executed takes on top of its cost in isa::table (block instructions). Whoever
+    // runs the instruction adds them to the clock and clears them.
+    u32 stall = 0;
 
     // Sets the value of a register.
-    inline void set(reg reg, u16 val) { registers[u8(reg)] = val; }
+    inline void set(vm::reg reg, u16 val) { 
+        // `im` and `mb` are next to each other, so both are caught with a single comparison
+        static_assert(u8(vm::reg::mb) == u8(vm::reg::im) + 1);
+        if (u8(u8(reg) - u8(vm::reg::im)) <= 1) [[unlikely]] {
+            if (reg == vm::reg::mb && registers[u8(reg)] != val) bank_switches++;
+            registers[u8(reg)] = val;
+            if (reg == vm::reg::im) update_pending();
+            return;
+        }
+        registers[u8(reg)] = val; 
+    }
     // Gets the value of a register.
-    inline u16 reg(reg reg) const { return registers[u8(reg)]; }
+    inline u16 reg(vm::reg reg) const { return registers[u8(reg)]; }
+
+    // Raises an interrupt. It will be serviced before the next instruction if it's not masked.
+    inline void raise(interrupt line) {
+        status.raised |= u16(1 << u8(line));
+        update_pending();
+    }
+    // Clears a raised interrupt without servicing it.
+    inline void acknowledge(interrupt line) {
+        status.raised &= u16(~(1 << u8(line)));
+        update_pending();
+    }
+    // Recomputes the combined pending flag from the raised interrupts and `im`.
+    inline void update_pending() { 
+        status.pending = status.raised & (registers[u8(vm::reg::im)] | FAULT_INTERRUPTS); 
+    }
 
     inline void reset() {
         memset(registers, 0, sizeof(registers));
         status = {};
+        bank_switches = 0;
+        stall = 0;
     }
 };
 
 class bus;
 
+// Handler that executes one opcode
+typedef control_flow (*opcode_func)(sakuya16c& cpu, bus& bus, instr instr);
+
+// An instruction paired with the handler of its opcode, so the lookup is only done once per decode.
+struct decoded_instr {
+    opcode_func func = nullptr;
+    vm::instr instr = vm::instr(opcode::nop);
+};
+
 // Executes a single instruction.
 control_flow execute(sakuya16c& cpu, bus& bus, instr instr);
+// Looks up the handler of an instruction.
+decoded_instr decode(instr instr);
+// Executes an instruction that was already decoded.
+inline control_flow execute(sakuya16c& cpu, bus& bus, const decoded_instr& decoded) {
+    return decoded.func(cpu, bus, decoded.instr);
+}
 
 } // namespace vm
\ No newline at end of file
@@ -0,0 +1,272 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+
+#if defined(__linux__)
+#include <signal.h>
+#include <unistd.h>
+#define REMI16_WATCHPOINTS 1
+#else
+#define REMI16_WATCHPOINTS 0
+#endif
+
+#include "./watchpoints.hpp"
+
+namespace vm {
+
+#if REMI16_WATCHPOINTS
+// Process-wide SIGSEGV handler that finds which watchpoints a fault belongs to. Faults that don't belong to any
+// go to the handler that was there before.
+class watch_fault_handler {
+    static constexpr usize MAX_REGISTERED = 16;
+    static inline std::atomic<watchpoints*> registered[MAX_REGISTERED] = {};
+    static inline struct sigaction previous = {};
+    static inline std::once_flag installed;
+
+    static void on_fault(int number, siginfo_t* info, void* context) {
+        for (auto& slot : registered) {
+            watchpoints* watch = slot.load(std::memory_order_acquire);
+            if (watch && watch->fault(info->si_addr)) {
+                return;
+            }
+        }
+
+        if (previous.sa_flags & SA_SIGINFO) {
+            previous.sa_sigaction(number, info, context);
+        } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+            previous.sa_handler(number);
+        } else {
+            // Returning runs the faulting instruction again, which now crashes like it would have
+            signal(number, SIG_DFL);
+        }
+    }
+public:
+    static bool add(watchpoints* watch) {
+        std::call_once(installed, [] {
+            struct sigaction action = {};
+            action.sa_sigaction = on_fault;
+            action.sa_flags = SA_SIGINFO;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGSEGV, &action, &previous);
+        });
+        for (auto& slot : registered) {
+            watchpoints* empty = nullptr;
+            if (slot.compare_exchange_strong(empty, watch)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void remove(watchpoints* watch) {
+        for (auto& slot : registered) {
+            watchpoints* expected = watch;
+            slot.compare_exchange_strong(expected, nullptr);
+        }
+    }
+};
+#endif
+
+watchpoints::watchpoints(dev::memory& memory, u8& stop_requested): memory(memory), stop_requested(stop_requested) {
+#if REMI16_WATCHPOINTS
+    host_page_size = usize(sysconf(_SC_PAGESIZE));
+    usize size = memory.host_memory().size();
+    assert((size + host_page_size - 1) / host_page_size <= 64 && "Too many host pages to watch");
+    page_watches.resize((size + host_page_size - 1) / host_page_size);
+#else
+    // Nothing can be watched, so there are no pages to keep track of
+    host_page_size = dev::memory::page_size;
+#endif
+}
+
+watchpoints::~watchpoints() {
+    disarm();
+#if REMI16_WATCHPOINTS
+    if (registered) {
+        watch_fault_handler::remove(this);
+    }
+#endif
+}
+
+void watchpoints::set_watched(u16 bank, u16 addr, usize size, bool watch) {
+    if (!watched) {
+        watched = std::unique_ptr<u64[]>(new u64[(memory.host_memory().size() + 63) / 64]());
+    }
+    for (usize i = 0; i < size; i++) {
+        usize offset = dev::memory::host_offset(bank, u16(addr + i));
+        if (is_watched(offset) == watch) {
+            continue;
+        }
+        watched[offset / 64] ^= u64(1) << (offset % 64);
+        page_watches[offset / host_page_size] += watch ? 1 : -1;
+        watched_bytes += watch ? 1 : -1;
+    }
+
+    u64 pages = 0;
+    for (usize page = 0; page < page_watches.size(); page++) {
+        if (page_watches[page] > 0) {
+            pages |= u64(1) << page;
+        }
+    }
+    watched_pages = pages;
+}
+
+bool watchpoints::add(u16 bank, u16 addr, usize size) {
+#if REMI16_WATCHPOINTS
+    if (!registered) {
+        if (!watch_fault_handler::add(this)) {
+            return false;
+        }
+        registered = true;
+    }
+
+    disarm();
+    set_watched(bank, addr, size, true);
+    arm();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void watchpoints::remove(u16 bank, u16 addr, usize size) {
+    if (watched_bytes == 0) {
+        return;
+    }
+    disarm();
+    set_watched(bank, addr, size, false);
+    arm();
+}
+
+void watchpoints::clear() {
+    disarm();
+    if (watched) {
+        memset(watched.get(), 0, (memory.host_memory().size() + 63) / 64 * sizeof(u64));
+    }
+    std::fill(page_watches.begin(), page_watches.end(), 0);
+    watched_bytes = 0;
+    watched_pages = 0;
+    written_pages = 0;
+    hit_offset = NO_HIT;
+}
+
+bool watchpoints::fault(const void* addr) {
+    std::span<u8> host = memory.host_memory();
+    const u8* byte = (const u8*) addr;
+    if (byte < host.data() || byte >= host.data() + host.size()) {
+        return false;
+    }
+    usize offset = byte - host.data();
+    usize page = offset / host_page_size;
+    u64 bit = u64(1) << page;
+    // Pages stay watched while they're writable, so a thread that faulted right before another one unprotected the
+    // page just writes again
+    if (!(watched_pages.load(std::memory_order_relaxed) & bit)) {
+        return false;
+    }
+
+    usize page_size = std::min(host_page_size, host.size() - page * host_page_size);
+    memory.protect(page * host_page_size, page_size, true);
+    protected_pages.fetch_and(~bit, std::memory_order_relaxed);
+    written_pages.fetch_or(bit, std::memory_order_relaxed);
+    if (is_watched(offset)) {
+        usize none = NO_HIT;
+        hit_offset.compare_exchange_strong(none, offset, std::memory_order_relaxed);
+    }
+    std::atomic_ref(stop_requested).fetch_or(STOP_BIT, std::memory_order_relaxed);
+    return true;
+}
+
+bool watchpoints::handle_stop() {
+    u64 written = written_pages.exchange(0, std::memory_order_relaxed);
+    if (!written) {
+        return false;
+    }
+
+    std::span<u8> host = memory.host_memory();
+    for (usize page = 0; page < page_watches.size(); page++) {
+        if (!((written >> page) & 1)) {
+            continue;
+        }
+        usize start = page * host_page_size;
+        usize size = std::min(host_page_size, host.size() - start);
+
+        // Writes after the fault didn't fault, so look for the watched bytes they changed
+        for (usize offset = start; offset < start + size && hit_offset == NO_HIT; offset++) {
+            if (is_watched(offset) && host[offset] != shadow[offset]) {
+                hit_offset = offset;
+            }
+        }
+
+        memcpy(shadow.get() + start, host.data() + start, size);
+        if (page_watches[page] > 0 && memory.protect(start, size, false)) {
+            protected_pages.fetch_or(u64(1) << page, std::memory_order_relaxed);
+        }
+    }
+    return hit_offset == NO_HIT;
+}
+
+bool watchpoints::take_hit(watch_hit& hit) {
+    usize offset = hit_offset.exchange(NO_HIT, std::memory_order_relaxed);
+    if (offset == NO_HIT) {
+        return false;
+    }
+    usize half = offset / 0x8000;
+    hit.bank = half == 0 ? 0 : u16(half - 1);
+    hit.addr = u16(half == 0 ? offset : 0x8000 + offset % 0x8000);
+    return true;
+}
+
+void watchpoints::disarm() {
+    u64 pages = protected_pages.exchange(0, std::memory_order_relaxed);
+    std::span<u8> host = memory.host_memory();
+    for (usize page = 0; page < page_watches.size(); page++) {
+        if ((pages >> page) & 1) {
+            memory.protect(page * host_page_size, std::min(host_page_size, host.size() - page * host_page_size), true);
+        }
+    }
+}
+
+void watchpoints::arm() {
+    written_pages = 0;
+    hit_offset = NO_HIT;
+    if (watched_bytes == 0) {
+        return;
+    }
+
+    std::span<u8> host = memory.host_memory();
+    if (!shadow) {
+        shadow = std::unique_ptr<u8[]>(new u8[host.size()]);
+    }
+    u64 pages = 0;
+    for (usize page = 0; page < page_watches.size(); page++) {
+        if (page_watches[page] == 0) {
+            continue;
+        }
+        usize start = page * host_page_size;
+        usize size = std::min(host_page_size, host.size() - start);
+        memcpy(shadow.get() + start, host.data() + start, size);
+        if (memory.protect(start, size, false)) {
+            pages |= u64(1) << page;
+        }
+    }
+    protected_pages = pages;
+}
+
+} // namespace vm
@@ -0,0 +1,104 @@
+// remi16 - 16-bit retro fantasy console
+// Copyright (C) 2025 - suleyth
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "./vm.hpp"
+#include "./mapper.hpp"
+
+namespace vm {
+
+// Where a watched write happened. `bank` is 0 for the low half.
+struct watch_hit {
+    u16 bank;
+    u16 addr;
+};
+
+// Write watchpoints on memory, which cost nothing to code that doesn't write to a watched page.
+//
+// Instead of checking writes, the host pages backing watched bytes are made read-only. The first write to one of
+// them faults, and the fault handler makes the page writable again, takes note of the write and asks the machine
+// to stop. Once it has stopped, handle_stop() protects the page again and tells whether a watched byte was
+// written. Writes to the rest of the page make the machine stop and go on again, which costs a fault and a couple
+// of system calls.
+//
+// Only the first write to a page between two stops faults, so any other watched byte of the page that changed
+// value counts as written too. Writing the value a byte already holds is only caught if it faults. Compiled code
+// only stops when it yields back to the interpreter, so its hits are reported late.
+//
+// Page protection is only available on Linux. Elsewhere add() always fails.
+class watchpoints {
+    friend class watch_fault_handler;
+
+    dev::memory& memory;
+    u8& stop_requested;
+    usize host_page_size;
+
+    // One bit per watched byte of host_memory(), and number of watched bytes per host page
+    std::unique_ptr<u64[]> watched;
+    std::vector<u32> page_watches;
+    usize watched_bytes = 0;
+    // Host memory as of the last time each page was protected, to find watched bytes written without a fault
+    std::unique_ptr<u8[]> shadow;
+
+    // One bit per host page. Pages with watched bytes, the ones currently read-only, and the ones written since
+    // the last stop.
+    std::atomic<u64> watched_pages = 0;
+    std::atomic<u64> protected_pages = 0;
+    std::atomic<u64> written_pages = 0;
+    // host_memory() offset of the first watched byte written since the hit was last taken
+    static constexpr usize NO_HIT = SIZE_MAX;
+    std::atomic<usize> hit_offset = NO_HIT;
+    // Whether the fault handler is looking at this instance
+    bool registered = false;
+
+    bool is_watched(usize offset) const { return (watched[offset / 64] >> (offset % 64)) & 1; }
+    void set_watched(u16 bank, u16 addr, usize size, bool watch);
+    // Called by the fault handler. Returns false if the fault isn't a write to a page protected by this instance.
+    bool fault(const void* addr);
+public:
+    // Bit the fault handler sets in `stop_requested`, apart from anything else that stops the machine
+    static constexpr u8 STOP_BIT = 0x80;
+
+    // Stops the machine by setting STOP_BIT in `stop_requested` when a watched page is written.
+    watchpoints(dev::memory& memory, u8& stop_requested);
+    watchpoints(const watchpoints&) = delete;
+    watchpoints& operator=(const watchpoints&) = delete;
+    ~watchpoints();
+
+    // Watches writes to [addr, addr + size), as seen through a bank (ignored in the low half). Returns false if
+    // the host can't protect memory.
+    bool add(u16 bank, u16 addr, usize size);
+    void remove(u16 bank, u16 addr, usize size);
+    void clear();
+    usize count() const { return watched_bytes; }
+
+    // Called by the machine whenever it stops. Protects the pages written since the last stop again, and returns
+    // true if they only had unwatched bytes written. The machine can go on if nothing but STOP_BIT stopped it.
+    bool handle_stop();
+    // Returns the watched byte that made the machine stop, and forgets it. Returns false if there's none.
+    bool take_hit(watch_hit& hit);
+
+    // Makes every page writable, for writes by the host itself (resets, loading, debuggers) which shouldn't count
+    // as hits.
+    void disarm();
+    // Protects every watched page again, and forgets any write seen before.
+    void arm();
+};
+
+} // namespace vm